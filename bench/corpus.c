@@ -0,0 +1,751 @@
+/* This file is placed in the public domain. */
+/*
+ * Generator of synthetic netlink traffic that looks like what the kernel
+ * sends: links and IPv4 routes with multipath next hops, conntrack
+ * entries, packets queued to user-space or logged via NFLOG and kobject
+ * uevents. Every entry is built from its index, so the same traffic is
+ * produced on every run.
+ *
+ * On top of the realistic attributes, each message can carry any number
+ * of extra attributes of a given size, possibly held by a chain of nests,
+ * to stress the parsers. Parsers that skip unknown attributes, as the
+ * examples do, walk over them.
+ *
+ * The messages can be generated one by one, packed into datagrams like
+ * the kernel does, eg. to write them to a pcap file, kept in memory as a
+ * corpus or produced on demand by the fake kernel endpoint.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+#include <linux/netfilter/nfnetlink_log.h>
+#include <linux/netfilter/nfnetlink_queue.h>
+
+#include "corpus.h"
+
+#define CORPUS_ATTR_MAX		(UINT16_MAX - sizeof(struct nlattr))
+
+/* source of the packets and of the extra attributes. */
+static const uint8_t zero[CORPUS_ATTR_MAX];
+
+/* cheap mixing, so that the entries do not all look the same. */
+static uint32_t mix(uint64_t idx)
+{
+	uint64_t x = idx * 0x9e3779b97f4a7c15ULL;
+
+	return (x ^ (x >> 29)) & 0xffffffff;
+}
+
+static void put_nfgenmsg(struct nlmsghdr *nlh, uint16_t res_id)
+{
+	struct nfgenmsg *nfg;
+
+	nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(struct nfgenmsg));
+	nfg->nfgen_family = AF_INET;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(res_id);
+}
+
+/* a mix of small, medium and full sized packets, as seen on the wire. */
+static void put_packet(struct nlmsghdr *nlh, uint16_t type, uint32_t r,
+		       const struct corpus_params *p)
+{
+	static const uint16_t sizes[] = { 60, 60, 576, 1500 };
+	uint16_t size = p->payload ? p->payload : sizes[r & 3];
+	struct nlattr *attr;
+	uint8_t *ip;
+
+	attr = mnl_nlmsg_get_payload_tail(nlh);
+	mnl_attr_put(nlh, type, size, zero);
+	if (size < 20)
+		return;
+
+	ip = mnl_attr_get_payload(attr);
+	ip[0] = 0x45;
+	ip[2] = size >> 8;
+	ip[3] = size;
+	ip[8] = 64;
+	ip[9] = (r & 1) ? IPPROTO_TCP : IPPROTO_UDP;
+}
+
+static void put_ct_tuple(struct nlmsghdr *nlh, uint16_t type, uint32_t src,
+			 uint32_t dst, uint8_t proto, uint16_t sport,
+			 uint16_t dport)
+{
+	struct nlattr *tuple, *nest;
+
+	tuple = mnl_attr_nest_start(nlh, type);
+
+	nest = mnl_attr_nest_start(nlh, CTA_TUPLE_IP);
+	mnl_attr_put_u32(nlh, CTA_IP_V4_SRC, htonl(src));
+	mnl_attr_put_u32(nlh, CTA_IP_V4_DST, htonl(dst));
+	mnl_attr_nest_end(nlh, nest);
+
+	nest = mnl_attr_nest_start(nlh, CTA_TUPLE_PROTO);
+	mnl_attr_put_u8(nlh, CTA_PROTO_NUM, proto);
+	mnl_attr_put_u16(nlh, CTA_PROTO_SRC_PORT, htons(sport));
+	mnl_attr_put_u16(nlh, CTA_PROTO_DST_PORT, htons(dport));
+	mnl_attr_nest_end(nlh, nest);
+
+	mnl_attr_nest_end(nlh, tuple);
+}
+
+static void put_ct_counters(struct nlmsghdr *nlh, uint16_t type,
+			    uint64_t packets)
+{
+	struct nlattr *nest;
+
+	nest = mnl_attr_nest_start(nlh, type);
+	mnl_attr_put_u64(nlh, CTA_COUNTERS_PACKETS, htobe64(packets));
+	mnl_attr_put_u64(nlh, CTA_COUNTERS_BYTES, htobe64(packets * 576));
+	mnl_attr_nest_end(nlh, nest);
+}
+
+/* one in four entries is UDP, the others are established TCP flows. */
+static void ct_build(struct nlmsghdr *nlh, uint64_t idx,
+		     const struct corpus_params *p)
+{
+	uint32_t r = mix(idx);
+	uint32_t src = 0x0a000000 | (r & 0xffffff);
+	uint32_t dst = 0xc0a80000 | (r >> 16);
+	uint16_t sport = 1024 + (r % 60000), dport = (r & 3) ? 443 : 53;
+	uint8_t proto = (r & 3) ? IPPROTO_TCP : IPPROTO_UDP;
+	struct nlattr *nest, *tcp;
+
+	nlh->nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_NEW;
+	put_nfgenmsg(nlh, 0);
+
+	put_ct_tuple(nlh, CTA_TUPLE_ORIG, src, dst, proto, sport, dport);
+	put_ct_tuple(nlh, CTA_TUPLE_REPLY, dst, src, proto, dport, sport);
+
+	if (proto == IPPROTO_TCP) {
+		uint16_t flags[2] = { 0x0a, 0x0a };
+
+		nest = mnl_attr_nest_start(nlh, CTA_PROTOINFO);
+		tcp = mnl_attr_nest_start(nlh, CTA_PROTOINFO_TCP);
+		mnl_attr_put_u8(nlh, CTA_PROTOINFO_TCP_STATE, 3);
+		mnl_attr_put_u8(nlh, CTA_PROTOINFO_TCP_WSCALE_ORIGINAL, 7);
+		mnl_attr_put_u8(nlh, CTA_PROTOINFO_TCP_WSCALE_REPLY, 7);
+		mnl_attr_put(nlh, CTA_PROTOINFO_TCP_FLAGS_ORIGINAL,
+			     sizeof(flags), flags);
+		mnl_attr_put(nlh, CTA_PROTOINFO_TCP_FLAGS_REPLY,
+			     sizeof(flags), flags);
+		mnl_attr_nest_end(nlh, tcp);
+		mnl_attr_nest_end(nlh, nest);
+	}
+	mnl_attr_put_u32(nlh, CTA_STATUS, htonl(0x18e));
+	mnl_attr_put_u32(nlh, CTA_TIMEOUT, htonl(r % 432000));
+	mnl_attr_put_u32(nlh, CTA_MARK, htonl(r & 0xff));
+	put_ct_counters(nlh, CTA_COUNTERS_ORIG, r % 10000);
+	put_ct_counters(nlh, CTA_COUNTERS_REPLY, r % 9000);
+	mnl_attr_put_u32(nlh, CTA_ID, htonl(idx));
+	mnl_attr_put_u32(nlh, CTA_USE, htonl(1));
+}
+
+/*
+ * RTA_MULTIPATH carries struct rtnexthop, each one followed by its own
+ * attributes, and the kernel does not flag it as a nest.
+ */
+static void put_multipath(struct nlmsghdr *nlh, unsigned int hops)
+{
+	struct nlattr *mp;
+	unsigned int i;
+
+	mp = mnl_attr_nest_start(nlh, RTA_MULTIPATH);
+	mp->nla_type = RTA_MULTIPATH;
+	for (i = 0; i < hops; i++) {
+		struct rtnexthop *rtnh;
+
+		rtnh = mnl_nlmsg_put_extra_header(nlh, sizeof(*rtnh));
+		rtnh->rtnh_ifindex = 2 + i;
+		mnl_attr_put_u32(nlh, RTA_GATEWAY, htonl(0xac100001 + i));
+		rtnh->rtnh_len = (char *)mnl_nlmsg_get_payload_tail(nlh) -
+				 (char *)rtnh;
+	}
+	mnl_attr_nest_end(nlh, mp);
+}
+
+/* one in four routes has 2 to 4 next hops. */
+static void route_build(struct nlmsghdr *nlh, uint64_t idx,
+			const struct corpus_params *p)
+{
+	uint32_t r = mix(idx);
+	struct rta_cacheinfo ci = {
+		.rta_used	= r & 0xffff,
+		.rta_expires	= 0,
+	};
+	struct nlattr *metrics;
+	struct rtmsg *rtm;
+
+	nlh->nlmsg_type = RTM_NEWROUTE;
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtmsg));
+	rtm->rtm_family = AF_INET;
+	rtm->rtm_dst_len = 24;
+	rtm->rtm_table = RT_TABLE_MAIN;
+	rtm->rtm_protocol = RTPROT_BOOT;
+	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+	rtm->rtm_type = RTN_UNICAST;
+
+	mnl_attr_put_u32(nlh, RTA_TABLE, RT_TABLE_MAIN);
+	mnl_attr_put_u32(nlh, RTA_DST, htonl((idx << 8) & 0xffffff00));
+	mnl_attr_put_u32(nlh, RTA_PRIORITY, r % 1024);
+	mnl_attr_put_u32(nlh, RTA_PREFSRC, htonl(0xac100101));
+
+	metrics = mnl_attr_nest_start(nlh, RTA_METRICS);
+	mnl_attr_put_u32(nlh, RTAX_MTU, 1500);
+	mnl_attr_put_u32(nlh, RTAX_ADVMSS, 1460);
+	mnl_attr_nest_end(nlh, metrics);
+
+	if ((r & 3) == 0) {
+		put_multipath(nlh, 2 + (r >> 2) % 3);
+	} else {
+		mnl_attr_put_u32(nlh, RTA_GATEWAY, htonl(0xac100001));
+		mnl_attr_put_u32(nlh, RTA_OIF, 2);
+	}
+	mnl_attr_put(nlh, RTA_CACHEINFO, sizeof(ci), &ci);
+}
+
+static void nfq_build(struct nlmsghdr *nlh, uint64_t idx,
+		      const struct corpus_params *p)
+{
+	uint32_t r = mix(idx);
+	struct nfqnl_msg_packet_hdr ph = {
+		.packet_id	= htonl(idx),
+		.hw_protocol	= htons(0x0800),
+		.hook		= 1,
+	};
+	struct nfqnl_msg_packet_timestamp ts = {
+		.sec		= htobe64(1700000000 + idx / 1000),
+		.usec		= htobe64(idx % 1000 * 1000),
+	};
+	struct nfqnl_msg_packet_hw hw = {
+		.hw_addrlen	= htons(6),
+		.hw_addr	= { 0x02, 0x00, 0x00, 0x00, r >> 8, r },
+	};
+
+	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_PACKET;
+	put_nfgenmsg(nlh, 0);
+
+	mnl_attr_put(nlh, NFQA_PACKET_HDR, sizeof(ph), &ph);
+	mnl_attr_put_u32(nlh, NFQA_MARK, htonl(r & 0xff));
+	mnl_attr_put(nlh, NFQA_TIMESTAMP, sizeof(ts), &ts);
+	mnl_attr_put_u32(nlh, NFQA_IFINDEX_INDEV, htonl(2));
+	mnl_attr_put(nlh, NFQA_HWADDR, sizeof(hw), &hw);
+
+	put_packet(nlh, NFQA_PAYLOAD, r, p);
+}
+
+/* links with the attributes that iproute2 shows, veth ones. */
+static void link_build(struct nlmsghdr *nlh, uint64_t idx,
+		       const struct corpus_params *p)
+{
+	uint32_t r = mix(idx);
+	uint8_t hwaddr[6] = { 0x02, 0x00, idx >> 24, idx >> 16, idx >> 8, idx };
+	uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	struct rtnl_link_stats64 stats = {
+		.rx_packets	= r % 100000,
+		.tx_packets	= r % 90000,
+		.rx_bytes	= (r % 100000) * 576,
+		.tx_bytes	= (r % 90000) * 576,
+	};
+	struct ifinfomsg *ifm;
+	struct nlattr *nest;
+	char name[IFNAMSIZ];
+
+	nlh->nlmsg_type = RTM_NEWLINK;
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct ifinfomsg));
+	ifm->ifi_family = AF_UNSPEC;
+	ifm->ifi_type = 1;	/* ARPHRD_ETHER */
+	ifm->ifi_index = idx + 1;
+	ifm->ifi_flags = IFF_UP | IFF_BROADCAST | IFF_RUNNING | IFF_MULTICAST;
+
+	snprintf(name, sizeof(name), "veth%u", (unsigned int)idx);
+	mnl_attr_put_strz(nlh, IFLA_IFNAME, name);
+	mnl_attr_put_u32(nlh, IFLA_TXQLEN, 1000);
+	mnl_attr_put_u8(nlh, IFLA_OPERSTATE, IF_OPER_UP);
+	mnl_attr_put_u8(nlh, IFLA_LINKMODE, 0);
+	mnl_attr_put_u32(nlh, IFLA_MTU, 1500);
+	mnl_attr_put_u32(nlh, IFLA_GROUP, 0);
+	mnl_attr_put_u32(nlh, IFLA_PROMISCUITY, 0);
+	mnl_attr_put_u32(nlh, IFLA_NUM_TX_QUEUES, 1);
+	mnl_attr_put_u32(nlh, IFLA_NUM_RX_QUEUES, 1);
+	mnl_attr_put_u8(nlh, IFLA_CARRIER, 1);
+	mnl_attr_put_strz(nlh, IFLA_QDISC, "noqueue");
+	mnl_attr_put(nlh, IFLA_ADDRESS, sizeof(hwaddr), hwaddr);
+	mnl_attr_put(nlh, IFLA_BROADCAST, sizeof(broadcast), broadcast);
+	mnl_attr_put(nlh, IFLA_STATS64, sizeof(stats), &stats);
+
+	nest = mnl_attr_nest_start(nlh, IFLA_LINKINFO);
+	mnl_attr_put_strz(nlh, IFLA_INFO_KIND, "veth");
+	mnl_attr_nest_end(nlh, nest);
+
+	/* every link is paired with the next one. */
+	mnl_attr_put_u32(nlh, IFLA_LINK, (idx ^ 1) + 1);
+}
+
+static void nflog_build(struct nlmsghdr *nlh, uint64_t idx,
+			const struct corpus_params *p)
+{
+	uint32_t r = mix(idx);
+	struct nfulnl_msg_packet_hdr ph = {
+		.hw_protocol	= htons(0x0800),
+		.hook		= 1,
+	};
+	struct nfulnl_msg_packet_timestamp ts = {
+		.sec		= htobe64(1700000000 + idx / 1000),
+		.usec		= htobe64(idx % 1000 * 1000),
+	};
+	struct nfulnl_msg_packet_hw hw = {
+		.hw_addrlen	= htons(6),
+		.hw_addr	= { 0x02, 0x00, 0x00, 0x00, r >> 8, r },
+	};
+
+	nlh->nlmsg_type = (NFNL_SUBSYS_ULOG << 8) | NFULNL_MSG_PACKET;
+	put_nfgenmsg(nlh, 0);
+
+	mnl_attr_put(nlh, NFULA_PACKET_HDR, sizeof(ph), &ph);
+	mnl_attr_put_u32(nlh, NFULA_MARK, htonl(r & 0xff));
+	mnl_attr_put(nlh, NFULA_TIMESTAMP, sizeof(ts), &ts);
+	mnl_attr_put_u32(nlh, NFULA_IFINDEX_INDEV, htonl(2));
+	mnl_attr_put(nlh, NFULA_HWADDR, sizeof(hw), &hw);
+	mnl_attr_put_u16(nlh, NFULA_HWTYPE, htons(1));
+	mnl_attr_put_u16(nlh, NFULA_HWLEN, htons(14));
+	mnl_attr_put(nlh, NFULA_HWHEADER, 14, zero);
+	mnl_attr_put_strz(nlh, NFULA_PREFIX, (r & 1) ? "DROP: " : "ACCEPT: ");
+	mnl_attr_put_u32(nlh, NFULA_SEQ, htonl(idx));
+	put_packet(nlh, NFULA_PAYLOAD, r, p);
+}
+
+static void put_extra(struct nlmsghdr *nlh, const struct corpus_params *p)
+{
+	struct nlattr *nest[CORPUS_DEPTH_MAX];
+	unsigned int i;
+
+	for (i = 0; i < p->depth; i++)
+		nest[i] = mnl_attr_nest_start(nlh, CORPUS_EXTRA_TYPE);
+
+	for (i = 0; i < p->attrs; i++) {
+		mnl_attr_put(nlh, CORPUS_EXTRA_TYPE + 1 + (i % 255),
+			     p->attr_size, zero);
+	}
+	for (i = p->depth; i > 0; i--)
+		mnl_attr_nest_end(nlh, nest[i - 1]);
+}
+
+/*
+ * uevents are not netlink messages, but a header and a list of KEY=value
+ * strings, each one terminated by a nul character.
+ */
+static size_t uevent_put(char *buf, uint64_t idx, const struct corpus_params *p)
+{
+	unsigned int n = idx, i;
+	char *s = buf;
+
+	s += sprintf(s, "%s@/devices/virtual/net/veth%u",
+		     (idx & 1) ? "remove" : "add", n) + 1;
+	s += sprintf(s, "ACTION=%s", (idx & 1) ? "remove" : "add") + 1;
+	s += sprintf(s, "DEVPATH=/devices/virtual/net/veth%u", n) + 1;
+	s += sprintf(s, "SUBSYSTEM=net") + 1;
+	s += sprintf(s, "INTERFACE=veth%u", n) + 1;
+	s += sprintf(s, "IFINDEX=%u", n + 1) + 1;
+	s += sprintf(s, "SEQNUM=%llu", (unsigned long long)idx + 1) + 1;
+
+	for (i = 0; i < p->attrs; i++) {
+		s += sprintf(s, "CORPUS_KEY%u=", i);
+		memset(s, 'x', p->attr_size);
+		s += p->attr_size;
+		*s++ = '\0';
+	}
+	return s - buf;
+}
+
+typedef void (*corpus_build_t)(struct nlmsghdr *nlh, uint64_t idx,
+			       const struct corpus_params *p);
+
+/* how the kernel packs the messages into datagrams. */
+enum corpus_pack {
+	/* one message per datagram, as for events */
+	CORPUS_PACK_SINGLE,
+	/* multipart, NLMSG_DONE after the last message */
+	CORPUS_PACK_DUMP,
+	/* multipart, NLMSG_DONE ends every datagram with several messages,
+	 * as nfnetlink_log does when qthresh is larger than one */
+	CORPUS_PACK_BATCH,
+};
+
+static const struct corpus_kind {
+	const char	*name;
+	int		protocol;
+	uint16_t	hdrlen;
+	corpus_build_t	build;		/* NULL for uevents */
+	/* largest message without the extra attributes and the packet */
+	size_t		max;
+	enum corpus_pack	pack;
+} corpus_kinds[] = {
+	{ "link",	NETLINK_ROUTE,		sizeof(struct ifinfomsg),
+	  link_build,	512,	CORPUS_PACK_DUMP },
+	{ "route",	NETLINK_ROUTE,		sizeof(struct rtmsg),
+	  route_build,	256,	CORPUS_PACK_DUMP },
+	{ "ctnetlink",	NETLINK_NETFILTER,	sizeof(struct nfgenmsg),
+	  ct_build,	512,	CORPUS_PACK_DUMP },
+	{ "nfqueue",	NETLINK_NETFILTER,	sizeof(struct nfgenmsg),
+	  nfq_build,	256,	CORPUS_PACK_SINGLE },
+	{ "nflog",	NETLINK_NETFILTER,	sizeof(struct nfgenmsg),
+	  nflog_build,	256,	CORPUS_PACK_BATCH },
+	{ "uevent",	NETLINK_KOBJECT_UEVENT,	0,
+	  NULL,		512,	CORPUS_PACK_SINGLE },
+};
+
+unsigned int corpus_count(void)
+{
+	return MNL_ARRAY_SIZE(corpus_kinds);
+}
+
+const char *corpus_name(unsigned int i)
+{
+	return i < corpus_count() ? corpus_kinds[i].name : NULL;
+}
+
+struct corpus_gen {
+	const struct corpus_kind	*kind;
+	struct corpus_params		p;
+	size_t				max;
+};
+
+/*
+ * p may be NULL for the realistic attributes only. On error, it returns
+ * NULL and errno is set: EINVAL if the kind does not exist or if the
+ * parameters lead to attributes that do not fit in their 16-bit length.
+ */
+struct corpus_gen *corpus_gen_start(const char *name,
+				    const struct corpus_params *p)
+{
+	static const struct corpus_params none;
+	const struct corpus_kind *kind = NULL;
+	struct corpus_gen *g;
+	size_t extra;
+	unsigned int i;
+
+	for (i = 0; i < corpus_count(); i++) {
+		if (strcmp(corpus_kinds[i].name, name) == 0)
+			kind = &corpus_kinds[i];
+	}
+	if (p == NULL)
+		p = &none;
+
+	if (kind == NULL || p->depth > CORPUS_DEPTH_MAX ||
+	    p->attr_size > CORPUS_ATTR_MAX || p->payload > CORPUS_ATTR_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	g = calloc(1, sizeof(struct corpus_gen));
+	if (g == NULL)
+		return NULL;
+
+	g->kind = kind;
+	g->p = *p;
+	if (g->p.attr_size == 0)
+		g->p.attr_size = 4;
+
+	if (kind->build) {
+		extra = (size_t)g->p.attrs *
+			(MNL_ATTR_HDRLEN + MNL_ALIGN(g->p.attr_size));
+		/* the nests have a 16-bit length too. */
+		if (g->p.depth &&
+		    extra + g->p.depth * MNL_ATTR_HDRLEN > UINT16_MAX) {
+			free(g);
+			errno = EINVAL;
+			return NULL;
+		}
+		extra += g->p.depth * MNL_ATTR_HDRLEN;
+	} else {
+		extra = (size_t)g->p.attrs * (sizeof("CORPUS_KEY=") + 10 +
+					      g->p.attr_size);
+	}
+	g->max = kind->max + extra + (g->p.payload ? g->p.payload : 1500);
+
+	return g;
+}
+
+void corpus_gen_stop(struct corpus_gen *g)
+{
+	free(g);
+}
+
+const char *corpus_gen_name(const struct corpus_gen *g)
+{
+	return g->kind->name;
+}
+
+/* netlink bus of the messages, see NETLINK_* constants. */
+int corpus_gen_protocol(const struct corpus_gen *g)
+{
+	return g->kind->protocol;
+}
+
+bool corpus_gen_is_netlink(const struct corpus_gen *g)
+{
+	return g->kind->build != NULL;
+}
+
+uint16_t corpus_gen_hdrlen(const struct corpus_gen *g)
+{
+	return g->kind->hdrlen;
+}
+
+/* upper bound of the size of the messages. */
+size_t corpus_gen_max(const struct corpus_gen *g)
+{
+	return g->max;
+}
+
+static void corpus_gen_build(const struct corpus_gen *g,
+			     struct nlmsghdr *nlh, uint64_t idx)
+{
+	g->kind->build(nlh, idx, &g->p);
+	put_extra(nlh, &g->p);
+}
+
+/*
+ * Build entry idx into buf, of corpus_gen_max() bytes at least. It returns
+ * the size of the message, aligned for netlink so that another one can
+ * follow.
+ */
+size_t corpus_gen_put(const struct corpus_gen *g, void *buf, uint64_t idx)
+{
+	struct nlmsghdr *nlh;
+
+	if (!corpus_gen_is_netlink(g))
+		return uevent_put(buf, idx, &g->p);
+
+	nlh = mnl_nlmsg_put_header(buf);
+	if (g->kind->pack != CORPUS_PACK_SINGLE)
+		nlh->nlmsg_flags = NLM_F_MULTI;
+
+	corpus_gen_build(g, nlh, idx);
+
+	return MNL_ALIGN(nlh->nlmsg_len);
+}
+
+/*
+ * Pass the generator as data to mnl_fake_dump(), so that the entries are
+ * built as they are received, eg. to test dumps of millions of entries.
+ */
+int corpus_gen_dump_cb(struct nlmsghdr *nlh, uint64_t idx, void *data)
+{
+	const struct corpus_gen *g = data;
+
+	if (!corpus_gen_is_netlink(g)) {
+		errno = EPROTONOSUPPORT;
+		return MNL_CB_ERROR;
+	}
+	corpus_gen_build(g, nlh, idx);
+
+	return MNL_CB_OK;
+}
+
+#define CORPUS_DONE_LEN	(MNL_NLMSG_HDRLEN + MNL_ALIGN(sizeof(int)))
+
+static size_t put_done(void *buf)
+{
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_flags = NLM_F_MULTI;
+	mnl_nlmsg_put_extra_header(nlh, sizeof(int));
+
+	return nlh->nlmsg_len;
+}
+
+/*
+ * As the kernel does for dumps and batched events, as many messages as fit
+ * in bufsiz bytes are packed into each datagram that is passed to cb,
+ * except for the kinds that are sent one per datagram, and multipart
+ * messages are terminated by NLMSG_DONE. The entries are built as they
+ * are packed, so only one datagram is kept in memory.
+ *
+ * On error, it returns -1 and errno is set, to EMSGSIZE if a message does
+ * not fit into a datagram, or the return value of cb if it is negative.
+ */
+int corpus_gen_pack(const struct corpus_gen *g, uint64_t msgs, size_t bufsiz,
+		    corpus_dgram_cb_t cb, void *data)
+{
+	enum corpus_pack pack = g->kind->pack;
+	/* room for NLMSG_DONE at the end of each datagram of a batch. */
+	size_t room = pack == CORPUS_PACK_BATCH ? CORPUS_DONE_LEN : 0;
+	size_t off = 0, len;
+	unsigned int n = 0;
+	char *buf, *msg;
+	int ret = 0;
+	uint64_t i;
+
+	if (bufsiz < CORPUS_DONE_LEN) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	/* the entries are built past the datagram, copied if they fit. */
+	buf = malloc(MNL_ALIGN(bufsiz) + g->max);
+	if (buf == NULL)
+		return -1;
+	msg = buf + MNL_ALIGN(bufsiz);
+
+	for (i = 0; i < msgs; i++) {
+		len = corpus_gen_put(g, msg, i);
+		if (len > bufsiz) {
+			errno = EMSGSIZE;
+			ret = -1;
+			goto out;
+		}
+		if (off && (pack == CORPUS_PACK_SINGLE ||
+			    off + len + room > bufsiz)) {
+			if (pack == CORPUS_PACK_BATCH && n > 1)
+				off += put_done(buf + off);
+
+			ret = cb(buf, off, data);
+			if (ret < 0)
+				goto out;
+
+			off = n = 0;
+		}
+		memcpy(buf + off, msg, len);
+		off += len;
+		n++;
+	}
+	if (pack == CORPUS_PACK_DUMP && off + CORPUS_DONE_LEN > bufsiz) {
+		ret = cb(buf, off, data);
+		if (ret < 0)
+			goto out;
+
+		off = 0;
+	}
+	if (pack == CORPUS_PACK_DUMP || (pack == CORPUS_PACK_BATCH && n > 1))
+		off += put_done(buf + off);
+	if (off)
+		ret = cb(buf, off, data);
+out:
+	free(buf);
+	return ret < 0 ? ret : 0;
+}
+
+static uint64_t count_attrs(const void *payload, size_t len)
+{
+	const struct nlattr *attr;
+	uint64_t n = 0;
+
+	mnl_attr_for_each_payload(payload, len) {
+		n++;
+		if (attr->nla_type & NLA_F_NESTED)
+			n += count_attrs(mnl_attr_get_payload(attr),
+					 mnl_attr_get_payload_len(attr));
+	}
+	return n;
+}
+
+static int corpus_add_dgram(const void *buf, size_t len, void *data)
+{
+	struct corpus *c = data;
+
+	if (c->len + len > c->size) {
+		size_t size = c->size ? c->size * 2 : 1 << 20;
+		char *p;
+
+		while (c->len + len > size)
+			size *= 2;
+
+		p = realloc(c->buf, size);
+		if (p == NULL)
+			return -1;
+
+		c->buf = p;
+		c->size = size;
+	}
+	memcpy(c->buf + c->len, buf, len);
+	c->len += len;
+	c->dgram[++c->ndgrams] = c->len;
+
+	return 0;
+}
+
+/* msgs entries packed into datagrams of bufsiz bytes at most. */
+struct corpus *corpus_start(const char *name, const struct corpus_params *p,
+			    uint64_t msgs, size_t bufsiz)
+{
+	struct corpus *c;
+	unsigned int i;
+	uint64_t j = 0;
+
+	if (msgs == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	c = calloc(1, sizeof(struct corpus));
+	if (c == NULL)
+		return NULL;
+
+	c->gen = corpus_gen_start(name, p);
+	if (c->gen == NULL)
+		goto err;
+
+	c->name = corpus_gen_name(c->gen);
+	c->hdrlen = corpus_gen_hdrlen(c->gen);
+	c->msgs = msgs;
+
+	/* worst case: one message per datagram, then NLMSG_DONE alone. */
+	c->dgram = calloc(msgs + 2, sizeof(*c->dgram));
+	if (c->dgram == NULL)
+		goto err;
+
+	if (corpus_gen_pack(c->gen, msgs, bufsiz, corpus_add_dgram, c) < 0)
+		goto err;
+
+	if (!corpus_gen_is_netlink(c->gen))
+		return c;
+
+	c->msg = calloc(msgs, sizeof(*c->msg));
+	if (c->msg == NULL)
+		goto err;
+
+	for (i = 0; i < c->ndgrams; i++) {
+		const struct nlmsghdr *nlh = (void *)(c->buf + c->dgram[i]);
+		int len = c->dgram[i + 1] - c->dgram[i];
+
+		while (mnl_nlmsg_ok(nlh, len)) {
+			if (nlh->nlmsg_type != NLMSG_DONE) {
+				c->msg[j++] = nlh;
+				c->attrs += count_attrs(
+					mnl_nlmsg_get_payload_offset(nlh,
+								     c->hdrlen),
+					mnl_nlmsg_get_payload_len(nlh) -
+					MNL_ALIGN(c->hdrlen));
+			}
+			nlh = mnl_nlmsg_next(nlh, &len);
+		}
+	}
+	return c;
+err:
+	corpus_stop(c);
+	return NULL;
+}
+
+void corpus_stop(struct corpus *c)
+{
+	if (c->gen)
+		corpus_gen_stop(c->gen);
+	free(c->dgram);
+	free(c->msg);
+	free(c->buf);
+	free(c);
+}
@@ -0,0 +1,63 @@
+#ifndef _MNL_BENCH_CORPUS_H_
+#define _MNL_BENCH_CORPUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libmnl/libmnl.h>
+
+/*
+ * type of the nests added on top of the realistic attributes, the extra
+ * attributes use the 255 types that follow, below NLA_F_NET_BYTEORDER.
+ */
+#define CORPUS_EXTRA_TYPE	0x3f00
+#define CORPUS_DEPTH_MAX	32
+
+struct corpus_params {
+	unsigned int	attrs;		/* extra attributes per message */
+	unsigned int	depth;		/* nests that hold the extra ones */
+	unsigned int	attr_size;	/* payload of each extra one, 4 if 0 */
+	unsigned int	payload;	/* packet size, 0 for a mix of sizes */
+};
+
+/* a generator builds entry idx of a given kind from scratch. */
+struct corpus_gen;
+
+unsigned int corpus_count(void);
+const char *corpus_name(unsigned int i);
+
+struct corpus_gen *corpus_gen_start(const char *name,
+				    const struct corpus_params *p);
+void corpus_gen_stop(struct corpus_gen *g);
+const char *corpus_gen_name(const struct corpus_gen *g);
+int corpus_gen_protocol(const struct corpus_gen *g);
+bool corpus_gen_is_netlink(const struct corpus_gen *g);
+uint16_t corpus_gen_hdrlen(const struct corpus_gen *g);
+size_t corpus_gen_max(const struct corpus_gen *g);
+size_t corpus_gen_put(const struct corpus_gen *g, void *buf, uint64_t idx);
+int corpus_gen_dump_cb(struct nlmsghdr *nlh, uint64_t idx, void *data);
+
+typedef int (*corpus_dgram_cb_t)(const void *buf, size_t len, void *data);
+int corpus_gen_pack(const struct corpus_gen *g, uint64_t msgs, size_t bufsiz,
+		    corpus_dgram_cb_t cb, void *data);
+
+/* a corpus holds the datagrams of a generator in memory. */
+struct corpus {
+	struct corpus_gen	*gen;
+	const char		*name;
+	uint16_t		hdrlen;		/* family header */
+	char			*buf;
+	size_t			len;
+	size_t			size;
+	/* messages, NULL if the kind does not use netlink messages */
+	const struct nlmsghdr	**msg;
+	size_t			*dgram;		/* ndgrams + 1 offsets */
+	unsigned int		ndgrams;
+	uint64_t		msgs;
+	uint64_t		attrs;		/* nested ones included */
+};
+
+struct corpus *corpus_start(const char *name, const struct corpus_params *p,
+			    uint64_t msgs, size_t bufsiz);
+void corpus_stop(struct corpus *c);
+
+#endif
@@ -0,0 +1,713 @@
+/* This file is placed in the public domain. */
+/*
+ * Microbenchmarks for the hot paths of libmnl: attribute parsing,
+ * iteration and validation, the callback runqueue, batching, the
+ * attribute builders, the message arena and a dump through the fake
+ * kernel endpoint.
+ *
+ * Each benchmark runs over every synthetic corpus and prints one JSON
+ * object per line, so that the results can be stored and compared:
+ *
+ *	mnl-bench > baseline.json
+ *	(rebuild with your changes)
+ *	mnl-bench -B baseline.json
+ *
+ * With -B, the results that are slower than the baseline by more than
+ * the threshold (-T, 10% by default) are flagged and the program exits
+ * with status 1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <libmnl/libmnl.h>
+
+#include "corpus.h"
+
+#define BENCH_BUFSIZ		8192
+#define BENCH_MAXTYPE		63
+#define BENCH_LOOKUPS		8
+#define BENCH_BASELINE_MAX	256
+
+struct bench_ctx {
+	const struct corpus		*c;
+	/* results are accumulated here, so nothing is optimized out. */
+	uint64_t			sink;
+	const struct nlattr		*tb[BENCH_MAXTYPE + 1];
+	/* offsets of the messages of one datagram, see cb_run_index. */
+	uint32_t			offsets[BENCH_BUFSIZ / MNL_NLMSG_HDRLEN];
+	/* data type of every attribute of the corpus, in walk order. */
+	enum mnl_attr_data_type		*types;
+	char				*out;
+	struct mnl_attr_index		*idx;
+	struct mnl_nlmsg_batch		*batch;
+	struct mnl_arena		*arena;
+	struct mnl_fake			*fake;
+	struct mnl_socket		*nl;
+};
+
+typedef void (*bench_fn_t)(struct bench_ctx *ctx);
+
+static int parse_cb(const struct nlattr *attr, void *data)
+{
+	struct bench_ctx *ctx = data;
+
+	ctx->tb[mnl_attr_get_type(attr) & BENCH_MAXTYPE] = attr;
+	if (attr->nla_type & NLA_F_NESTED)
+		return mnl_attr_parse_nested(attr, parse_cb, ctx);
+
+	return MNL_CB_OK;
+}
+
+static void bench_attr_parse(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		mnl_attr_parse(c->msg[i], c->hdrlen, parse_cb, ctx);
+		ctx->sink += (uintptr_t)ctx->tb[1];
+	}
+}
+
+/*
+ * The index is built on the first lookup, then the handler reads several
+ * fields of the message as in attr_parse, without a callback. Only the
+ * top-level attributes are indexed.
+ */
+static void bench_attr_index(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	unsigned int type;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		mnl_attr_index_reset(ctx->idx, c->msg[i], c->hdrlen);
+		for (type = 1; type <= BENCH_LOOKUPS; type++) {
+			ctx->sink += (uintptr_t)mnl_attr_index_get(ctx->idx,
+								   type);
+		}
+	}
+}
+
+static uint64_t walk_nested(const struct nlattr *nest)
+{
+	const struct nlattr *attr;
+	uint64_t sum = 0;
+
+	mnl_attr_for_each_nested(attr, nest) {
+		sum += mnl_attr_get_payload_len(attr);
+		if (attr->nla_type & NLA_F_NESTED)
+			sum += walk_nested(attr);
+	}
+	return sum;
+}
+
+static void bench_attr_for_each(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	const struct nlattr *attr;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		mnl_attr_for_each(attr, c->msg[i], c->hdrlen) {
+			ctx->sink += mnl_attr_get_payload_len(attr);
+			if (attr->nla_type & NLA_F_NESTED)
+				ctx->sink += walk_nested(attr);
+		}
+	}
+}
+
+/*
+ * The validation benchmarks walk the attributes as above and check each
+ * one against the type that was recorded at setup, so the difference with
+ * attr_for_each is the cost of the checks.
+ */
+static uint64_t validate_nested(const struct nlattr *nest,
+				const enum mnl_attr_data_type **type)
+{
+	const struct nlattr *attr;
+	uint64_t sum = 0;
+
+	mnl_attr_for_each_nested(attr, nest) {
+		sum += mnl_attr_validate(attr, *(*type)++);
+		if (attr->nla_type & NLA_F_NESTED)
+			sum += validate_nested(attr, type);
+	}
+	return sum;
+}
+
+static void bench_attr_validate(struct bench_ctx *ctx)
+{
+	const enum mnl_attr_data_type *type = ctx->types;
+	const struct corpus *c = ctx->c;
+	const struct nlattr *attr;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		mnl_attr_for_each(attr, c->msg[i], c->hdrlen) {
+			ctx->sink += mnl_attr_validate(attr, *type++);
+			if (attr->nla_type & NLA_F_NESTED)
+				ctx->sink += validate_nested(attr, &type);
+		}
+	}
+}
+
+static uint64_t validate2_nested(const struct nlattr *nest)
+{
+	const struct nlattr *attr;
+	uint64_t sum = 0;
+
+	mnl_attr_for_each_nested(attr, nest) {
+		sum += mnl_attr_validate2(attr, MNL_TYPE_BINARY,
+					  mnl_attr_get_payload_len(attr));
+		if (attr->nla_type & NLA_F_NESTED)
+			sum += validate2_nested(attr);
+	}
+	return sum;
+}
+
+static void bench_attr_validate2(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	const struct nlattr *attr;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		mnl_attr_for_each(attr, c->msg[i], c->hdrlen) {
+			ctx->sink += mnl_attr_validate2(attr, MNL_TYPE_BINARY,
+						mnl_attr_get_payload_len(attr));
+			if (attr->nla_type & NLA_F_NESTED)
+				ctx->sink += validate2_nested(attr);
+		}
+	}
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct bench_ctx *ctx = data;
+
+	ctx->sink += nlh->nlmsg_len;
+	return MNL_CB_OK;
+}
+
+static void bench_cb_run(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	unsigned int i;
+
+	for (i = 0; i < c->ndgrams; i++) {
+		mnl_cb_run(c->buf + c->dgram[i], c->dgram[i + 1] - c->dgram[i],
+			   1, 0, data_cb, ctx);
+	}
+}
+
+static int ctl_cb(const struct nlmsghdr *nlh, void *data)
+{
+	return MNL_CB_OK;
+}
+
+static void bench_cb_run2(struct bench_ctx *ctx)
+{
+	static const mnl_cb_t cb_ctl_array[NLMSG_MIN_TYPE] = {
+		[NLMSG_NOOP]	= ctl_cb,
+		[NLMSG_ERROR]	= ctl_cb,
+		[NLMSG_DONE]	= ctl_cb,
+		[NLMSG_OVERRUN]	= ctl_cb,
+	};
+	const struct corpus *c = ctx->c;
+	unsigned int i;
+
+	for (i = 0; i < c->ndgrams; i++) {
+		mnl_cb_run2(c->buf + c->dgram[i],
+			    c->dgram[i + 1] - c->dgram[i], 1, 0, data_cb, ctx,
+			    cb_ctl_array, MNL_ARRAY_SIZE(cb_ctl_array));
+	}
+}
+
+/* all the headers are checked first, then the messages are dispatched. */
+static void bench_cb_run_index(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	unsigned int i;
+	int n;
+
+	for (i = 0; i < c->ndgrams; i++) {
+		n = mnl_cb_index(c->buf + c->dgram[i],
+				 c->dgram[i + 1] - c->dgram[i], 1, 0,
+				 ctx->offsets, MNL_ARRAY_SIZE(ctx->offsets));
+		if (n < 0)
+			continue;
+
+		mnl_cb_run_index(c->buf + c->dgram[i], ctx->offsets, n,
+				 data_cb, ctx, NULL, 0);
+	}
+}
+
+/* messages are copied from the corpus, so this is mostly batch overhead. */
+static void bench_batch_next(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	struct mnl_nlmsg_batch *b = ctx->batch;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		memcpy(mnl_nlmsg_batch_current(b), c->msg[i],
+		       c->msg[i]->nlmsg_len);
+		if (!mnl_nlmsg_batch_next(b)) {
+			ctx->sink += mnl_nlmsg_batch_size(b);
+			mnl_nlmsg_batch_reset(b);
+		}
+	}
+	ctx->sink += mnl_nlmsg_batch_size(b);
+	mnl_nlmsg_batch_reset(b);
+}
+
+static void bench_attr_put(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++)
+		ctx->sink += corpus_gen_put(c->gen, ctx->out, i);
+}
+
+/*
+ * The corpus is copied to the arena attribute by attribute with the _check
+ * putters, the chunks are as large as a batch, so the messages that do not
+ * fit at the end of a chunk are moved by mnl_arena_grow().
+ */
+static void bench_arena_put(struct bench_ctx *ctx)
+{
+	const struct corpus *c = ctx->c;
+	struct mnl_arena *a = ctx->arena;
+	const struct nlattr *attr;
+	struct nlmsghdr *nlh;
+	unsigned int j;
+	size_t len;
+	uint64_t i;
+
+	for (i = 0; i < c->msgs; i++) {
+		nlh = mnl_arena_nlmsg_put_header(a);
+		if (nlh == NULL)
+			goto out;
+
+		nlh->nlmsg_type = c->msg[i]->nlmsg_type;
+		nlh->nlmsg_flags = c->msg[i]->nlmsg_flags;
+		nlh->nlmsg_seq = c->msg[i]->nlmsg_seq;
+
+		nlh = mnl_arena_grow(a, nlh, c->hdrlen);
+		if (nlh == NULL)
+			goto out;
+
+		memcpy(mnl_nlmsg_put_extra_header(nlh, c->hdrlen),
+		       mnl_nlmsg_get_payload(c->msg[i]), c->hdrlen);
+
+		mnl_attr_for_each(attr, c->msg[i], c->hdrlen) {
+			uint16_t plen = mnl_attr_get_payload_len(attr);
+
+			while (!mnl_attr_put_check(nlh,
+					mnl_arena_buflen(a, nlh),
+					attr->nla_type, plen,
+					mnl_attr_get_payload(attr))) {
+				nlh = mnl_arena_grow(a, nlh,
+						     MNL_ATTR_HDRLEN + plen);
+				if (nlh == NULL)
+					goto out;
+			}
+		}
+	}
+out:
+	for (j = 0; j < mnl_arena_chunks(a); j++) {
+		mnl_arena_chunk(a, j, &len);
+		ctx->sink += len;
+	}
+	mnl_arena_reset(a);
+}
+
+/*
+ * A dump through mnl_socket_recvfrom() and mnl_cb_run(). The entries are
+ * built on demand by the generator of the corpus, as the kernel would do,
+ * see attr_put for their cost.
+ */
+static void bench_fake_dump(struct bench_ctx *ctx)
+{
+	struct nlmsghdr req = {
+		.nlmsg_len	= sizeof(struct nlmsghdr),
+		.nlmsg_flags	= NLM_F_REQUEST | NLM_F_DUMP,
+		.nlmsg_seq	= 1,
+	};
+	unsigned int portid = mnl_socket_get_portid(ctx->nl);
+	char buf[BENCH_BUFSIZ];
+	int ret;
+
+	if (mnl_fake_dump(ctx->fake, &req, ctx->c->msgs, UINT64_MAX,
+			  corpus_gen_dump_cb, ctx->c->gen) < 0)
+		return;
+
+	ret = mnl_socket_recvfrom(ctx->nl, buf, sizeof(buf));
+	while (ret > 0) {
+		ret = mnl_cb_run(buf, ret, 1, portid, data_cb, ctx);
+		if (ret <= MNL_CB_STOP)
+			break;
+		ret = mnl_socket_recvfrom(ctx->nl, buf, sizeof(buf));
+	}
+}
+
+static const struct {
+	const char	*name;
+	bench_fn_t	fn;
+} benches[] = {
+	{ "attr_parse",		bench_attr_parse },
+	{ "attr_index",		bench_attr_index },
+	{ "attr_for_each",	bench_attr_for_each },
+	{ "attr_validate",	bench_attr_validate },
+	{ "attr_validate2",	bench_attr_validate2 },
+	{ "cb_run",		bench_cb_run },
+	{ "cb_run2",		bench_cb_run2 },
+	{ "cb_run_index",	bench_cb_run_index },
+	{ "batch_next",		bench_batch_next },
+	{ "attr_put",		bench_attr_put },
+	{ "arena_put",		bench_arena_put },
+	{ "fake_dump",		bench_fake_dump },
+};
+
+static enum mnl_attr_data_type attr_data_type(const struct nlattr *attr)
+{
+	if (attr->nla_type & NLA_F_NESTED)
+		return MNL_TYPE_NESTED;
+
+	switch (mnl_attr_get_payload_len(attr)) {
+	case 1:
+		return MNL_TYPE_U8;
+	case 2:
+		return MNL_TYPE_U16;
+	case 4:
+		return MNL_TYPE_U32;
+	case 8:
+		return MNL_TYPE_U64;
+	}
+	return MNL_TYPE_BINARY;
+}
+
+static void record_types(const struct nlattr *nest,
+			 enum mnl_attr_data_type **type)
+{
+	const struct nlattr *attr;
+
+	mnl_attr_for_each_nested(attr, nest) {
+		*(*type)++ = attr_data_type(attr);
+		if (attr->nla_type & NLA_F_NESTED)
+			record_types(attr, type);
+	}
+}
+
+static int bench_ctx_init(struct bench_ctx *ctx, const struct corpus *c)
+{
+	enum mnl_attr_data_type *type;
+	const struct nlattr *attr;
+	uint64_t i;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->c = c;
+
+	ctx->types = calloc(c->attrs + 1, sizeof(*ctx->types));
+	ctx->out = malloc(BENCH_BUFSIZ * 2 + corpus_gen_max(c->gen));
+	if (ctx->types == NULL || ctx->out == NULL)
+		return -1;
+
+	type = ctx->types;
+	for (i = 0; i < c->msgs; i++) {
+		mnl_attr_for_each(attr, c->msg[i], c->hdrlen) {
+			*type++ = attr_data_type(attr);
+			if (attr->nla_type & NLA_F_NESTED)
+				record_types(attr, &type);
+		}
+	}
+
+	ctx->idx = mnl_attr_index_start(BENCH_MAXTYPE);
+	if (ctx->idx == NULL)
+		return -1;
+
+	ctx->batch = mnl_nlmsg_batch_start(ctx->out, BENCH_BUFSIZ);
+	if (ctx->batch == NULL)
+		return -1;
+
+	ctx->arena = mnl_arena_start(BENCH_BUFSIZ);
+	if (ctx->arena == NULL)
+		return -1;
+
+	ctx->fake = mnl_fake_start(NETLINK_ROUTE, NULL, NULL);
+	if (ctx->fake == NULL)
+		return -1;
+
+	ctx->nl = mnl_fake_socket(ctx->fake);
+	if (ctx->nl == NULL)
+		return -1;
+
+	return 0;
+}
+
+static void bench_ctx_fini(struct bench_ctx *ctx)
+{
+	if (ctx->nl)
+		mnl_socket_close(ctx->nl);
+	if (ctx->fake)
+		mnl_fake_stop(ctx->fake);
+	if (ctx->arena)
+		mnl_arena_stop(ctx->arena);
+	if (ctx->batch)
+		mnl_nlmsg_batch_stop(ctx->batch);
+	if (ctx->idx)
+		mnl_attr_index_stop(ctx->idx);
+	free(ctx->out);
+	free(ctx->types);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* best time per run over several samples, each lasting min_time at least. */
+static double bench_time(bench_fn_t fn, struct bench_ctx *ctx,
+			 double min_time, unsigned int samples,
+			 uint64_t *total_runs)
+{
+	double best = 0;
+	unsigned int i;
+
+	fn(ctx);	/* warm up */
+	*total_runs = 0;
+	for (i = 0; i < samples; i++) {
+		uint64_t runs = 0;
+		double t0 = now(), t;
+
+		do {
+			fn(ctx);
+			runs++;
+			t = now() - t0;
+		} while (t < min_time);
+
+		t /= runs;
+		if (i == 0 || t < best)
+			best = t;
+		*total_runs += runs;
+	}
+	return best;
+}
+
+struct baseline {
+	char	bench[32];
+	char	corpus[32];
+	double	ns_per_msg;
+};
+
+static int baseline_load(const char *path, struct baseline *base,
+			 unsigned int max)
+{
+	char line[512];
+	unsigned int n = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+
+	while (n < max && fgets(line, sizeof(line), fp)) {
+		const char *p;
+
+		if (sscanf(line, "{\"bench\":\"%31[^\"]\",\"corpus\":\"%31[^\"]\"",
+			   base[n].bench, base[n].corpus) != 2)
+			continue;
+
+		p = strstr(line, "\"ns_per_msg\":");
+		if (p == NULL)
+			continue;
+
+		base[n].ns_per_msg = strtod(p + strlen("\"ns_per_msg\":"),
+					    NULL);
+		n++;
+	}
+	fclose(fp);
+
+	return n;
+}
+
+static const struct baseline *baseline_find(const struct baseline *base,
+					    int n, const char *bench,
+					    const char *corpus)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(base[i].bench, bench) == 0 &&
+		    strcmp(base[i].corpus, corpus) == 0)
+			return &base[i];
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+		"  -n MSGS     messages per corpus (default 10000)\n"
+		"  -t SECONDS  minimum duration of each sample (default 0.1)\n"
+		"  -r SAMPLES  samples per benchmark, the best one is kept "
+		"(default 5)\n"
+		"  -b BENCH    run this benchmark only\n"
+		"  -c CORPUS   use this corpus only\n"
+		"  -a ATTRS    extra attributes per message (default 0)\n"
+		"  -d DEPTH    nests that hold the extra attributes "
+		"(default 0)\n"
+		"  -s SIZE     payload of the extra attributes (default 4)\n"
+		"  -p SIZE     packet size, a mix of sizes by default\n"
+		"  -B FILE     compare with the results of a previous run\n"
+		"  -T PERCENT  slowdown that is reported as a regression "
+		"(default 10)\n"
+		"  -l          list the benchmarks and the corpora\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct baseline base[BENCH_BASELINE_MAX];
+	struct corpus_params params = {};
+	const char *only_bench = NULL, *only_corpus = NULL;
+	double min_time = 0.1, threshold = 10;
+	unsigned int samples = 5, i, j;
+	int nbase = 0, regressions = 0, opt;
+	uint64_t msgs = 10000;
+
+	while ((opt = getopt(argc, argv, "n:t:r:b:c:a:d:s:p:B:T:lh")) != -1) {
+		switch (opt) {
+		case 'n':
+			msgs = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			min_time = strtod(optarg, NULL);
+			break;
+		case 'r':
+			samples = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			only_bench = optarg;
+			break;
+		case 'c':
+			only_corpus = optarg;
+			break;
+		case 'a':
+			params.attrs = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			params.depth = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			params.attr_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			params.payload = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			nbase = baseline_load(optarg, base,
+					      BENCH_BASELINE_MAX);
+			if (nbase < 0) {
+				perror(optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'T':
+			threshold = strtod(optarg, NULL);
+			break;
+		case 'l':
+			for (i = 0; i < MNL_ARRAY_SIZE(benches); i++)
+				printf("bench %s\n", benches[i].name);
+			for (i = 0; i < corpus_count(); i++)
+				printf("corpus %s\n", corpus_name(i));
+			exit(EXIT_SUCCESS);
+		default:
+			usage(argv[0]);
+			exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (msgs == 0 || samples == 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < corpus_count(); i++) {
+		struct bench_ctx ctx;
+		struct corpus *c;
+
+		if (only_corpus && strcmp(only_corpus, corpus_name(i)) != 0)
+			continue;
+
+		c = corpus_start(corpus_name(i), &params, msgs, BENCH_BUFSIZ);
+		if (c == NULL) {
+			perror("corpus_start");
+			exit(EXIT_FAILURE);
+		}
+		/* uevents are not netlink messages. */
+		if (c->msg == NULL) {
+			corpus_stop(c);
+			continue;
+		}
+		if (bench_ctx_init(&ctx, c) < 0) {
+			perror("bench_ctx_init");
+			exit(EXIT_FAILURE);
+		}
+
+		for (j = 0; j < MNL_ARRAY_SIZE(benches); j++) {
+			const struct baseline *b;
+			double t, ns_msg;
+			uint64_t runs;
+
+			if (only_bench && strcmp(only_bench, benches[j].name))
+				continue;
+
+			t = bench_time(benches[j].fn, &ctx, min_time, samples,
+				       &runs);
+			ns_msg = t * 1e9 / c->msgs;
+
+			printf("{\"bench\":\"%s\",\"corpus\":\"%s\","
+			       "\"msgs\":%llu,\"attrs\":%llu,\"bytes\":%zu,"
+			       "\"runs\":%llu,\"ns_per_msg\":%.2f,"
+			       "\"ns_per_attr\":%.3f,\"mb_per_s\":%.1f",
+			       benches[j].name, c->name,
+			       (unsigned long long)c->msgs,
+			       (unsigned long long)c->attrs, c->len,
+			       (unsigned long long)runs, ns_msg,
+			       t * 1e9 / c->attrs, c->len / t / 1e6);
+
+			b = baseline_find(base, nbase, benches[j].name,
+					  c->name);
+			if (b && b->ns_per_msg > 0) {
+				double change;
+
+				change = (ns_msg / b->ns_per_msg - 1) * 100;
+				printf(",\"baseline_ns_per_msg\":%.2f,"
+				       "\"change_pct\":%.1f", b->ns_per_msg,
+				       change);
+				if (change > threshold) {
+					printf(",\"regression\":true");
+					regressions++;
+				}
+			}
+			printf("}\n");
+			fflush(stdout);
+		}
+		/* keep the compiler from dropping the work. */
+		if (ctx.sink == 0)
+			fprintf(stderr, "%s: empty results\n", c->name);
+
+		bench_ctx_fini(&ctx);
+		corpus_stop(c);
+	}
+
+	return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/* This file is placed in the public domain. */
+/*
+ * Writes synthetic netlink traffic to a pcap file, eg. to replay it or to
+ * decode it with rtnl-link-replay, or to look at it with the usual tools:
+ *
+ *	mnl-corpus -n 1000000 -o ct.pcap ctnetlink
+ *	mnl-corpus -n 100000 -a 64 -d 4 link > links.pcap
+ *
+ * The entries are generated as they are written, so any number of them
+ * can be produced without keeping them in memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <libmnl/libmnl.h>
+
+#include "corpus.h"
+
+struct corpus_out {
+	struct mnl_tap	*tap;
+	int		protocol;
+	uint64_t	dgrams;
+	uint64_t	bytes;
+};
+
+static int write_dgram(const void *buf, size_t len, void *data)
+{
+	struct corpus_out *out = data;
+
+	out->dgrams++;
+	out->bytes += len;
+	return mnl_tap_put(out->tap, buf, len, out->protocol, MNL_TAP_RECV);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] <kind>\n"
+		"  -n MSGS     number of entries (default 1000)\n"
+		"  -a ATTRS    extra attributes per message (default 0)\n"
+		"  -d DEPTH    nests that hold the extra attributes "
+		"(default 0)\n"
+		"  -s SIZE     payload of the extra attributes (default 4)\n"
+		"  -p SIZE     packet size, a mix of sizes by default\n"
+		"  -b BUFSIZ   maximum size of a datagram (default 8192)\n"
+		"  -o FILE     write to this file instead of stdout\n"
+		"  -l          list the kinds\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct corpus_params params = {};
+	struct corpus_out out = {};
+	const char *path = NULL;
+	struct corpus_gen *g;
+	size_t bufsiz = 8192;
+	uint64_t msgs = 1000;
+	struct timespec t0, t1;
+	unsigned int i;
+	double t;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "n:a:d:s:p:b:o:lh")) != -1) {
+		switch (opt) {
+		case 'n':
+			msgs = strtoull(optarg, NULL, 0);
+			break;
+		case 'a':
+			params.attrs = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			params.depth = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			params.attr_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			params.payload = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			bufsiz = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			path = optarg;
+			break;
+		case 'l':
+			for (i = 0; i < corpus_count(); i++)
+				printf("%s\n", corpus_name(i));
+			exit(EXIT_SUCCESS);
+		default:
+			usage(argv[0]);
+			exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	g = corpus_gen_start(argv[optind], &params);
+	if (g == NULL) {
+		perror(argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (path) {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(path);
+			exit(EXIT_FAILURE);
+		}
+	} else if (isatty(STDOUT_FILENO)) {
+		fprintf(stderr, "not writing a capture to a terminal, "
+				"use -o or a redirection\n");
+		exit(EXIT_FAILURE);
+	} else {
+		fd = STDOUT_FILENO;
+	}
+
+	out.tap = mnl_tap_start(fd, 1 << 20);
+	if (out.tap == NULL) {
+		perror("mnl_tap_start");
+		exit(EXIT_FAILURE);
+	}
+	out.protocol = corpus_gen_protocol(g);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (corpus_gen_pack(g, msgs, bufsiz, write_dgram, &out) < 0 ||
+	    mnl_tap_flush(out.tap) < 0) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	fprintf(stderr, "%s: %llu entries in %llu datagrams, %llu bytes, "
+		"%.0f entries/s\n", corpus_gen_name(g),
+		(unsigned long long)msgs, (unsigned long long)out.dgrams,
+		(unsigned long long)out.bytes, t > 0 ? msgs / t : 0);
+
+	mnl_tap_stop(out.tap);
+	if (path)
+		close(fd);
+	corpus_gen_stop(g);
+
+	return 0;
+}
@@ -0,0 +1,632 @@
+/* This example is placed in the public domain. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/genetlink.h>
+
+/*
+ * Generic netlink resolver: it dumps all the families once and keeps their
+ * ids, versions, operations and multicast groups in a table, which is kept
+ * up to date with the notifications of the "notify" group of the
+ * controller. Clients resolve names without asking the kernel each time.
+ *
+ * Each family takes one single allocation that stores its operations and
+ * groups after it. Families are indexed by name, in an open-addressing hash
+ * table, and by id, in an array, since ids are small numbers.
+ */
+
+struct genl_op {
+	uint32_t	id;
+	uint32_t	flags;
+};
+
+struct genl_grp {
+	uint32_t	id;
+	char		name[GENL_NAMSIZ];
+};
+
+struct genl_family {
+	char		name[GENL_NAMSIZ];
+	uint16_t	id;
+	uint32_t	version;
+	uint32_t	hdrsize;
+	uint32_t	maxattr;
+	unsigned int	num_ops;
+	unsigned int	num_grps;
+	struct genl_op	*ops;
+	struct genl_grp	*grps;
+};
+
+struct genl_resolver {
+	/* by name, open addressing with linear probing. */
+	struct genl_family	**by_name;
+	uint32_t		mask;
+	uint32_t		count;
+	/* by id. */
+	struct genl_family	**by_id;
+	uint32_t		max_id;
+};
+
+static uint32_t genl_name_hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static struct genl_family **genl_name_slot(const struct genl_resolver *r,
+					   const char *name)
+{
+	uint32_t i = genl_name_hash(name) & r->mask;
+
+	while (r->by_name[i] && strcmp(r->by_name[i]->name, name))
+		i = (i + 1) & r->mask;
+
+	return &r->by_name[i];
+}
+
+static int genl_resolver_init(struct genl_resolver *r)
+{
+	r->mask = 255;
+	r->count = 0;
+	r->by_name = calloc(r->mask + 1, sizeof(struct genl_family *));
+	r->max_id = 0;
+	r->by_id = NULL;
+	return r->by_name ? 0 : -1;
+}
+
+static void genl_resolver_fini(struct genl_resolver *r)
+{
+	uint32_t i;
+
+	for (i = 0; i <= r->mask; i++)
+		free(r->by_name[i]);
+	free(r->by_name);
+	free(r->by_id);
+}
+
+/*
+ * Lookups.
+ */
+
+static const struct genl_family *
+genl_resolve(const struct genl_resolver *r, const char *name)
+{
+	return *genl_name_slot(r, name);
+}
+
+static const struct genl_family *
+genl_resolve_id(const struct genl_resolver *r, uint16_t id)
+{
+	return id < r->max_id ? r->by_id[id] : NULL;
+}
+
+/* returns the id of the multicast group, -1 if there is no such group. */
+static int genl_resolve_grp(const struct genl_resolver *r, const char *family,
+			    const char *grp)
+{
+	const struct genl_family *f = genl_resolve(r, family);
+	unsigned int i;
+
+	if (f == NULL)
+		return -1;
+
+	for (i = 0; i < f->num_grps; i++) {
+		if (strcmp(f->grps[i].name, grp) == 0)
+			return f->grps[i].id;
+	}
+	return -1;
+}
+
+/*
+ * Updates.
+ */
+
+static void genl_resolver_del(struct genl_resolver *r, const char *name)
+{
+	struct genl_family **slot = genl_name_slot(r, name), *f = *slot;
+	uint32_t i, j, home;
+
+	if (f == NULL)
+		return;
+
+	if (f->id < r->max_id && r->by_id[f->id] == f)
+		r->by_id[f->id] = NULL;
+
+	/* backward shift deletion, so that no tombstones are needed. */
+	i = j = slot - r->by_name;
+	for (;;) {
+		j = (j + 1) & r->mask;
+		if (r->by_name[j] == NULL)
+			break;
+
+		home = genl_name_hash(r->by_name[j]->name) & r->mask;
+		if (((j - home) & r->mask) >= ((j - i) & r->mask)) {
+			r->by_name[i] = r->by_name[j];
+			i = j;
+		}
+	}
+	r->by_name[i] = NULL;
+	r->count--;
+	free(f);
+}
+
+/*
+ * The table takes ownership of f, which is released on error. An entry with
+ * the same name is replaced once the tables have room for f, so that it is
+ * still there if the allocation fails.
+ */
+static int genl_resolver_add(struct genl_resolver *r, struct genl_family *f)
+{
+	struct genl_family **slot, *old = *genl_name_slot(r, f->name);
+
+	/* the name table is kept half empty, it is small anyway. */
+	if (r->count + (old ? 0 : 1) > (r->mask + 1) / 2) {
+		struct genl_resolver bigger = *r;
+		uint32_t i;
+
+		bigger.mask = (r->mask << 1) | 1;
+		bigger.by_name = calloc(bigger.mask + 1,
+					sizeof(struct genl_family *));
+		if (bigger.by_name == NULL)
+			goto err;
+
+		for (i = 0; i <= r->mask; i++) {
+			if (r->by_name[i])
+				*genl_name_slot(&bigger, r->by_name[i]->name) =
+					r->by_name[i];
+		}
+		free(r->by_name);
+		r->by_name = bigger.by_name;
+		r->mask = bigger.mask;
+	}
+
+	if (f->id >= r->max_id) {
+		uint32_t max = r->max_id ? r->max_id : 64;
+		struct genl_family **by_id;
+
+		while (max <= f->id)
+			max *= 2;
+
+		by_id = realloc(r->by_id, max * sizeof(struct genl_family *));
+		if (by_id == NULL)
+			goto err;
+
+		memset(&by_id[r->max_id], 0,
+		       (max - r->max_id) * sizeof(struct genl_family *));
+		r->by_id = by_id;
+		r->max_id = max;
+	}
+
+	slot = genl_name_slot(r, f->name);
+	if (old) {
+		/* same name, same slot, the family may have a new id though. */
+		if (old->id < r->max_id && r->by_id[old->id] == old)
+			r->by_id[old->id] = NULL;
+		free(old);
+	} else {
+		r->count++;
+	}
+	*slot = f;
+	r->by_id[f->id] = f;
+	return 0;
+err:
+	free(f);
+	return -1;
+}
+
+/*
+ * Netlink side.
+ */
+
+static int parse_mc_grps_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	/* skip unsupported attribute in user-space */
+	if (mnl_attr_type_valid(attr, CTRL_ATTR_MCAST_GRP_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTRL_ATTR_MCAST_GRP_ID:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case CTRL_ATTR_MCAST_GRP_NAME:
+		if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int parse_family_ops_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, CTRL_ATTR_OP_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTRL_ATTR_OP_ID:
+	case CTRL_ATTR_OP_FLAGS:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int data_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, CTRL_ATTR_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTRL_ATTR_FAMILY_NAME:
+		if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case CTRL_ATTR_FAMILY_ID:
+		if (mnl_attr_validate(attr, MNL_TYPE_U16) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case CTRL_ATTR_VERSION:
+	case CTRL_ATTR_HDRSIZE:
+	case CTRL_ATTR_MAXATTR:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case CTRL_ATTR_OPS:
+	case CTRL_ATTR_MCAST_GROUPS:
+		if (mnl_attr_validate(attr, MNL_TYPE_NESTED) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static unsigned int count_nested(const struct nlattr *nested)
+{
+	const struct nlattr *pos;
+	unsigned int n = 0;
+
+	if (nested == NULL)
+		return 0;
+
+	mnl_attr_for_each_nested(pos, nested)
+		n++;
+	return n;
+}
+
+/* build the family from a CTRL_CMD_NEWFAMILY message, in one allocation. */
+static struct genl_family *genl_family_build(struct nlattr *tb[])
+{
+	unsigned int num_ops = count_nested(tb[CTRL_ATTR_OPS]);
+	unsigned int num_grps = count_nested(tb[CTRL_ATTR_MCAST_GROUPS]);
+	struct genl_family *f;
+	struct nlattr *pos;
+
+	f = calloc(1, sizeof(struct genl_family) +
+		      num_ops * sizeof(struct genl_op) +
+		      num_grps * sizeof(struct genl_grp));
+	if (f == NULL)
+		return NULL;
+
+	f->ops = (struct genl_op *)(f + 1);
+	f->grps = (struct genl_grp *)(f->ops + num_ops);
+
+	snprintf(f->name, sizeof(f->name), "%s",
+		 mnl_attr_get_str(tb[CTRL_ATTR_FAMILY_NAME]));
+	f->id = mnl_attr_get_u16(tb[CTRL_ATTR_FAMILY_ID]);
+	if (tb[CTRL_ATTR_VERSION])
+		f->version = mnl_attr_get_u32(tb[CTRL_ATTR_VERSION]);
+	if (tb[CTRL_ATTR_HDRSIZE])
+		f->hdrsize = mnl_attr_get_u32(tb[CTRL_ATTR_HDRSIZE]);
+	if (tb[CTRL_ATTR_MAXATTR])
+		f->maxattr = mnl_attr_get_u32(tb[CTRL_ATTR_MAXATTR]);
+
+	if (tb[CTRL_ATTR_OPS]) {
+		mnl_attr_for_each_nested(pos, tb[CTRL_ATTR_OPS]) {
+			struct nlattr *tbo[CTRL_ATTR_OP_MAX+1] = {};
+			struct genl_op *op = &f->ops[f->num_ops];
+
+			if (mnl_attr_parse_nested(pos, parse_family_ops_cb,
+						  tbo) < 0 ||
+			    !tbo[CTRL_ATTR_OP_ID])
+				continue;
+
+			op->id = mnl_attr_get_u32(tbo[CTRL_ATTR_OP_ID]);
+			if (tbo[CTRL_ATTR_OP_FLAGS])
+				op->flags = mnl_attr_get_u32(tbo[CTRL_ATTR_OP_FLAGS]);
+			f->num_ops++;
+		}
+	}
+	if (tb[CTRL_ATTR_MCAST_GROUPS]) {
+		mnl_attr_for_each_nested(pos, tb[CTRL_ATTR_MCAST_GROUPS]) {
+			struct nlattr *tbg[CTRL_ATTR_MCAST_GRP_MAX+1] = {};
+			struct genl_grp *grp = &f->grps[f->num_grps];
+
+			if (mnl_attr_parse_nested(pos, parse_mc_grps_cb,
+						  tbg) < 0 ||
+			    !tbg[CTRL_ATTR_MCAST_GRP_ID] ||
+			    !tbg[CTRL_ATTR_MCAST_GRP_NAME])
+				continue;
+
+			grp->id = mnl_attr_get_u32(tbg[CTRL_ATTR_MCAST_GRP_ID]);
+			snprintf(grp->name, sizeof(grp->name), "%s",
+				 mnl_attr_get_str(tbg[CTRL_ATTR_MCAST_GRP_NAME]));
+			f->num_grps++;
+		}
+	}
+	return f;
+}
+
+/* add or remove one group, the family is rebuilt with its new groups. */
+static int genl_family_update_grp(struct genl_resolver *r, struct nlattr *tb[],
+				  bool add)
+{
+	const struct genl_family *old;
+	struct genl_family *f;
+	struct nlattr *tbg[CTRL_ATTR_MCAST_GRP_MAX+1] = {};
+	struct nlattr *pos;
+	unsigned int i, num_grps;
+	size_t size;
+
+	old = genl_resolve(r, mnl_attr_get_str(tb[CTRL_ATTR_FAMILY_NAME]));
+	if (old == NULL || !tb[CTRL_ATTR_MCAST_GROUPS])
+		return 0;
+
+	/* the notification carries the group that changed only. */
+	mnl_attr_for_each_nested(pos, tb[CTRL_ATTR_MCAST_GROUPS]) {
+		if (mnl_attr_parse_nested(pos, parse_mc_grps_cb, tbg) < 0)
+			return -1;
+		break;
+	}
+	if (!tbg[CTRL_ATTR_MCAST_GRP_ID] || !tbg[CTRL_ATTR_MCAST_GRP_NAME])
+		return 0;
+
+	num_grps = old->num_grps + (add ? 1 : 0);
+	size = sizeof(struct genl_family) +
+	       old->num_ops * sizeof(struct genl_op) +
+	       num_grps * sizeof(struct genl_grp);
+	f = calloc(1, size);
+	if (f == NULL)
+		return -1;
+
+	*f = *old;
+	f->ops = (struct genl_op *)(f + 1);
+	f->grps = (struct genl_grp *)(f->ops + f->num_ops);
+	memcpy(f->ops, old->ops, old->num_ops * sizeof(struct genl_op));
+
+	f->num_grps = 0;
+	for (i = 0; i < old->num_grps; i++) {
+		if (old->grps[i].id == mnl_attr_get_u32(tbg[CTRL_ATTR_MCAST_GRP_ID]))
+			continue;
+		f->grps[f->num_grps++] = old->grps[i];
+	}
+	if (add) {
+		struct genl_grp *grp = &f->grps[f->num_grps++];
+
+		grp->id = mnl_attr_get_u32(tbg[CTRL_ATTR_MCAST_GRP_ID]);
+		snprintf(grp->name, sizeof(grp->name), "%s",
+			 mnl_attr_get_str(tbg[CTRL_ATTR_MCAST_GRP_NAME]));
+	}
+
+	return genl_resolver_add(r, f);
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct genl_resolver *r = data;
+	struct nlattr *tb[CTRL_ATTR_MAX+1] = {};
+	struct genlmsghdr *genl = mnl_nlmsg_get_payload(nlh);
+	struct genl_family *f;
+
+	mnl_attr_parse(nlh, sizeof(*genl), data_attr_cb, tb);
+	if (!tb[CTRL_ATTR_FAMILY_NAME] || !tb[CTRL_ATTR_FAMILY_ID])
+		return MNL_CB_OK;
+
+	switch (genl->cmd) {
+	case CTRL_CMD_NEWFAMILY:
+		f = genl_family_build(tb);
+		if (f == NULL || genl_resolver_add(r, f) < 0)
+			return MNL_CB_ERROR;
+		break;
+	case CTRL_CMD_DELFAMILY:
+		genl_resolver_del(r, mnl_attr_get_str(tb[CTRL_ATTR_FAMILY_NAME]));
+		break;
+	case CTRL_CMD_NEWMCAST_GRP:
+	case CTRL_CMD_DELMCAST_GRP:
+		if (genl_family_update_grp(r, tb,
+					   genl->cmd == CTRL_CMD_NEWMCAST_GRP) < 0)
+			return MNL_CB_ERROR;
+		break;
+	default:
+		return MNL_CB_OK;
+	}
+
+	if (nlh->nlmsg_pid == 0 && nlh->nlmsg_seq == 0)
+		printf("family %s changed (cmd=%u)\n",
+		       mnl_attr_get_str(tb[CTRL_ATTR_FAMILY_NAME]), genl->cmd);
+
+	return MNL_CB_OK;
+}
+
+/* family NULL dumps all the families. */
+static int genl_resolver_query(struct genl_resolver *r, struct mnl_socket *nl,
+			       const char *family)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct genlmsghdr *genl;
+	unsigned int seq, portid = mnl_socket_get_portid(nl);
+	int ret;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= GENL_ID_CTRL;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nlh->nlmsg_seq = seq = time(NULL);
+
+	genl = mnl_nlmsg_put_extra_header(nlh, sizeof(struct genlmsghdr));
+	genl->cmd = CTRL_CMD_GETFAMILY;
+	genl->version = 1;
+
+	if (family)
+		mnl_attr_put_strz(nlh, CTRL_ATTR_FAMILY_NAME, family);
+	else
+		nlh->nlmsg_flags |= NLM_F_DUMP;
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+		return -1;
+
+	do {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1)
+			return -1;
+
+		ret = mnl_cb_run(buf, ret, seq, portid, data_cb, r);
+	} while (ret > MNL_CB_STOP);
+
+	return ret;
+}
+
+static void print_family(const struct genl_family *f)
+{
+	unsigned int i;
+
+	printf("name=%s\tid=%u\tversion=%u\thdrsize=%u\tmaxattr=%u\tops=%u",
+	       f->name, f->id, f->version, f->hdrsize, f->maxattr, f->num_ops);
+	for (i = 0; i < f->num_grps; i++)
+		printf("\tgrp %s=%u", f->grps[i].name, f->grps[i].id);
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct mnl_socket *nl;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct genl_resolver r;
+	struct timespec start, end;
+	int i, ret, notify;
+
+	nl = mnl_socket_open(NETLINK_GENERIC);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+
+	if (genl_resolver_init(&r) < 0) {
+		perror("genl_resolver_init");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* subscribe to the controller notifications before the dump, so
+	 * that no change is missed. */
+	if (genl_resolver_query(&r, nl, "nlctrl") < 0) {
+		perror("genl_resolver_query");
+		exit(EXIT_FAILURE);
+	}
+	notify = genl_resolve_grp(&r, "nlctrl", "notify");
+	if (notify < 0 ||
+	    mnl_socket_setsockopt(nl, NETLINK_ADD_MEMBERSHIP, &notify,
+				  sizeof(int)) < 0) {
+		perror("mnl_socket_setsockopt");
+		exit(EXIT_FAILURE);
+	}
+
+	if (genl_resolver_query(&r, nl, NULL) < 0) {
+		perror("genl_resolver_query");
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%u families resolved in %ld us\n", r.count,
+	       (end.tv_sec - start.tv_sec) * 1000000 +
+	       (end.tv_nsec - start.tv_nsec) / 1000);
+
+	/* family or family/group */
+	for (i = 1; i < argc; i++) {
+		const struct genl_family *f;
+		char *grp = strchr(argv[i], '/');
+
+		if (grp) {
+			*grp++ = '\0';
+			printf("%s/%s=%d\n", argv[i], grp,
+			       genl_resolve_grp(&r, argv[i], grp));
+			continue;
+		}
+		f = genl_resolve(&r, argv[i]);
+		if (f)
+			print_family(f);
+		else
+			printf("%s not found\n", argv[i]);
+	}
+	if (argc == 1) {
+		uint32_t id;
+
+		for (id = 0; id < r.max_id; id++) {
+			if (genl_resolve_id(&r, id))
+				print_family(genl_resolve_id(&r, id));
+		}
+	}
+
+	/* keep the table up to date. */
+	while (1) {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1) {
+			perror("mnl_socket_recvfrom");
+			exit(EXIT_FAILURE);
+		}
+
+		ret = mnl_cb_run(buf, ret, 0, 0, data_cb, &r);
+		if (ret == -1) {
+			perror("mnl_cb_run");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	genl_resolver_fini(&r);
+	mnl_socket_close(nl);
+
+	return 0;
+}
@@ -1,17 +1,436 @@
 /* This example is placed in the public domain. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
 #include <unistd.h>
 #include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
 
 #include <libmnl/libmnl.h>
 #include <linux/netlink.h>
 
+/*
+ * kobject uses a string based protocol, with no initial netlink header.
+ * The kernel sends "ACTION@DEVPATH" followed by NUL-separated KEY=VALUE
+ * strings to group 1, udevd forwards the processed events to group 2 with
+ * a binary header in front of the KEY=VALUE strings.
+ */
+
+#define UEVENT_GROUP_KERNEL	(1 << 0)
+#define UEVENT_GROUP_UDEV	(1 << 1)
+
+/* header of the events sent by udevd, see libudev. */
+#define UDEV_MONITOR_MAGIC	0xfeedcafe
+
+struct udev_monitor_netlink_header {
+	char		prefix[8];	/* "libudev" */
+	uint32_t	magic;		/* network byte order */
+	uint32_t	header_size;
+	uint32_t	properties_off;
+	uint32_t	properties_len;
+	uint32_t	filter_subsystem_hash;	/* network byte order */
+	uint32_t	filter_devtype_hash;	/* network byte order */
+	uint32_t	filter_tag_bloom_hi;
+	uint32_t	filter_tag_bloom_lo;
+};
+
+/*
+ * The parser does not allocate nor copy anything: the index points to the
+ * strings in the receive buffer, which has to outlive it.
+ */
+#define UEVENT_MAX_KEYS		64
+
+struct uevent_key {
+	const char	*key;
+	unsigned int	key_len;
+	const char	*value;
+};
+
+struct uevent {
+	bool			udev;
+	/* the most used keys, NULL if they are not in the event. */
+	const char		*action;
+	const char		*devpath;
+	const char		*subsystem;
+	const char		*devtype;
+	const char		*seqnum;
+	unsigned int		num_keys;
+	struct uevent_key	keys[UEVENT_MAX_KEYS];
+};
+
+#define KEY_IS(k, len, str) \
+	((len) == sizeof(str) - 1 && memcmp((k), (str), (len)) == 0)
+
+static void uevent_index_key(struct uevent *ev, const char *key,
+			     unsigned int key_len, const char *value)
+{
+	switch (key_len) {
+	case 6:
+		if (KEY_IS(key, key_len, "ACTION"))
+			ev->action = value;
+		else if (KEY_IS(key, key_len, "SEQNUM"))
+			ev->seqnum = value;
+		break;
+	case 7:
+		if (KEY_IS(key, key_len, "DEVPATH"))
+			ev->devpath = value;
+		else if (KEY_IS(key, key_len, "DEVTYPE"))
+			ev->devtype = value;
+		break;
+	case 9:
+		if (KEY_IS(key, key_len, "SUBSYSTEM"))
+			ev->subsystem = value;
+		break;
+	}
+
+	if (ev->num_keys < UEVENT_MAX_KEYS) {
+		struct uevent_key *k = &ev->keys[ev->num_keys++];
+
+		k->key = key;
+		k->key_len = key_len;
+		k->value = value;
+	}
+}
+
+/*
+ * uevent_parse - index the keys of one event
+ *
+ * The buffer must be NUL-terminated, ie. buf[len] == '\0', so that the last
+ * value is a valid string even if the sender did not terminate it. It
+ * returns -1 if the event is malformed.
+ */
+static int uevent_parse(struct uevent *ev, const char *buf, size_t len)
+{
+	const char *cur, *end, *eq;
+
+	memset(ev, 0, offsetof(struct uevent, keys));
+
+	if (len >= sizeof(struct udev_monitor_netlink_header) &&
+	    memcmp(buf, "libudev", 8) == 0) {
+		const struct udev_monitor_netlink_header *hdr =
+			(const struct udev_monitor_netlink_header *)buf;
+
+		if (ntohl(hdr->magic) != UDEV_MONITOR_MAGIC ||
+		    hdr->properties_off < sizeof(*hdr) ||
+		    hdr->properties_off > len ||
+		    hdr->properties_len > len - hdr->properties_off)
+			return -1;
+
+		ev->udev = true;
+		cur = buf + hdr->properties_off;
+		end = cur + hdr->properties_len;
+	} else {
+		/* skip ACTION@DEVPATH, both are also given as keys. */
+		cur = memchr(buf, '\0', len);
+		if (cur == NULL || memchr(buf, '@', cur - buf) == NULL)
+			return -1;
+
+		cur++;
+		end = buf + len;
+	}
+
+	while (cur < end) {
+		size_t slen = strnlen(cur, end - cur);
+
+		eq = memchr(cur, '=', slen);
+		if (eq)
+			uevent_index_key(ev, cur, eq - cur, eq + 1);
+
+		cur += slen + 1;
+	}
+
+	if (ev->action == NULL || ev->devpath == NULL)
+		return -1;
+
+	return 0;
+}
+
+static const char *uevent_get(const struct uevent *ev, const char *key)
+{
+	size_t len = strlen(key);
+	unsigned int i;
+
+	for (i = 0; i < ev->num_keys; i++) {
+		if (ev->keys[i].key_len == len &&
+		    memcmp(ev->keys[i].key, key, len) == 0)
+			return ev->keys[i].value;
+	}
+	return NULL;
+}
+
+/*
+ * Filtering.
+ */
+
+#define MAX_FILTERS	8
+
+struct uevent_filter {
+	const char	*action[MAX_FILTERS];
+	unsigned int	num_action;
+	const char	*subsystem[MAX_FILTERS];
+	unsigned int	num_subsystem;
+};
+
+static bool filter_match_one(const char * const *list, unsigned int num,
+			     const char *value)
+{
+	unsigned int i;
+
+	if (num == 0)
+		return true;
+	if (value == NULL)
+		return false;
+
+	for (i = 0; i < num; i++) {
+		if (strcmp(list[i], value) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool uevent_filter_match(const struct uevent_filter *f,
+				const struct uevent *ev)
+{
+	return filter_match_one(f->action, f->num_action, ev->action) &&
+	       filter_match_one(f->subsystem, f->num_subsystem, ev->subsystem);
+}
+
+/* MurmurHash2, this is what udevd uses to hash the subsystem. */
+static uint32_t murmur_hash2(const char *key, size_t len, uint32_t seed)
+{
+	const uint32_t m = 0x5bd1e995;
+	const int r = 24;
+	uint32_t h = seed ^ len;
+
+	while (len >= 4) {
+		uint32_t k;
+
+		memcpy(&k, key, sizeof(k));
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h *= m;
+		h ^= k;
+		key += 4;
+		len -= 4;
+	}
+	switch (len) {
+	case 3:
+		h ^= (unsigned char)key[2] << 16;
+		/* fall through */
+	case 2:
+		h ^= (unsigned char)key[1] << 8;
+		/* fall through */
+	case 1:
+		h ^= (unsigned char)key[0];
+		h *= m;
+	}
+	h ^= h >> 13;
+	h *= m;
+	h ^= h >> 15;
+	return h;
+}
+
+/* the first bytes of str, as BPF loads them: in network byte order. */
+static uint32_t str_chunk(const char *str, unsigned int len)
+{
+	uint32_t val = 0;
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		val = (val << 8) | (unsigned char)str[i];
+
+	return val;
+}
+
+/*
+ * Drop the events that do not match in the kernel, before they are queued
+ * to the socket. Only fixed offsets can be matched in classic BPF: the
+ * kernel events start with "ACTION@", the udev events carry the hash of
+ * the subsystem in their header. Whatever passes the filter is matched
+ * again in user-space anyway.
+ */
+static int uevent_attach_filter(struct mnl_socket *nl,
+				const struct uevent_filter *f, int group)
+{
+	struct sock_filter code[128];
+	struct sock_fprog fprog = {
+		.filter = code,
+	};
+	unsigned int n = 0, i, reject[16], num_reject;
+
+	if (group == UEVENT_GROUP_KERNEL && f->num_action) {
+		for (i = 0; i < f->num_action; i++) {
+			char prefix[16];
+			unsigned int off, len, chunk;
+
+			len = snprintf(prefix, sizeof(prefix), "%s@",
+				       f->action[i]);
+			if (len >= sizeof(prefix)) {
+				errno = EINVAL;
+				return -1;
+			}
+
+			/* compare the prefix in words, then half-words... */
+			num_reject = 0;
+			for (off = 0; off < len; off += chunk) {
+				chunk = len - off >= 4 ? 4 : len - off >= 2 ? 2 : 1;
+				code[n++] = (struct sock_filter)
+					BPF_STMT(BPF_LD|BPF_ABS|
+						 (chunk == 4 ? BPF_W :
+						  chunk == 2 ? BPF_H : BPF_B),
+						 off);
+				reject[num_reject++] = n;
+				code[n++] = (struct sock_filter)
+					BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K,
+						 str_chunk(prefix + off, chunk),
+						 0, 0);
+			}
+			code[n++] = (struct sock_filter)
+				BPF_STMT(BPF_RET|BPF_K, 0xffffffff);
+			/* ...and try the next action if it does not match. */
+			while (num_reject--)
+				code[reject[num_reject]].jf =
+					n - reject[num_reject] - 1;
+		}
+	} else if (group == UEVENT_GROUP_UDEV && f->num_subsystem) {
+		num_reject = 0;
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 0);
+		reject[num_reject++] = n;
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, str_chunk("libu", 4), 0, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, 4);
+		reject[num_reject++] = n;
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, str_chunk("dev", 4), 0, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+				 offsetof(struct udev_monitor_netlink_header,
+					  magic));
+		reject[num_reject++] = n;
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, UDEV_MONITOR_MAGIC,
+				 0, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+				 offsetof(struct udev_monitor_netlink_header,
+					  filter_subsystem_hash));
+		for (i = 0; i < f->num_subsystem; i++) {
+			const char *s = f->subsystem[i];
+
+			/* the last one falls through to the reject below. */
+			code[n++] = (struct sock_filter)
+				BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K,
+					 murmur_hash2(s, strlen(s), 0),
+					 f->num_subsystem - i, 0);
+		}
+		code[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_RET|BPF_K, 0xffffffff);
+		/* the header does not match, it does not come from udevd. */
+		while (num_reject--)
+			code[reject[num_reject]].jf =
+				n - 2 - reject[num_reject] - 1;
+
+		fprog.len = n;
+		return setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET,
+				  SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+	}
+	if (n == 0)
+		return 0;
+
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, 0);
+
+	fprog.len = n;
+	return setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET,
+			  SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+}
+
+static void print_uevent(const struct uevent *ev, bool verbose)
+{
+	unsigned int i;
+
+	const char *devname = uevent_get(ev, "DEVNAME");
+
+	printf("%s%s %s %s %s", ev->udev ? "[UDEV] " : "",
+	       ev->seqnum ? ev->seqnum : "-", ev->action,
+	       ev->subsystem ? ev->subsystem : "-", ev->devpath);
+	if (devname)
+		printf(" (%s)", devname);
+
+	if (verbose) {
+		for (i = 0; i < ev->num_keys; i++)
+			printf("\n\t%.*s=%s", ev->keys[i].key_len,
+			       ev->keys[i].key, ev->keys[i].value);
+	}
+	printf("\n");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+		"  -a, --action ACTION\t\tshow this action only\n"
+		"  -s, --subsystem SUBSYSTEM\tshow this subsystem only\n"
+		"  -u, --udev\t\t\tlisten to the events sent by udevd\n"
+		"  -b, --rcvbuf BYTES\t\treceive buffer size\n"
+		"  -v, --verbose\t\t\tshow all the keys\n"
+		"Up to %d actions and subsystems can be given.\n",
+		prog, MAX_FILTERS);
+	exit(EXIT_FAILURE);
+}
+
 int main(int argc, char *argv[])
 {
+	static const struct option options[] = {
+		{ "action",	required_argument,	NULL, 'a' },
+		{ "subsystem",	required_argument,	NULL, 's' },
+		{ "udev",	no_argument,		NULL, 'u' },
+		{ "rcvbuf",	required_argument,	NULL, 'b' },
+		{ "verbose",	no_argument,		NULL, 'v' },
+		{ }
+	};
 	struct mnl_socket *nl;
-	char buf[MNL_SOCKET_BUFFER_SIZE];
-	int ret;
+	char buf[MNL_SOCKET_BUFFER_SIZE + 1];
+	struct uevent_filter filter = {};
+	struct uevent ev;
+	int group = UEVENT_GROUP_KERNEL, rcvbuf = 0, opt, ret;
+	bool verbose = false;
+
+	while ((opt = getopt_long(argc, argv, "a:s:ub:v", options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			if (filter.num_action == MAX_FILTERS)
+				usage(argv[0]);
+			filter.action[filter.num_action++] = optarg;
+			break;
+		case 's':
+			if (filter.num_subsystem == MAX_FILTERS)
+				usage(argv[0]);
+			filter.subsystem[filter.num_subsystem++] = optarg;
+			break;
+		case 'u':
+			group = UEVENT_GROUP_UDEV;
+			break;
+		case 'b':
+			rcvbuf = atoi(optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
 	nl = mnl_socket_open(NETLINK_KOBJECT_UEVENT);
 	if (nl == NULL) {
@@ -19,24 +438,37 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	/* There is one single group in kobject over netlink */
-	if (mnl_socket_bind(nl, (1<<0), MNL_SOCKET_AUTOPID) < 0) {
+	/* hotplug storms at boot or on VF creation bring tens of thousands
+	 * of events, a large buffer avoids losing them. */
+	if (rcvbuf &&
+	    setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUFFORCE,
+		       &rcvbuf, sizeof(int)) < 0 &&
+	    setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUF,
+		       &rcvbuf, sizeof(int)) < 0) {
+		perror("setsockopt");
+		exit(EXIT_FAILURE);
+	}
+
+	/* set up the filter before binding, so that nothing slips through. */
+	if (uevent_attach_filter(nl, &filter, group) < 0) {
+		perror("uevent_attach_filter");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mnl_socket_bind(nl, group, MNL_SOCKET_AUTOPID) < 0) {
 		perror("mnl_socket_bind");
 		exit(EXIT_FAILURE);
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf) - 1);
 	while (ret > 0) {
-		int i;
+		buf[ret] = '\0';
 
-		/* kobject uses a string based protocol, with no initial
-		 * netlink header.
-		 */
-		for (i=0; i<ret; i++)
-			printf("%c", buf[i]);
+		if (uevent_parse(&ev, buf, ret) == 0 &&
+		    uevent_filter_match(&filter, &ev))
+			print_uevent(&ev, verbose);
 
-		printf("\n");
-		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf) - 1);
 	}
 	if (ret == -1) {
 		perror("error");
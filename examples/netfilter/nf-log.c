@@ -1,10 +1,19 @@
 /* This example is placed in the public domain. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <time.h>
+#include <endian.h>
+#include <pthread.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
 
 #include <libmnl/libmnl.h>
 #include <linux/netfilter.h>
@@ -80,6 +89,243 @@ static int log_cb(const struct nlmsghdr *nlh, void *data)
 	return MNL_CB_OK;
 }
 
+/*
+ * Collector: the packets are stored in pcap format with LINKTYPE_NFLOG,
+ * whose records are the nfgenmsg header and the attributes as the kernel
+ * sends them, so the prefix, the mark and the interfaces are kept and no
+ * conversion is needed. The reader copies the records to a ring buffer
+ * and a background thread writes them to disk, so that the socket is
+ * never left unattended while the disk is busy.
+ */
+#define LINKTYPE_NFLOG		239
+
+struct pcap_file_hdr {
+	uint32_t	magic;
+	uint16_t	version_major;
+	uint16_t	version_minor;
+	int32_t		thiszone;
+	uint32_t	sigfigs;
+	uint32_t	snaplen;
+	uint32_t	linktype;
+};
+
+struct pcap_rec_hdr {
+	uint32_t	ts_sec;
+	uint32_t	ts_usec;
+	uint32_t	incl_len;
+	uint32_t	orig_len;
+};
+
+/*
+ * Single producer, single consumer ring of bytes. The records are stored
+ * as they go to the file, wrapping around the end of the ring if needed,
+ * so the writer sends contiguous areas to disk without looking at them.
+ * head and tail grow forever, their difference is the used room.
+ */
+struct log_ring {
+	char			*data;
+	size_t			size;	/* power of two */
+	_Atomic uint64_t	head __attribute__((aligned(64)));
+	/* last tail seen by the producer, to avoid touching the line of
+	 * the consumer for each record. */
+	uint64_t		cached_tail;
+	/* only written by the producer, read for the statistics. */
+	_Atomic uint64_t	dropped;
+	_Atomic uint64_t	tail __attribute__((aligned(64)));
+};
+
+static int log_ring_init(struct log_ring *r, size_t size)
+{
+	memset(r, 0, sizeof(*r));
+	r->size = size;
+	r->data = malloc(size);
+	return r->data ? 0 : -1;
+}
+
+static void log_ring_copy(struct log_ring *r, uint64_t pos, const void *src,
+			  size_t len)
+{
+	size_t off = pos & (r->size - 1);
+	size_t first = len < r->size - off ? len : r->size - off;
+
+	memcpy(r->data + off, src, first);
+	memcpy(r->data, (const char *)src + first, len - first);
+}
+
+/* only called by the producer, the record is dropped if it does not fit. */
+static bool log_ring_push(struct log_ring *r, const struct pcap_rec_hdr *hdr,
+			  const void *data, size_t len)
+{
+	uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t total = sizeof(*hdr) + len;
+
+	if (head + total - r->cached_tail > r->size) {
+		r->cached_tail = atomic_load_explicit(&r->tail,
+						      memory_order_acquire);
+		if (head + total - r->cached_tail > r->size) {
+			atomic_fetch_add_explicit(&r->dropped, 1,
+						  memory_order_relaxed);
+			return false;
+		}
+	}
+
+	log_ring_copy(r, head, hdr, sizeof(*hdr));
+	log_ring_copy(r, head + sizeof(*hdr), data, len);
+	atomic_store_explicit(&r->head, head + total, memory_order_release);
+	return true;
+}
+
+struct log_writer {
+	pthread_t		thread;
+	struct log_ring		ring;
+	int			fd;
+	_Atomic uint64_t	packets;
+	_Atomic uint64_t	enobufs;
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static void *log_writer_run(void *data)
+{
+	struct log_writer *w = data;
+	struct log_ring *r = &w->ring;
+	const struct timespec idle = { .tv_nsec = 1000000 };
+	uint64_t head, tail = 0, last_packets = 0;
+	time_t last = time(NULL);
+
+	while (1) {
+		head = atomic_load_explicit(&r->head, memory_order_acquire);
+		if (head == tail) {
+			nanosleep(&idle, NULL);
+		} else {
+			size_t off = tail & (r->size - 1);
+			size_t len = head - tail;
+			size_t first = len < r->size - off ? len : r->size - off;
+
+			if (write_all(w->fd, r->data + off, first) < 0 ||
+			    write_all(w->fd, r->data, len - first) < 0) {
+				perror("write");
+				exit(EXIT_FAILURE);
+			}
+			tail = head;
+			atomic_store_explicit(&r->tail, tail,
+					      memory_order_release);
+		}
+
+		if (time(NULL) != last) {
+			uint64_t packets = atomic_load_explicit(&w->packets,
+							memory_order_relaxed);
+
+			fprintf(stderr, "%llu packets/s, %llu total, "
+				"%llu dropped in ring, %llu ENOBUFS\n",
+				(unsigned long long)(packets - last_packets),
+				(unsigned long long)packets,
+				(unsigned long long)
+				atomic_load_explicit(&r->dropped,
+						     memory_order_relaxed),
+				(unsigned long long)
+				atomic_load_explicit(&w->enobufs,
+						     memory_order_relaxed));
+			last_packets = packets;
+			last = time(NULL);
+		}
+	}
+	return NULL;
+}
+
+static int log_writer_start(struct log_writer *w, const char *path,
+			    size_t ring_size)
+{
+	struct pcap_file_hdr hdr = {
+		.magic		= 0xa1b2c3d4,
+		.version_major	= 2,
+		.version_minor	= 4,
+		/* records hold the metadata too, they go over 64 KBytes. */
+		.snaplen	= 262144,
+		.linktype	= LINKTYPE_NFLOG,
+	};
+
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0)
+		return -1;
+
+	if (write_all(w->fd, (const char *)&hdr, sizeof(hdr)) < 0)
+		return -1;
+
+	if (log_ring_init(&w->ring, ring_size) < 0)
+		return -1;
+
+	errno = pthread_create(&w->thread, NULL, log_writer_run, w);
+	return errno ? -1 : 0;
+}
+
+static const struct mnl_attr_policy nflog_policy[NFULA_MAX+1] = {
+	[NFULA_TIMESTAMP]	= { MNL_TYPE_UNSPEC,
+				    sizeof(struct nfulnl_msg_packet_timestamp) },
+};
+
+struct collect_batch {
+	struct log_writer	*w;
+	/* reception time, for the packets with no timestamp. */
+	struct timespec		now;
+};
+
+static int collect_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct collect_batch *b = data;
+	struct mnl_attr_span spans[NFULA_MAX * 2];
+	const struct nlattr *tb[NFULA_MAX+1] = {};
+	const void *payload = mnl_nlmsg_get_payload_offset(nlh,
+						sizeof(struct nfgenmsg));
+	size_t payload_len = mnl_nlmsg_get_payload_len(nlh);
+	struct pcap_rec_hdr hdr;
+	int n;
+
+	if (payload_len < sizeof(struct nfgenmsg))
+		return MNL_CB_OK;
+
+	payload_len -= sizeof(struct nfgenmsg);
+
+	/* the scanner is much cheaper than one callback per attribute, and
+	 * the timestamp is the only thing that has to be looked at. */
+	n = mnl_attr_scan(payload, payload_len, spans, NFULA_MAX * 2);
+	if (n > 0 &&
+	    mnl_attr_parse_policy(payload, spans, n, nflog_policy,
+				  NFULA_MAX, tb) == 0 &&
+	    tb[NFULA_TIMESTAMP]) {
+		const struct nfulnl_msg_packet_timestamp *ts =
+			mnl_attr_get_payload(tb[NFULA_TIMESTAMP]);
+
+		hdr.ts_sec = be64toh(ts->sec);
+		hdr.ts_usec = be64toh(ts->usec);
+	} else {
+		hdr.ts_sec = b->now.tv_sec;
+		hdr.ts_usec = b->now.tv_nsec / 1000;
+	}
+	hdr.incl_len = hdr.orig_len = mnl_nlmsg_get_payload_len(nlh);
+
+	if (log_ring_push(&b->w->ring, &hdr, mnl_nlmsg_get_payload(nlh),
+			  hdr.incl_len))
+		atomic_fetch_add_explicit(&b->w->packets, 1,
+					  memory_order_relaxed);
+
+	return MNL_CB_OK;
+}
+
 static struct nlmsghdr *
 nflog_build_cfg_pf_request(char *buf, uint8_t command)
 {
@@ -140,19 +386,105 @@ nflog_build_cfg_params(char *buf, uint8_t mode, int range, int qnum)
 	return nlh;
 }
 
+/*
+ * The kernel batches up to qthresh packets in one multipart message of up
+ * to nlbufsiz bytes, which is flushed after timeout (in 1/100 s) anyway.
+ */
+static struct nlmsghdr *
+nflog_build_cfg_batching(char *buf, uint32_t qthresh, uint32_t timeout,
+			 uint32_t nlbufsiz, int qnum)
+{
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= (NFNL_SUBSYS_ULOG << 8) | NFULNL_MSG_CONFIG;
+	nlh->nlmsg_flags = NLM_F_REQUEST;
+
+	struct nfgenmsg *nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(*nfg));
+	nfg->nfgen_family = AF_UNSPEC;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(qnum);
+
+	mnl_attr_put_u32(nlh, NFULA_CFG_QTHRESH, htonl(qthresh));
+	mnl_attr_put_u32(nlh, NFULA_CFG_TIMEOUT, htonl(timeout));
+	mnl_attr_put_u32(nlh, NFULA_CFG_NLBUFSIZ, htonl(nlbufsiz));
+
+	return nlh;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] queue_num\n"
+		"  -w, --write FILE\twrite the packets to a pcap file\n"
+		"  -q, --qthresh N\tpackets per batch (default 1)\n"
+		"  -t, --timeout N\tbatch timeout in 1/100 s (default 100)\n"
+		"  -n, --nlbufsiz BYTES\tbatch size (default 4096)\n"
+		"  -r, --ring MBYTES\tring buffer size, power of two "
+		"(default 64)\n"
+		"  -b, --rcvbuf BYTES\treceive buffer size\n", prog);
+	exit(EXIT_FAILURE);
+}
+
 int main(int argc, char *argv[])
 {
+	static const struct option options[] = {
+		{ "write",	required_argument,	NULL, 'w' },
+		{ "qthresh",	required_argument,	NULL, 'q' },
+		{ "timeout",	required_argument,	NULL, 't' },
+		{ "nlbufsiz",	required_argument,	NULL, 'n' },
+		{ "ring",	required_argument,	NULL, 'r' },
+		{ "rcvbuf",	required_argument,	NULL, 'b' },
+		{ }
+	};
 	struct mnl_socket *nl;
-	char buf[MNL_SOCKET_BUFFER_SIZE];
+	char *buf;
 	struct nlmsghdr *nlh;
-	int ret;
+	struct log_writer w = {};
+	struct collect_batch batch = { .w = &w };
+	const char *path = NULL;
+	uint32_t qthresh = 1, timeout = 100, nlbufsiz = 4096;
+	size_t buf_size, ring_size = 64;
+	int ret, opt, rcvbuf = 0;
 	unsigned int portid, qnum;
 
-	if (argc != 2) {
-		printf("Usage: %s [queue_num]\n", argv[0]);
+	while ((opt = getopt_long(argc, argv, "w:q:t:n:r:b:", options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'w':
+			path = optarg;
+			break;
+		case 'q':
+			qthresh = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			timeout = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nlbufsiz = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			ring_size = strtoul(optarg, NULL, 0);
+			if (ring_size == 0 || (ring_size & (ring_size - 1)))
+				usage(argv[0]);
+			break;
+		case 'b':
+			rcvbuf = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	qnum = atoi(argv[optind]);
+
+	/* one batch, or one single packet if it is larger than a batch. */
+	buf_size = nlbufsiz > 0xffff ? nlbufsiz : 0xffff;
+	buf_size += MNL_SOCKET_BUFFER_SIZE;
+	buf = malloc(buf_size);
+	if (buf == NULL) {
+		perror("malloc");
 		exit(EXIT_FAILURE);
 	}
-	qnum = atoi(argv[1]);
 
 	nl = mnl_socket_open(NETLINK_NETFILTER);
 	if (nl == NULL) {
@@ -166,6 +498,15 @@ int main(int argc, char *argv[])
 	}
 	portid = mnl_socket_get_portid(nl);
 
+	if (rcvbuf &&
+	    setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUFFORCE,
+		       &rcvbuf, sizeof(int)) < 0 &&
+	    setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUF,
+		       &rcvbuf, sizeof(int)) < 0) {
+		perror("setsockopt");
+		exit(EXIT_FAILURE);
+	}
+
 	nlh = nflog_build_cfg_pf_request(buf, NFULNL_CFG_CMD_PF_UNBIND);
 
 	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
@@ -194,26 +535,52 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		perror("mnl_socket_recvfrom");
+	nlh = nflog_build_cfg_batching(buf, qthresh, timeout, nlbufsiz, qnum);
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+		perror("mnl_socket_sendto");
+		exit(EXIT_FAILURE);
+	}
+
+	if (path && log_writer_start(&w, path, ring_size << 20) < 0) {
+		perror("log_writer_start");
 		exit(EXIT_FAILURE);
 	}
-	while (ret > 0) {
-		ret = mnl_cb_run(buf, ret, 0, portid, log_cb, NULL);
-		if (ret < 0){
-			perror("mnl_cb_run");
-			exit(EXIT_FAILURE);
-		}
 
-		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	ret = mnl_socket_recvfrom(nl, buf, buf_size);
+	while (ret != 0) {
 		if (ret == -1) {
+			/* the collector keeps going, the losses are
+			 * reported in the statistics. */
+			if (errno == ENOBUFS && path) {
+				atomic_fetch_add_explicit(&w.enobufs, 1,
+							  memory_order_relaxed);
+				ret = mnl_socket_recvfrom(nl, buf, buf_size);
+				continue;
+			}
 			perror("mnl_socket_recvfrom");
 			exit(EXIT_FAILURE);
 		}
+
+		/* batches are multipart messages that end with NLMSG_DONE,
+		 * so the runqueue may stop early, which is fine here. */
+		if (path) {
+			clock_gettime(CLOCK_REALTIME, &batch.now);
+			ret = mnl_cb_run(buf, ret, 0, portid, collect_cb,
+					 &batch);
+		} else {
+			ret = mnl_cb_run(buf, ret, 0, portid, log_cb, NULL);
+		}
+		if (ret < 0){
+			perror("mnl_cb_run");
+			exit(EXIT_FAILURE);
+		}
+
+		ret = mnl_socket_recvfrom(nl, buf, buf_size);
 	}
 
 	mnl_socket_close(nl);
+	free(buf);
 
 	return 0;
 }
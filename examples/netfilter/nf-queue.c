@@ -1,10 +1,20 @@
 /* This example is placed in the public domain. */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <poll.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <libmnl/libmnl.h>
 #include <linux/netfilter.h>
@@ -26,6 +36,7 @@ static int parse_attr_cb(const struct nlattr *attr, void *data)
 	case NFQA_IFINDEX_OUTDEV:
 	case NFQA_IFINDEX_PHYSINDEV:
 	case NFQA_IFINDEX_PHYSOUTDEV:
+	case NFQA_CAP_LEN:
 		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
 			perror("mnl_attr_validate");
 			return MNL_CB_ERROR;
@@ -38,6 +49,13 @@ static int parse_attr_cb(const struct nlattr *attr, void *data)
 			return MNL_CB_ERROR;
 		}
 		break;
+	case NFQA_PACKET_HDR:
+		if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC,
+		    sizeof(struct nfqnl_msg_packet_hdr)) < 0) {
+			perror("mnl_attr_validate2");
+			return MNL_CB_ERROR;
+		}
+		break;
 	case NFQA_HWADDR:
 		if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC,
 		    sizeof(struct nfqnl_msg_packet_hw)) < 0) {
@@ -52,24 +70,6 @@ static int parse_attr_cb(const struct nlattr *attr, void *data)
 	return MNL_CB_OK;
 }
 
-static int queue_cb(const struct nlmsghdr *nlh, void *data)
-{
-	struct nlattr *tb[NFQA_MAX+1] = {};
-	struct nfqnl_msg_packet_hdr *ph = NULL;
-	uint32_t id = 0;
-
-	mnl_attr_parse(nlh, sizeof(struct nfgenmsg), parse_attr_cb, tb);
-	if (tb[NFQA_PACKET_HDR]) {
-		ph = mnl_attr_get_payload(tb[NFQA_PACKET_HDR]);
-		id = ntohl(ph->packet_id);
-
-		printf("packet received (id=%u hw=0x%04x hook=%u)\n",
-		       id, ntohs(ph->hw_protocol), ph->hook);
-	}
-
-	return MNL_CB_OK + id;
-}
-
 static struct nlmsghdr *
 nfq_build_cfg_pf_request(char *buf, uint8_t command)
 {
@@ -133,41 +133,616 @@ nfq_build_cfg_params(char *buf, uint8_t mode, int range, int queue_num)
 }
 
 static struct nlmsghdr *
-nfq_build_verdict(char *buf, int id, int queue_num, int verd)
+nfq_build_cfg_flags(char *buf, uint32_t flags, int queue_num)
+{
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_CONFIG;
+	nlh->nlmsg_flags = NLM_F_REQUEST;
+
+	struct nfgenmsg *nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(*nfg));
+	nfg->nfgen_family = AF_UNSPEC;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(queue_num);
+
+	/* only the flags in the mask are changed. */
+	mnl_attr_put_u32(nlh, NFQA_CFG_MASK, htonl(flags));
+	mnl_attr_put_u32(nlh, NFQA_CFG_FLAGS, htonl(flags));
+
+	return nlh;
+}
+
+/* index of the variable fields in the verdict templates. */
+enum {
+	VERDICT_FIELD_ID,
+	VERDICT_FIELD_VERDICT,
+	VERDICT_FIELD_MAX
+};
+
+static struct mnl_nlmsg_tmpl *nfq_build_verdict_tmpl(int type, int queue_num)
 {
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct mnl_nlmsg_tmpl *t;
 	struct nlmsghdr *nlh;
 	struct nfgenmsg *nfg;
+	struct nlattr *attr;
+	char *vh_payload;
 
 	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_VERDICT;
+	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | type;
 	nlh->nlmsg_flags = NLM_F_REQUEST;
 	nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(*nfg));
 	nfg->nfgen_family = AF_UNSPEC;
 	nfg->version = NFNETLINK_V0;
 	nfg->res_id = htons(queue_num);
 
+	struct nfqnl_msg_verdict_hdr vh = {};
+	attr = mnl_nlmsg_get_payload_tail(nlh);
+	mnl_attr_put(nlh, NFQA_VERDICT_HDR, sizeof(vh), &vh);
+
+	t = mnl_nlmsg_tmpl_start(nlh, VERDICT_FIELD_MAX);
+	if (t == NULL)
+		return NULL;
+
+	/* the fields are registered in the order of the enum above. */
+	vh_payload = mnl_attr_get_payload(attr);
+	mnl_nlmsg_tmpl_add_field(t, nlh, vh_payload +
+				 offsetof(struct nfqnl_msg_verdict_hdr, id),
+				 sizeof(vh.id));
+	mnl_nlmsg_tmpl_add_field(t, nlh, vh_payload +
+				 offsetof(struct nfqnl_msg_verdict_hdr, verdict),
+				 sizeof(vh.verdict));
+	return t;
+}
+
+/*
+ * Verdict batching: the kernel applies NFQNL_MSG_VERDICT_BATCH to all the
+ * packets in the queue whose id is lower or equal than the one in the
+ * message. Thus, we accumulate runs of packets, in the order they are
+ * received, that get the same verdict and we send one single message per
+ * run, a plain NFQNL_MSG_VERDICT if the run has only one packet. Packets
+ * that could not be delivered, eg. because of ENOBUFS, are not queued by
+ * the kernel, so the gaps in the ids do not need any verdict. Messages are
+ * placed in a mnl_nlmsg_batch that is sent once VERDICT_BATCH_MAX verdicts
+ * are pending or VERDICT_BATCH_TIMEOUT_MS milliseconds after the first one.
+ */
+#define VERDICT_BATCH_MAX		64
+#define VERDICT_BATCH_TIMEOUT_MS	10
+
+struct nfq_verdict_batch {
+	struct mnl_socket	*nl;
+	struct mnl_nlmsg_batch	*b;
+	/* templates for NFQNL_MSG_VERDICT and NFQNL_MSG_VERDICT_BATCH. */
+	struct mnl_nlmsg_tmpl	*single;
+	struct mnl_nlmsg_tmpl	*range;
+	/* current run of ids with the same verdict. */
+	bool			run;
+	uint32_t		first_id;
+	uint32_t		last_id;
+	uint32_t		verdict;
+	/* verdicts that have not been sent yet. */
+	unsigned int		pending;
+	struct timespec		deadline;
+	char			*buf;
+};
+
+static int nfq_verdict_batch_init(struct nfq_verdict_batch *vb,
+				  struct mnl_socket *nl, int queue_num)
+{
+	memset(vb, 0, sizeof(*vb));
+	vb->nl = nl;
+
+	vb->single = nfq_build_verdict_tmpl(NFQNL_MSG_VERDICT, queue_num);
+	if (vb->single == NULL)
+		return -1;
+	vb->range = nfq_build_verdict_tmpl(NFQNL_MSG_VERDICT_BATCH, queue_num);
+	if (vb->range == NULL)
+		return -1;
+
+	/* As in nfct-create-batch, the batch is limited to half of the
+	 * buffer since the last message may go over the upper boundary. */
+	vb->buf = malloc(MNL_SOCKET_BUFFER_SIZE * 2);
+	if (vb->buf == NULL)
+		return -1;
+	vb->b = mnl_nlmsg_batch_start(vb->buf, MNL_SOCKET_BUFFER_SIZE);
+	if (vb->b == NULL)
+		return -1;
+
+	return 0;
+}
+
+static void nfq_verdict_batch_fini(struct nfq_verdict_batch *vb)
+{
+	mnl_nlmsg_batch_stop(vb->b);
+	mnl_nlmsg_tmpl_stop(vb->range);
+	mnl_nlmsg_tmpl_stop(vb->single);
+	free(vb->buf);
+}
+
+static int nfq_verdict_batch_send(struct nfq_verdict_batch *vb)
+{
+	int ret;
+
+	ret = mnl_socket_sendto(vb->nl, mnl_nlmsg_batch_head(vb->b),
+				mnl_nlmsg_batch_size(vb->b));
+	mnl_nlmsg_batch_reset(vb->b);
+	return ret < 0 ? -1 : 0;
+}
+
+/* close the current run, place its message in the batch. */
+static int nfq_verdict_batch_close_run(struct nfq_verdict_batch *vb)
+{
+	struct mnl_nlmsg_tmpl *t;
+	struct nlmsghdr *nlh;
+	uint32_t id, verdict;
+
+	if (!vb->run)
+		return 0;
+
+	vb->run = false;
+	t = vb->first_id == vb->last_id ? vb->single : vb->range;
+	id = htonl(vb->last_id);
+	verdict = htonl(vb->verdict);
+
+	nlh = mnl_nlmsg_tmpl_put(t, mnl_nlmsg_batch_current(vb->b));
+	mnl_nlmsg_tmpl_set_field(t, nlh, VERDICT_FIELD_ID, &id);
+	mnl_nlmsg_tmpl_set_field(t, nlh, VERDICT_FIELD_VERDICT, &verdict);
+
+	/* no room for this message, send the others first. */
+	if (!mnl_nlmsg_batch_next(vb->b))
+		return nfq_verdict_batch_send(vb);
+
+	return 0;
+}
+
+static int nfq_verdict_batch_flush(struct nfq_verdict_batch *vb)
+{
+	if (nfq_verdict_batch_close_run(vb) < 0)
+		return -1;
+
+	vb->pending = 0;
+	if (mnl_nlmsg_batch_is_empty(vb->b))
+		return 0;
+
+	return nfq_verdict_batch_send(vb);
+}
+
+static int nfq_verdict_batch_add(struct nfq_verdict_batch *vb, uint32_t id,
+				 uint32_t verdict)
+{
+	if (vb->run && verdict != vb->verdict) {
+		if (nfq_verdict_batch_close_run(vb) < 0)
+			return -1;
+	}
+	if (!vb->run) {
+		vb->run = true;
+		vb->first_id = id;
+		vb->verdict = verdict;
+	}
+	vb->last_id = id;
+
+	if (vb->pending++ == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &vb->deadline);
+		vb->deadline.tv_nsec += VERDICT_BATCH_TIMEOUT_MS * 1000000;
+		if (vb->deadline.tv_nsec >= 1000000000) {
+			vb->deadline.tv_sec++;
+			vb->deadline.tv_nsec -= 1000000000;
+		}
+	}
+	if (vb->pending >= VERDICT_BATCH_MAX)
+		return nfq_verdict_batch_flush(vb);
+
+	return 0;
+}
+
+/* milliseconds until the pending verdicts have to be sent, -1 if none. */
+static int nfq_verdict_batch_timeout(const struct nfq_verdict_batch *vb)
+{
+	struct timespec now;
+	long ms;
+
+	if (vb->pending == 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (vb->deadline.tv_sec - now.tv_sec) * 1000 +
+	     (vb->deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+	return ms > 0 ? ms : 0;
+}
+
+/*
+ * One worker per queue: each one has its own socket and verdict batch, so
+ * workers share nothing. The worker that handles the i-th queue of the
+ * range is pinned to the i-th online CPU, which matches the queue selection
+ * of the NFQUEUE target with --queue-balance and --queue-cpu-fanout: the
+ * packets are handled by the CPU that queued them.
+ */
+struct nfq_worker {
+	pthread_t		thread;
+	unsigned int		queue_num;
+	int			cpu;
+	uint32_t		flags;
+	/* bytes of each packet that are copied to user-space. */
+	uint32_t		copy_range;
+	/* DSCP to set in IPv4 packets, -1 to leave packets untouched. */
+	int			dscp;
+	struct mnl_socket	*nl;
+	unsigned int		portid;
+	struct nfq_verdict_batch vb;
+	/* slice of the buffer pool, see nfq_buf_pool_alloc(). */
+	char			*buf;
+	size_t			buf_size;
+};
+
+/*
+ * View of a queued packet: the payload points to the receive buffer, so
+ * it is valid until the next packet is received. If the copy range is
+ * smaller than the packet, len is lower than orig_len.
+ */
+struct nfq_packet {
+	uint32_t		id;
+	uint16_t		hw_protocol;
+	uint8_t			hook;
+	uint8_t			*payload;
+	uint32_t		len;
+	uint32_t		orig_len;
+};
+
+/*
+ * Send a verdict with a modified packet. The message is sent with an iovec
+ * that points to the payload in the receive buffer, so that the packet is
+ * not copied to build the message. Since the kernel replaces the packet
+ * with this payload, it must be complete and it must fit in the 16-bit
+ * length of NFQA_PAYLOAD.
+ */
+#define NFQ_MANGLE_MAX	(UINT16_MAX - MNL_ATTR_HDRLEN)
+
+static int nfq_verdict_mangle(struct nfq_worker *w, const struct nfq_packet *pkt,
+			      uint32_t verdict)
+{
+	static const char pad[MNL_ALIGNTO];
+	char buf[MNL_NLMSG_HDRLEN + MNL_ALIGN(sizeof(struct nfgenmsg)) +
+		 MNL_ATTR_HDRLEN + MNL_ALIGN(sizeof(struct nfqnl_msg_verdict_hdr)) +
+		 MNL_ATTR_HDRLEN];
+	struct sockaddr_nl snl = {
+		.nl_family = AF_NETLINK,
+	};
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfg;
+	struct nlattr *attr;
+	struct iovec iov[3];
+	struct msghdr msg = {
+		.msg_name	= &snl,
+		.msg_namelen	= sizeof(snl),
+		.msg_iov	= iov,
+		.msg_iovlen	= 3,
+	};
+
+	if (pkt->len != pkt->orig_len) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (pkt->len > NFQ_MANGLE_MAX) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_VERDICT;
+	nlh->nlmsg_flags = NLM_F_REQUEST;
+	nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(*nfg));
+	nfg->nfgen_family = AF_UNSPEC;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(w->queue_num);
+
 	struct nfqnl_msg_verdict_hdr vh = {
-		.verdict = htonl(verd),
-		.id = htonl(id),
+		.verdict = htonl(verdict),
+		.id = htonl(pkt->id),
 	};
 	mnl_attr_put(nlh, NFQA_VERDICT_HDR, sizeof(vh), &vh);
 
-	return nlh;
+	/* the attribute header goes here, its payload goes in the iovec. */
+	attr = mnl_nlmsg_get_payload_tail(nlh);
+	attr->nla_type = NFQA_PAYLOAD;
+	attr->nla_len = MNL_ATTR_HDRLEN + pkt->len;
+	nlh->nlmsg_len += MNL_ATTR_HDRLEN + MNL_ALIGN(pkt->len);
+
+	iov[0].iov_base = buf;
+	iov[0].iov_len = sizeof(buf);
+	iov[1].iov_base = pkt->payload;
+	iov[1].iov_len = pkt->len;
+	iov[2].iov_base = (void *)pad;
+	iov[2].iov_len = MNL_ALIGN(pkt->len) - pkt->len;
+
+	return sendmsg(mnl_socket_get_fd(w->nl), &msg, 0) < 0 ? -1 : 0;
 }
 
-int main(int argc, char *argv[])
+/* RFC 1624 incremental update of a checksum after a 16-bit field change. */
+static void csum_replace2(uint16_t *sum, uint16_t old, uint16_t new)
+{
+	uint32_t csum = (uint16_t)~ntohs(*sum) + (uint16_t)~old + new;
+
+	csum = (csum & 0xffff) + (csum >> 16);
+	csum = (csum & 0xffff) + (csum >> 16);
+	*sum = htons(~csum);
+}
+
+/* set the DSCP of an IPv4 packet, returns true if the packet changed. */
+static bool nfq_set_dscp(struct nfq_packet *pkt, int dscp)
+{
+	uint8_t *iph = pkt->payload;
+	uint16_t old, new, sum;
+
+	if (pkt->len < 20 || (iph[0] >> 4) != 4 || (iph[1] >> 2) == dscp)
+		return false;
+
+	/* version, ihl and tos are the first 16-bit word of the checksum. */
+	old = (iph[0] << 8) | iph[1];
+	iph[1] = (dscp << 2) | (iph[1] & 0x3);
+	new = (iph[0] << 8) | iph[1];
+
+	memcpy(&sum, &iph[10], sizeof(sum));
+	csum_replace2(&sum, old, new);
+	memcpy(&iph[10], &sum, sizeof(sum));
+
+	return true;
+}
+
+static int nfq_handle_packet(struct nfq_worker *w, struct nfq_packet *pkt)
+{
+	printf("queue %u: packet received (id=%u hw=0x%04x hook=%u "
+	       "len=%u/%u)\n", w->queue_num, pkt->id, pkt->hw_protocol,
+	       pkt->hook, pkt->len, pkt->orig_len);
+
+	/* only complete packets can be modified, otherwise the kernel
+	 * would truncate them, the largest GSO ones are left as is. */
+	if (w->dscp >= 0 && pkt->len == pkt->orig_len &&
+	    pkt->len <= NFQ_MANGLE_MAX && nfq_set_dscp(pkt, w->dscp))
+		return nfq_verdict_mangle(w, pkt, NF_ACCEPT);
+
+	return nfq_verdict_batch_add(&w->vb, pkt->id, NF_ACCEPT);
+}
+
+static int queue_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct nfq_worker *w = data;
+	struct nlattr *tb[NFQA_MAX+1] = {};
+	struct nfqnl_msg_packet_hdr *ph;
+	struct nfq_packet pkt = {};
+
+	if (mnl_attr_parse(nlh, sizeof(struct nfgenmsg),
+			   parse_attr_cb, tb) < 0)
+		return MNL_CB_ERROR;
+
+	if (!tb[NFQA_PACKET_HDR])
+		return MNL_CB_OK;
+
+	ph = mnl_attr_get_payload(tb[NFQA_PACKET_HDR]);
+	pkt.id = ntohl(ph->packet_id);
+	pkt.hw_protocol = ntohs(ph->hw_protocol);
+	pkt.hook = ph->hook;
+
+	/* the packet is accessed where it was received, no copy. */
+	if (tb[NFQA_PAYLOAD]) {
+		pkt.payload = mnl_attr_get_payload(tb[NFQA_PAYLOAD]);
+		pkt.len = mnl_attr_get_payload_len(tb[NFQA_PAYLOAD]);
+	}
+	/* this attribute is only present if the packet was truncated. */
+	if (tb[NFQA_CAP_LEN])
+		pkt.orig_len = ntohl(mnl_attr_get_u32(tb[NFQA_CAP_LEN]));
+	else
+		pkt.orig_len = pkt.len;
+
+	if (nfq_handle_packet(w, &pkt) < 0) {
+		perror("mnl_socket_sendto");
+		return MNL_CB_ERROR;
+	}
+
+	return MNL_CB_OK;
+}
+
+/*
+ * The receive buffers of all the workers are carved from one single pool,
+ * each one is sized after the copy range of its queue: the largest packet
+ * plus room for the metadata attributes. Buffers start at a page boundary.
+ */
+static char *nfq_buf_pool_alloc(struct nfq_worker *workers,
+				unsigned int num_workers)
+{
+	size_t page = sysconf(_SC_PAGESIZE), total = 0;
+	unsigned int i;
+	char *pool;
+
+	for (i = 0; i < num_workers; i++) {
+		struct nfq_worker *w = &workers[i];
+
+		w->buf_size = w->copy_range + MNL_SOCKET_BUFFER_SIZE;
+		w->buf_size = (w->buf_size + page - 1) / page * page;
+		total += w->buf_size;
+	}
+
+	if (posix_memalign((void **)&pool, page, total) != 0)
+		return NULL;
+
+	for (i = 0; i < num_workers; i++) {
+		workers[i].buf = pool;
+		pool += workers[i].buf_size;
+	}
+
+	return workers[0].buf;
+}
+
+static int nfq_send(struct mnl_socket *nl, const struct nlmsghdr *nlh)
+{
+	return mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0 ? -1 : 0;
+}
+
+static int nfq_worker_setup(struct nfq_worker *w)
 {
-	struct mnl_socket *nl;
-	char buf[MNL_SOCKET_BUFFER_SIZE];
 	struct nlmsghdr *nlh;
+
+	w->nl = mnl_socket_open(NETLINK_NETFILTER);
+	if (w->nl == NULL)
+		return -1;
+
+	if (mnl_socket_bind(w->nl, 0, MNL_SOCKET_AUTOPID) < 0)
+		return -1;
+
+	w->portid = mnl_socket_get_portid(w->nl);
+
+	nlh = nfq_build_cfg_request(w->buf, NFQNL_CFG_CMD_BIND, w->queue_num);
+	if (nfq_send(w->nl, nlh) < 0)
+		return -1;
+
+	nlh = nfq_build_cfg_params(w->buf, NFQNL_COPY_PACKET, w->copy_range,
+				   w->queue_num);
+	if (nfq_send(w->nl, nlh) < 0)
+		return -1;
+
+	if (w->flags) {
+		nlh = nfq_build_cfg_flags(w->buf, w->flags, w->queue_num);
+		if (nfq_send(w->nl, nlh) < 0)
+			return -1;
+	}
+
+	return nfq_verdict_batch_init(&w->vb, w->nl, w->queue_num);
+}
+
+static void *nfq_worker_run(void *data)
+{
+	struct nfq_worker *w = data;
+	struct pollfd pfd;
 	int ret;
-	unsigned int portid, queue_num;
 
-	if (argc != 2) {
-		printf("Usage: %s [queue_num]\n", argv[0]);
+	if (nfq_worker_setup(w) < 0) {
+		fprintf(stderr, "queue %u: %s\n", w->queue_num, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	pfd.fd = mnl_socket_get_fd(w->nl);
+	pfd.events = POLLIN;
+
+	for (;;) {
+		ret = poll(&pfd, 1, nfq_verdict_batch_timeout(&w->vb));
+		if (ret == -1) {
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+		if (ret > 0) {
+			ret = mnl_socket_recvfrom(w->nl, w->buf, w->buf_size);
+			if (ret == -1) {
+				perror("mnl_socket_recvfrom");
+				exit(EXIT_FAILURE);
+			}
+
+			ret = mnl_cb_run(w->buf, ret, 0, w->portid,
+					 queue_cb, w);
+			if (ret < 0){
+				perror("mnl_cb_run");
+				exit(EXIT_FAILURE);
+			}
+		}
+		/* the deadline also expires under steady traffic, when poll()
+		 * does not time out: send the verdicts that are pending. */
+		if (nfq_verdict_batch_timeout(&w->vb) == 0 &&
+		    nfq_verdict_batch_flush(&w->vb) < 0) {
+			perror("mnl_socket_sendto");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	nfq_verdict_batch_fini(&w->vb);
+	mnl_socket_close(w->nl);
+
+	return NULL;
+}
+
+#define MAX_COPY_RANGES	64
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options] [queue_num]\n"
+	       "  -b, --queue-balance FIRST:LAST  one worker per queue\n"
+	       "  -g, --gso                       receive GSO packets\n"
+	       "  -f, --fail-open                 accept packets if the "
+	       "queue is full\n"
+	       "  -r, --copy-range [QUEUE=]BYTES  bytes of the packets to "
+	       "copy, for all queues\n"
+	       "                                  or for one queue\n"
+	       "  -d, --dscp DSCP                 set the DSCP of IPv4 "
+	       "packets\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{ "queue-balance",	required_argument,	NULL, 'b' },
+		{ "gso",		no_argument,		NULL, 'g' },
+		{ "fail-open",		no_argument,		NULL, 'f' },
+		{ "copy-range",		required_argument,	NULL, 'r' },
+		{ "dscp",		required_argument,	NULL, 'd' },
+		{ NULL },
+	};
+	struct {
+		unsigned int	queue_num;
+		uint32_t	copy_range;
+	} ranges[MAX_COPY_RANGES];
+	unsigned int num_ranges = 0, j;
+	uint32_t copy_range = 0xFFFF;
+	int dscp = -1;
+	unsigned int first = 0, last = 0, num_workers, i;
+	struct mnl_socket *nl;
+	struct nfq_worker *workers;
+	struct nlmsghdr *nlh;
+	uint32_t flags = 0;
+	cpu_set_t online;
+	int opt, cpu;
+	char *buf, *pool;
+
+	while ((opt = getopt_long(argc, argv, "b:gfr:d:", opts, NULL)) != -1) {
+		switch (opt) {
+		case 'b':
+			if (sscanf(optarg, "%u:%u", &first, &last) != 2 ||
+			    first > last || last > 0xFFFF)
+				usage(argv[0]);
+			break;
+		case 'g':
+			flags |= NFQA_CFG_F_GSO;
+			break;
+		case 'f':
+			flags |= NFQA_CFG_F_FAIL_OPEN;
+			break;
+		case 'r':
+			if (strchr(optarg, '=') == NULL) {
+				copy_range = strtoul(optarg, NULL, 0);
+				break;
+			}
+			if (num_ranges == MAX_COPY_RANGES ||
+			    sscanf(optarg, "%u=%u", &ranges[num_ranges].queue_num,
+				   &ranges[num_ranges].copy_range) != 2)
+				usage(argv[0]);
+			num_ranges++;
+			break;
+		case 'd':
+			dscp = atoi(optarg);
+			if (dscp < 0 || dscp > 63)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind == argc - 1)
+		first = last = atoi(argv[optind]);
+	else if (optind != argc)
+		usage(argv[0]);
+
+	buf = malloc(MNL_SOCKET_BUFFER_SIZE);
+	if (buf == NULL) {
+		perror("malloc");
 		exit(EXIT_FAILURE);
 	}
-	queue_num = atoi(argv[1]);
 
 	nl = mnl_socket_open(NETLINK_NETFILTER);
 	if (nl == NULL) {
@@ -179,65 +754,88 @@ int main(int argc, char *argv[])
 		perror("mnl_socket_bind");
 		exit(EXIT_FAILURE);
 	}
-	portid = mnl_socket_get_portid(nl);
 
+	/* these commands are per family, not per queue, send them once. */
 	nlh = nfq_build_cfg_pf_request(buf, NFQNL_CFG_CMD_PF_UNBIND);
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+	if (nfq_send(nl, nlh) < 0) {
 		perror("mnl_socket_sendto");
 		exit(EXIT_FAILURE);
 	}
 
 	nlh = nfq_build_cfg_pf_request(buf, NFQNL_CFG_CMD_PF_BIND);
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+	if (nfq_send(nl, nlh) < 0) {
 		perror("mnl_socket_sendto");
 		exit(EXIT_FAILURE);
 	}
 
-	nlh = nfq_build_cfg_request(buf, NFQNL_CFG_CMD_BIND, queue_num);
+	mnl_socket_close(nl);
+	free(buf);
 
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_sendto");
+	if (sched_getaffinity(0, sizeof(online), &online) < 0) {
+		perror("sched_getaffinity");
 		exit(EXIT_FAILURE);
 	}
 
-	nlh = nfq_build_cfg_params(buf, NFQNL_COPY_PACKET, 0xFFFF, queue_num);
-
-	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-		perror("mnl_socket_sendto");
+	num_workers = last - first + 1;
+	workers = calloc(num_workers, sizeof(struct nfq_worker));
+	if (workers == NULL) {
+		perror("calloc");
 		exit(EXIT_FAILURE);
 	}
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		perror("mnl_socket_recvfrom");
+	for (i = 0, cpu = -1; i < num_workers; i++) {
+		struct nfq_worker *w = &workers[i];
+
+		w->queue_num = first + i;
+		w->flags = flags;
+		w->dscp = dscp;
+		w->copy_range = copy_range;
+		for (j = 0; j < num_ranges; j++) {
+			if (ranges[j].queue_num == w->queue_num)
+				w->copy_range = ranges[j].copy_range;
+		}
+		/* larger copy ranges are capped by the kernel. */
+		if (w->copy_range == 0 || w->copy_range > 0xFFFF)
+			w->copy_range = 0xFFFF;
+
+		/* next CPU that we are allowed to run on, wrap around. */
+		do {
+			cpu = (cpu + 1) % CPU_SETSIZE;
+		} while (!CPU_ISSET(cpu, &online));
+		w->cpu = cpu;
+	}
+
+	pool = nfq_buf_pool_alloc(workers, num_workers);
+	if (pool == NULL) {
+		perror("posix_memalign");
 		exit(EXIT_FAILURE);
 	}
-	while (ret > 0) {
-		uint32_t id;
 
-		ret = mnl_cb_run(buf, ret, 0, portid, queue_cb, NULL);
-		if (ret < 0){
-			perror("mnl_cb_run");
-			exit(EXIT_FAILURE);
-		}
+	for (i = 0; i < num_workers; i++) {
+		struct nfq_worker *w = &workers[i];
+		pthread_attr_t attr;
+		cpu_set_t set;
 
-		id = ret - MNL_CB_OK;
-		nlh = nfq_build_verdict(buf, id, queue_num, NF_ACCEPT);
-		if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-			perror("mnl_socket_sendto");
-			exit(EXIT_FAILURE);
-		}
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
 
-		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-		if (ret == -1) {
-			perror("mnl_socket_recvfrom");
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+		errno = pthread_create(&w->thread, &attr, nfq_worker_run, w);
+		pthread_attr_destroy(&attr);
+		if (errno != 0) {
+			perror("pthread_create");
 			exit(EXIT_FAILURE);
 		}
 	}
 
-	mnl_socket_close(nl);
+	for (i = 0; i < num_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	free(pool);
+	free(workers);
 
 	return 0;
 }
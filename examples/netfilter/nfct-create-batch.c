@@ -4,7 +4,6 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <time.h>
-#include <sys/select.h>
 #include <string.h>
 
 #include <libmnl/libmnl.h>
@@ -13,11 +12,21 @@
 #include <linux/netfilter/nf_conntrack_common.h>
 #include <linux/netfilter/nf_conntrack_tcp.h>
 
-static void put_msg(char *buf, uint16_t i, int seq)
+/* index of the variable fields in the template, see build_tmpl(). */
+enum {
+	FIELD_ORIG_SRC_PORT,
+	FIELD_REPL_DST_PORT,
+	FIELD_MAX
+};
+
+/* build the message once, only the ports differ from one entry to another. */
+static struct mnl_nlmsg_tmpl *build_tmpl(int seq)
 {
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct mnl_nlmsg_tmpl *t;
 	struct nlmsghdr *nlh;
 	struct nfgenmsg *nfh;
-	struct nlattr *nest1, *nest2;
+	struct nlattr *nest1, *nest2, *sport, *dport;
 
 	nlh = mnl_nlmsg_put_header(buf);
 	nlh->nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_NEW;
@@ -37,7 +46,8 @@ static void put_msg(char *buf, uint16_t i, int seq)
 
 	nest2 = mnl_attr_nest_start(nlh, CTA_TUPLE_PROTO);
 	mnl_attr_put_u8(nlh, CTA_PROTO_NUM, IPPROTO_TCP);
-	mnl_attr_put_u16(nlh, CTA_PROTO_SRC_PORT, htons(i));
+	sport = mnl_nlmsg_get_payload_tail(nlh);
+	mnl_attr_put_u16(nlh, CTA_PROTO_SRC_PORT, 0);
 	mnl_attr_put_u16(nlh, CTA_PROTO_DST_PORT, htons(1025));
 	mnl_attr_nest_end(nlh, nest2);
 	mnl_attr_nest_end(nlh, nest1);
@@ -51,7 +61,8 @@ static void put_msg(char *buf, uint16_t i, int seq)
 	nest2 = mnl_attr_nest_start(nlh, CTA_TUPLE_PROTO);
 	mnl_attr_put_u8(nlh, CTA_PROTO_NUM, IPPROTO_TCP);
 	mnl_attr_put_u16(nlh, CTA_PROTO_SRC_PORT, htons(1025));
-	mnl_attr_put_u16(nlh, CTA_PROTO_DST_PORT, htons(i));
+	dport = mnl_nlmsg_get_payload_tail(nlh);
+	mnl_attr_put_u16(nlh, CTA_PROTO_DST_PORT, 0);
 	mnl_attr_nest_end(nlh, nest2);
 	mnl_attr_nest_end(nlh, nest1);
 
@@ -63,27 +74,85 @@ static void put_msg(char *buf, uint16_t i, int seq)
 
 	mnl_attr_put_u32(nlh, CTA_STATUS, htonl(IPS_CONFIRMED));
 	mnl_attr_put_u32(nlh, CTA_TIMEOUT, htonl(1000));
+
+	t = mnl_nlmsg_tmpl_start(nlh, FIELD_MAX);
+	if (t == NULL)
+		return NULL;
+
+	/* the fields are registered in the order of the enum above. */
+	mnl_nlmsg_tmpl_add_field(t, nlh, mnl_attr_get_payload(sport),
+				 sizeof(uint16_t));
+	mnl_nlmsg_tmpl_add_field(t, nlh, mnl_attr_get_payload(dport),
+				 sizeof(uint16_t));
+	return t;
+}
+
+static void put_msg(struct mnl_nlmsg_tmpl *t, char *buf, uint16_t i)
+{
+	struct nlmsghdr *nlh;
+	uint16_t port = htons(i);
+
+	nlh = mnl_nlmsg_tmpl_put(t, buf);
+	mnl_nlmsg_tmpl_set_field(t, nlh, FIELD_ORIG_SRC_PORT, &port);
+	mnl_nlmsg_tmpl_set_field(t, nlh, FIELD_REPL_DST_PORT, &port);
+}
+
+static int cb_extack_attr(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, NLMSGERR_ATTR_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case NLMSGERR_ATTR_MSG:
+		if (mnl_attr_validate(attr, MNL_TYPE_NUL_STRING) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
 }
 
 static int cb_err(const struct nlmsghdr *nlh, void *data)
 {
+	const struct nlattr *tb[NLMSGERR_ATTR_MAX+1] = {};
 	struct nlmsgerr *err = mnl_nlmsg_get_payload(nlh);
-	if (err->error != 0)
-		printf("message with seq %u has failed: %s\n",
-			nlh->nlmsg_seq, strerror(-err->error));
+	unsigned int offset = sizeof(struct nlmsgerr);
+
+	if (!(nlh->nlmsg_flags & NLM_F_ACK_TLVS))
+		return MNL_CB_OK;
+
+	/* the original message follows unless NETLINK_CAP_ACK is set. */
+	if (!(nlh->nlmsg_flags & NLM_F_CAPPED))
+		offset += err->msg.nlmsg_len - sizeof(struct nlmsghdr);
+
+	if (mnl_attr_parse(nlh, offset, cb_extack_attr, tb) < 0)
+		return MNL_CB_ERROR;
+
+	if (tb[NLMSGERR_ATTR_MSG])
+		printf("message with seq %u: %s\n", nlh->nlmsg_seq,
+		       mnl_attr_get_str(tb[NLMSGERR_ATTR_MSG]));
 	return MNL_CB_OK;
 }
 
-static mnl_cb_t cb_ctl_array[NLMSG_MIN_TYPE] = {
-	[NLMSG_ERROR] = cb_err,
-};
-
 static void
 send_batch(struct mnl_socket *nl, struct mnl_nlmsg_batch *b, int portid)
 {
-	int ret, fd = mnl_socket_get_fd(nl);
+	int ret, i;
 	size_t len = mnl_nlmsg_batch_size(b);
 	char rcv_buf[MNL_SOCKET_BUFFER_SIZE];
+	struct mnl_nlmsg_batch_ack *a;
+
+	/* record the sequence numbers of this batch before sending it. */
+	a = mnl_nlmsg_batch_ack_start(mnl_nlmsg_batch_head(b), len);
+	if (a == NULL) {
+		perror("mnl_nlmsg_batch_ack_start");
+		exit(EXIT_FAILURE);
+	}
 
 	ret = mnl_socket_sendto(nl, mnl_nlmsg_batch_head(b), len);
 	if (ret == -1) {
@@ -92,42 +161,29 @@ send_batch(struct mnl_socket *nl, struct mnl_nlmsg_batch *b, int portid)
 	}
 
 	/* receive and digest all the acknowledgments from the kernel. */
-	struct timeval tv = {
-		.tv_sec		= 0,
-		.tv_usec	= 0
-	};
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(fd, &readfds);
-
-	ret = select(fd+1, &readfds, NULL, NULL, &tv);
-	if (ret == -1) {
-		perror("select");
-		exit(EXIT_FAILURE);
-	}
-	while (ret > 0 && FD_ISSET(fd, &readfds)) {
+	do {
 		ret = mnl_socket_recvfrom(nl, rcv_buf, sizeof(rcv_buf));
 		if (ret == -1) {
 			perror("mnl_socket_recvfrom");
 			exit(EXIT_FAILURE);
 		}
 
-		ret = mnl_cb_run2(rcv_buf, ret, 0, portid,
-				  NULL, NULL, cb_ctl_array,
-				  MNL_ARRAY_SIZE(cb_ctl_array));
+		ret = mnl_nlmsg_batch_ack_run(a, rcv_buf, ret, portid,
+					      cb_err, NULL);
 		if (ret == -1) {
-			perror("mnl_cb_run2");
+			perror("mnl_nlmsg_batch_ack_run");
 			exit(EXIT_FAILURE);
 		}
+	} while (ret > MNL_CB_STOP);
 
-		ret = select(fd+1, &readfds, NULL, NULL, &tv);
-		if (ret == -1) {
-			perror("select");
-			exit(EXIT_FAILURE);
-		}
-		FD_ZERO(&readfds);
-		FD_SET(fd, &readfds);
+	/* these are the messages that you may want to send again. */
+	for (i = mnl_nlmsg_batch_ack_next_failed(a, 0); i >= 0;
+	     i = mnl_nlmsg_batch_ack_next_failed(a, i + 1)) {
+		printf("message with seq %u has failed: %s\n",
+		       mnl_nlmsg_batch_ack_get_seq(a, i),
+		       strerror(mnl_nlmsg_batch_ack_get_error(a, i)));
 	}
+	mnl_nlmsg_batch_ack_stop(a);
 }
 
 int main(void)
@@ -135,8 +191,9 @@ int main(void)
 	struct mnl_socket *nl;
 	char snd_buf[MNL_SOCKET_BUFFER_SIZE*2];
 	struct mnl_nlmsg_batch *b;
-	int j;
-	unsigned int seq, portid;
+	struct mnl_nlmsg_tmpl *t;
+	int ret;
+	unsigned int portid;
 	uint16_t i;
 
 	nl = mnl_socket_open(NETLINK_NETFILTER);
@@ -150,6 +207,11 @@ int main(void)
 	}
 	portid = mnl_socket_get_portid(nl);
 
+	/* ask for extended acknowledgments to get error messages, if the
+	 * kernel does not support this, we just don't get them. */
+	ret = 1;
+	mnl_socket_setsockopt(nl, NETLINK_EXT_ACK, &ret, sizeof(ret));
+
 	/* The buffer that we use to batch messages is MNL_SOCKET_BUFFER_SIZE
 	 * multiplied by 2 bytes long, but we limit the batch to half of it
 	 * since the last message that does not fit the batch goes over the
@@ -160,9 +222,15 @@ int main(void)
 		exit(EXIT_FAILURE);
 	}
 
-	seq = time(NULL);
-	for (i=1024, j=0; i<65535; i++, j++) {
-		put_msg(mnl_nlmsg_batch_current(b), i, seq+j);
+	/* the template assigns consecutive sequence numbers to messages. */
+	t = build_tmpl(time(NULL));
+	if (t == NULL) {
+		perror("mnl_nlmsg_tmpl_start");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i=1024; i<65535; i++) {
+		put_msg(t, mnl_nlmsg_batch_current(b), i);
 
 		/* is there room for more messages in this batch?
 		 * if so, continue. */
@@ -180,6 +248,7 @@ int main(void)
 	if (!mnl_nlmsg_batch_is_empty(b))
 		send_batch(nl, b, portid);
 
+	mnl_nlmsg_tmpl_stop(t);
 	mnl_nlmsg_batch_stop(b);
 	mnl_socket_close(nl);
 
@@ -1,10 +1,14 @@
 /* A very simple skeleton code that implements a daemon that collects
  * conntrack statistics from ctnetlink.
  *
+ * The destroy events are split across several threads after the source
+ * address, each one with its own shard of the statistics (see nstats.h),
+ * and the shards are merged when the statistics are reported.
+ *
  * This example is placed in the public domain.
  */
-#include <endian.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -13,248 +17,247 @@
 #include <netinet/in.h>
 #include <inttypes.h>
 #include <errno.h>
-#include <sys/select.h>
+#include <pthread.h>
 
 #include <libmnl/libmnl.h>
 #include <linux/netlink.h>
+#include <linux/filter.h>
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/nfnetlink_conntrack.h>
 
-#include <sys/queue.h>
-
-struct nstats {
-	LIST_ENTRY(nstats)	list;
-
-	uint8_t family;
-
-	union {
-		struct in_addr	ip;
-		struct in6_addr ip6;
-	};
-	uint64_t pkts, bytes;
-};
-
-static LIST_HEAD(nstats_head, nstats) nstats_head;
+#include "nstats.h"
 
-static int parse_counters_cb(const struct nlattr *attr, void *data)
+static int data_cb(const struct nlmsghdr *nlh, void *data)
 {
-	const struct nlattr **tb = data;
-	int type = mnl_attr_get_type(attr);
+	struct nstats_table *t = data;
+	struct nstats ns;
+
+	nstats_parse(nlh, &ns);
 
-	if (mnl_attr_type_valid(attr, CTA_COUNTERS_MAX) < 0)
+	/* no address, nothing to account. */
+	if (ns.family == 0)
 		return MNL_CB_OK;
 
-	switch(type) {
-	case CTA_COUNTERS_PACKETS:
-	case CTA_COUNTERS_BYTES:
-		if (mnl_attr_validate(attr, MNL_TYPE_U64) < 0) {
-			perror("mnl_attr_validate");
-			return MNL_CB_ERROR;
-		}
-		break;
+	/* Sum counters to the existing statistics object or add a new one */
+	if (nstats_table_add(t, &ns) < 0) {
+		perror("nstats_table_add");
+		return MNL_CB_ERROR;
 	}
-	tb[type] = attr;
-	return MNL_CB_OK;
-}
-
-static void parse_counters(const struct nlattr *nest, struct nstats *ns)
-{
-	struct nlattr *tb[CTA_COUNTERS_MAX+1] = {};
 
-	mnl_attr_parse_nested(nest, parse_counters_cb, tb);
-	if (tb[CTA_COUNTERS_PACKETS])
-		ns->pkts += be64toh(mnl_attr_get_u64(tb[CTA_COUNTERS_PACKETS]));
-
-	if (tb[CTA_COUNTERS_BYTES])
-		ns->bytes += be64toh(mnl_attr_get_u64(tb[CTA_COUNTERS_BYTES]));
+	return MNL_CB_OK;
 }
 
-static int parse_ip_cb(const struct nlattr *attr, void *data)
+static int handle(struct mnl_socket *nl, struct nstats_table *t)
 {
-	const struct nlattr **tb = data;
-	int type = mnl_attr_get_type(attr);
-
-	if (mnl_attr_type_valid(attr, CTA_IP_MAX) < 0)
-		return MNL_CB_OK;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	int ret;
 
-	switch(type) {
-	case CTA_IP_V4_SRC:
-	case CTA_IP_V4_DST:
-		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
-			perror("mnl_attr_validate");
-			return MNL_CB_ERROR;
-		}
-		break;
-	case CTA_IP_V6_SRC:
-	case CTA_IP_V6_DST:
-		if (mnl_attr_validate2(attr, MNL_TYPE_BINARY,
-				       sizeof(struct in6_addr)) < 0) {
-			perror("mnl_attr_validate2");
-			return MNL_CB_ERROR;
+	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	if (ret == -1) {
+		/* It only happens if NETLINK_NO_ENOBUFS is not set, it means
+		 * we are leaking statistics.
+		 */
+		if (errno == ENOBUFS) {
+			fprintf(stderr, "The daemon has hit ENOBUFS, you can "
+					"increase the size of your receiver "
+					"buffer to mitigate this or enable "
+					"reliable delivery.\n");
+		} else {
+			perror("mnl_socket_recvfrom");
 		}
-		break;
+		return -1;
 	}
-	tb[type] = attr;
-	return MNL_CB_OK;
+
+	pthread_mutex_lock(&t->lock);
+	ret = mnl_cb_run(buf, ret, 0, 0, data_cb, t);
+	pthread_mutex_unlock(&t->lock);
+	if (ret == -1)
+		perror("mnl_cb_run");
+
+	return ret;
 }
 
-static void parse_ip(const struct nlattr *nest, struct nstats *ns)
+static struct mnl_socket *open_socket(unsigned int groups)
 {
-	struct nlattr *tb[CTA_IP_MAX+1] = {};
+	struct mnl_socket *nl;
+	int on = 1, buffersize = (1 << 22);
 
-	mnl_attr_parse_nested(nest, parse_ip_cb, tb);
-	if (tb[CTA_IP_V4_SRC]) {
-		struct in_addr *in = mnl_attr_get_payload(tb[CTA_IP_V4_SRC]);
-		ns->ip = *in;
-		ns->family = AF_INET;
+	/* Open netlink socket to operate with netfilter */
+	nl = mnl_socket_open(NETLINK_NETFILTER);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
 	}
-	if (tb[CTA_IP_V6_SRC]) {
-		struct in6_addr *in = mnl_attr_get_payload(tb[CTA_IP_V6_SRC]);
-		ns->ip6 = *in;
-		ns->family = AF_INET6;
+
+	if (mnl_socket_bind(nl, groups, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
 	}
-}
 
-static int parse_tuple_cb(const struct nlattr *attr, void *data)
-{
-	const struct nlattr **tb = data;
-	int type = mnl_attr_get_type(attr);
+	/* Set netlink receiver buffer to 16 MBytes, to avoid packet drops */
+	setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUFFORCE,
+		   &buffersize, sizeof(socklen_t));
 
-	if (mnl_attr_type_valid(attr, CTA_TUPLE_MAX) < 0)
-		return MNL_CB_OK;
+	/* The two tweaks below enable reliable event delivery, packets may
+	 * be dropped if the netlink receiver buffer overruns. This happens ...
+	 *
+	 * a) if the kernel spams this user-space process until the receiver
+	 *    is filled.
+	 *
+	 * or:
+	 *
+	 * b) if the user-space process does not pull messages from the
+	 *    receiver buffer so often.
+	 */
+	mnl_socket_setsockopt(nl, NETLINK_BROADCAST_ERROR, &on, sizeof(int));
+	mnl_socket_setsockopt(nl, NETLINK_NO_ENOBUFS, &on, sizeof(int));
 
-	switch(type) {
-	case CTA_TUPLE_IP:
-		if (mnl_attr_validate(attr, MNL_TYPE_NESTED) < 0) {
-			perror("mnl_attr_validate");
-			return MNL_CB_ERROR;
-		}
-		break;
-	}
-	tb[type] = attr;
-	return MNL_CB_OK;
+	return nl;
 }
 
-static void parse_tuple(const struct nlattr *nest, struct nstats *ns)
+/*
+ * Classic BPF program that only lets the events of one shard through: the
+ * events are split across the event threads after the original source
+ * address, which is the key of the statistics, so each address is only
+ * accounted by one shard. The address is looked up with the SKF_AD_NLATTR
+ * and SKF_AD_NLATTR_NEST extensions, as nfct-event does for the mark. The
+ * last word of IPv6 addresses is used, the others are IPv4.
+ */
+static int attach_shard_filter(struct mnl_socket *nl, unsigned int shard,
+			       unsigned int num_shards)
 {
-	struct nlattr *tb[CTA_TUPLE_MAX+1] = {};
+	struct sock_filter code[] = {
+		/* A = offset of CTA_TUPLE_ORIG, then of CTA_TUPLE_IP. */
+		BPF_STMT(BPF_LD|BPF_IMM,
+			 NLMSG_HDRLEN + sizeof(struct nfgenmsg)),
+		BPF_STMT(BPF_LDX|BPF_IMM, CTA_TUPLE_ORIG),
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_NLATTR),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 19, 0),
+		BPF_STMT(BPF_LDX|BPF_IMM, CTA_TUPLE_IP),
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_NLATTR_NEST),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 16, 0),
+		BPF_STMT(BPF_ST, 0),
+		/* IPv6 source address. */
+		BPF_STMT(BPF_LDX|BPF_IMM, CTA_IP_V6_SRC),
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_NLATTR_NEST),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 3, 0),
+		BPF_STMT(BPF_MISC|BPF_TAX, 0),
+		BPF_STMT(BPF_LD|BPF_W|BPF_IND, MNL_ATTR_HDRLEN + 12),
+		BPF_JUMP(BPF_JMP|BPF_JA, 6, 0, 0),
+		/* IPv4 source address. */
+		BPF_STMT(BPF_LD|BPF_MEM, 0),
+		BPF_STMT(BPF_LDX|BPF_IMM, CTA_IP_V4_SRC),
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_NLATTR_NEST),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 5, 0),
+		BPF_STMT(BPF_MISC|BPF_TAX, 0),
+		BPF_STMT(BPF_LD|BPF_W|BPF_IND, MNL_ATTR_HDRLEN),
+		/* the shard of the address. */
+		BPF_STMT(BPF_ALU|BPF_MOD|BPF_K, num_shards),
+		BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, shard, 0, 1),
+		BPF_STMT(BPF_RET|BPF_K, 0xffffffff),
+		/* no address or another shard, events without address are
+		 * not accounted anyway. */
+		BPF_STMT(BPF_RET|BPF_K, 0),
+	};
+	struct sock_fprog fprog = {
+		.len	= MNL_ARRAY_SIZE(code),
+		.filter	= code,
+	};
 
-	mnl_attr_parse_nested(nest, parse_tuple_cb, tb);
-	if (tb[CTA_TUPLE_IP])
-		parse_ip(tb[CTA_TUPLE_IP], ns);
+	return setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_ATTACH_FILTER,
+			  &fprog, sizeof(fprog));
 }
 
-static int data_attr_cb(const struct nlattr *attr, void *data)
-{
-	const struct nlattr **tb = data;
-	int type = mnl_attr_get_type(attr);
+#define SHARDS_MAX	64
 
-	if (mnl_attr_type_valid(attr, CTA_MAX) < 0)
-		return MNL_CB_OK;
+/* one shard per event thread, the last one is updated by the dump. */
+static struct nstats_table shards[SHARDS_MAX + 1];
+static unsigned int num_event_shards;
 
-	switch(type) {
-	case CTA_TUPLE_ORIG:
-	case CTA_COUNTERS_ORIG:
-	case CTA_COUNTERS_REPLY:
-		if (mnl_attr_validate(attr, MNL_TYPE_NESTED) < 0) {
-			perror("mnl_attr_validate");
-			return MNL_CB_ERROR;
-		}
-		break;
-	}
-	tb[type] = attr;
-	return MNL_CB_OK;
-}
-
-static int data_cb(const struct nlmsghdr *nlh, void *data)
+/* Subscribe to destroy events to avoid leaking counters. */
+static void *events_thread(void *data)
 {
-	struct nlattr *tb[CTA_MAX+1] = {};
-	struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
-	struct nstats ns = {}, *cur, *new;
-
-	mnl_attr_parse(nlh, sizeof(*nfg), data_attr_cb, tb);
-	if (tb[CTA_TUPLE_ORIG])
-		parse_tuple(tb[CTA_TUPLE_ORIG], &ns);
-
-	if (tb[CTA_COUNTERS_ORIG])
-		parse_counters(tb[CTA_COUNTERS_ORIG], &ns);
-
-	if (tb[CTA_COUNTERS_REPLY])
-		parse_counters(tb[CTA_COUNTERS_REPLY], &ns);
-
-	/* Look up for existing statistics object ... */
-	LIST_FOREACH(cur, &nstats_head, list) {
-		if (memcmp(&ns.ip6, &cur->ip6, sizeof(struct in6_addr)) == 0) {
-			/* ... and sum counters */
-			cur->pkts += ns.pkts;
-			cur->bytes += ns.bytes;
-			return MNL_CB_OK;
-		}
-	}
-
-	/* ... if it does not exist, add new stats object */
-	new = calloc(1, sizeof(struct nstats));
-	if (!new)
-		return MNL_CB_OK;
+	unsigned int shard = (uintptr_t)data;
+	struct mnl_socket *nl;
 
-	new->family = ns.family;
-	new->ip6 = ns.ip6;
-	new->pkts = ns.pkts;
-	new->bytes = ns.bytes;
+	nl = open_socket(NF_NETLINK_CONNTRACK_DESTROY);
+	if (num_event_shards > 1 &&
+	    attach_shard_filter(nl, shard, num_event_shards) < 0) {
+		perror("SO_ATTACH_FILTER");
+		exit(EXIT_FAILURE);
+	}
 
-	LIST_INSERT_HEAD(&nstats_head, new, list);
+	while (handle(nl, &shards[shard]) >= 0)
+		;
 
-	return MNL_CB_OK;
+	exit(EXIT_FAILURE);
 }
 
-static int handle(struct mnl_socket *nl)
+static void report(struct nstats_table *total)
 {
-	char buf[MNL_SOCKET_BUFFER_SIZE];
-	int ret;
+	uint32_t i;
 
-	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-	if (ret == -1) {
-		/* It only happens if NETLINK_NO_ENOBUFS is not set, it means
-		 * we are leaking statistics.
-		 */
-		if (errno == ENOBUFS) {
-			fprintf(stderr, "The daemon has hit ENOBUFS, you can "
-					"increase the size of your receiver "
-					"buffer to mitigate this or enable "
-					"reliable delivery.\n");
-		} else {
-			perror("mnl_socket_recvfrom");
+	for (i = 0; i <= num_event_shards; i++) {
+		if (nstats_table_merge(total, &shards[i]) < 0) {
+			perror("nstats_table_merge");
+			exit(EXIT_FAILURE);
 		}
-		return -1;
 	}
 
-	ret = mnl_cb_run(buf, ret, 0, 0, data_cb, NULL);
-	if (ret == -1) {
-		perror("mnl_cb_run");
-		return -1;
-	} else if (ret <= MNL_CB_STOP)
-		return 0;
+	/* print the content of the table */
+	for (i = 0; i <= total->mask; i++) {
+		const struct nstats *cur = &total->slots[i];
+		char out[INET6_ADDRSTRLEN];
 
-	return 0;
+		if (cur->family == 0)
+			continue;
+
+		if (inet_ntop(cur->family, &cur->ip, out, sizeof(out)))
+			printf("src=%s ", out);
+
+		printf("counters %"PRIu64" %"PRIu64"\n",
+			cur->pkts, cur->bytes);
+	}
+	nstats_table_clear(total);
 }
 
 int main(int argc, char *argv[])
 {
 	struct mnl_socket *nl;
 	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nstats_table total;
 	struct nlmsghdr *nlh;
 	struct nfgenmsg *nfh;
-	struct nstats *cur;
-	struct timeval tv = {};
-	int ret, secs, on = 1, buffersize = (1 << 22);
+	pthread_t thread;
+	unsigned int i;
+	int ret, secs;
 
-	if (argc != 2) {
-		printf("Usage: %s <poll-secs>\n", argv[0]);
+	if (argc != 2 && argc != 3) {
+		printf("Usage: %s <poll-secs> [event-threads]\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 	secs = atoi(argv[1]);
 
-	LIST_INIT(&nstats_head);
+	/* one event thread per CPU by default. */
+	if (argc == 3)
+		num_event_shards = atoi(argv[2]);
+	else
+		num_event_shards = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_event_shards < 1)
+		num_event_shards = 1;
+	if (num_event_shards > SHARDS_MAX)
+		num_event_shards = SHARDS_MAX;
+
+	for (i = 0; i <= num_event_shards; i++) {
+		if (nstats_table_init(&shards[i], 1024) < 0) {
+			perror("nstats_table_init");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (nstats_table_init(&total, 1024) < 0) {
+		perror("nstats_table_init");
+		exit(EXIT_FAILURE);
+	}
 
 	printf("Polling every %d seconds from kernel...\n", secs);
 
@@ -264,39 +267,19 @@ int main(int argc, char *argv[])
 	 */
 	nice(-20);
 
-	/* Open netlink socket to operate with netfilter */
-	nl = mnl_socket_open(NETLINK_NETFILTER);
-	if (nl == NULL) {
-		perror("mnl_socket_open");
-		exit(EXIT_FAILURE);
+	for (i = 0; i < num_event_shards; i++) {
+		errno = pthread_create(&thread, NULL, events_thread,
+				       (void *)(uintptr_t)i);
+		if (errno != 0) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
 	}
 
-	/* Subscribe to destroy events to avoid leaking counters. The same
-	 * socket is used to periodically atomically dump and reset counters.
+	/* This socket is used to periodically atomically dump and reset
+	 * counters.
 	 */
-	if (mnl_socket_bind(nl, NF_NETLINK_CONNTRACK_DESTROY,
-				MNL_SOCKET_AUTOPID) < 0) {
-		perror("mnl_socket_bind");
-		exit(EXIT_FAILURE);
-	}
-
-	/* Set netlink receiver buffer to 16 MBytes, to avoid packet drops */
-	setsockopt(mnl_socket_get_fd(nl), SOL_SOCKET, SO_RCVBUFFORCE,
-		   &buffersize, sizeof(socklen_t));
-
-	/* The two tweaks below enable reliable event delivery, packets may
-	 * be dropped if the netlink receiver buffer overruns. This happens ...
-	 *
-	 * a) if the kernel spams this user-space process until the receiver
-	 *    is filled.
-	 *
-	 * or:
-	 *
-	 * b) if the user-space process does not pull messages from the
-	 *    receiver buffer so often.
-	 */
-	mnl_socket_setsockopt(nl, NETLINK_BROADCAST_ERROR, &on, sizeof(int));
-	mnl_socket_setsockopt(nl, NETLINK_NO_ENOBUFS, &on, sizeof(int));
+	nl = open_socket(0);
 
 	nlh = mnl_nlmsg_put_header(buf);
 	/* Counters are atomically zeroed in each dump */
@@ -314,51 +297,31 @@ int main(int argc, char *argv[])
 	mnl_attr_put_u32(nlh, CTA_MARK_MASK, htonl(0xffffffff));
 
 	while (1) {
-		int fd_max = mnl_socket_get_fd(nl);
-		fd_set readfds;
-
-		/* Every N seconds ... */
-		if (tv.tv_sec == 0 && tv.tv_usec == 0) {
-			/* ... request a fresh dump of the table from kernel */
-			ret = mnl_socket_sendto(nl, nlh, nlh->nlmsg_len);
-			if (ret == -1) {
-				perror("mnl_socket_sendto");
-				return -1;
-			}
-			tv.tv_sec = secs;
-			tv.tv_usec = 0;
-
-			/* print the content of the list */
-			LIST_FOREACH(cur, &nstats_head, list) {
-				char out[INET6_ADDRSTRLEN];
-
-				if (inet_ntop(cur->family, &cur->ip, out, sizeof(out)))
-					printf("src=%s ", out);
-
-				printf("counters %"PRIu64" %"PRIu64"\n",
-					cur->pkts, cur->bytes);
-			}
+		/* Every N seconds, request a fresh dump of the table from
+		 * kernel ...
+		 */
+		ret = mnl_socket_sendto(nl, nlh, nlh->nlmsg_len);
+		if (ret == -1) {
+			perror("mnl_socket_sendto");
+			return -1;
 		}
 
-		FD_ZERO(&readfds);
-		FD_SET(mnl_socket_get_fd(nl), &readfds);
+		do {
+			ret = handle(nl, &shards[num_event_shards]);
+			if (ret < 0)
+				return EXIT_FAILURE;
+		} while (ret > MNL_CB_STOP);
 
-		ret = select(fd_max+1, &readfds, NULL, NULL, &tv);
-		if (ret < 0) {
-			if (errno == EINTR)
-				continue;
+		/* ... and merge the tables to report */
+		report(&total);
 
-			perror("select");
-			exit(EXIT_FAILURE);
-		}
-
-		/* Handled event and periodic atomic-dump-and-reset messages */
-		if (FD_ISSET(mnl_socket_get_fd(nl), &readfds)) {
-			if (handle(nl) < 0)
-				return EXIT_FAILURE;
-		}
+		sleep(secs);
 	}
 
+	nstats_table_fini(&total);
+	for (i = 0; i <= num_event_shards; i++)
+		nstats_table_fini(&shards[i]);
+
 	mnl_socket_close(nl);
 
 	return 0;
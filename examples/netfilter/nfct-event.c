@@ -1,8 +1,16 @@
 /* This example is placed in the public domain. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
 #include <unistd.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
 
 #include <libmnl/libmnl.h>
 #include <linux/netfilter/nfnetlink.h>
@@ -173,8 +181,12 @@ static int data_cb(const struct nlmsghdr *nlh, void *data)
 {
 	struct nlattr *tb[CTA_MAX+1] = {};
 	struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
+	const char *tag = data;
 
-	switch(nlh->nlmsg_type & 0xFF) {
+	/* entries that come from a resync dump are tagged by the caller. */
+	if (tag)
+		printf("%9s ", tag);
+	else switch(nlh->nlmsg_type & 0xFF) {
 	case IPCTNL_MSG_CT_NEW:
 		if (nlh->nlmsg_flags & (NLM_F_CREATE|NLM_F_EXCL))
 			printf("%9s ", "[NEW] ");
@@ -200,29 +212,329 @@ static int data_cb(const struct nlmsghdr *nlh, void *data)
 	return MNL_CB_OK;
 }
 
-int main(void)
+/* which events are delivered and what happens if some are lost. */
+enum delivery {
+	/* overruns are reported via ENOBUFS, which triggers a resync dump. */
+	DELIVERY_RESYNC,
+	/* overruns are not reported, lost events go unnoticed. */
+	DELIVERY_NO_ENOBUFS,
+	/* the kernel reports delivery failures to the sender, so conntrack
+	 * retries destroy events until they are delivered. */
+	DELIVERY_RELIABLE,
+};
+
+struct listener {
+	struct mnl_socket	*nl;
+	unsigned int		groups;
+	enum delivery		delivery;
+	/* filters, applied in the kernel. */
+	uint8_t			family;
+	bool			filter_mark;
+	uint32_t		mark;
+	uint32_t		mark_mask;
+	/* receive buffer size, doubled on each overrun up to the max. */
+	int			rcvbuf;
+	int			rcvbuf_max;
+	unsigned int		overruns;
+};
+
+static int listener_set_rcvbuf(struct listener *l, int size)
+{
+	int fd = mnl_socket_get_fd(l->nl);
+
+	/* SO_RCVBUFFORCE ignores rmem_max, but it requires CAP_NET_ADMIN. */
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+		       sizeof(size)) < 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+		return -1;
+
+	l->rcvbuf = size;
+	return 0;
+}
+
+/*
+ * Classic BPF program that drops the events that we are not interested in
+ * before they are queued to the socket. Each event comes in its own skb.
+ * The mark is looked up with the SKF_AD_NLATTR extension, which returns the
+ * offset of the first attribute with type X from offset A, or zero if there
+ * is none: events do not include the mark attribute if the mark is zero.
+ */
+static int listener_attach_filter(struct listener *l)
+{
+	struct sock_filter code[16];
+	struct sock_fprog fprog = {
+		.filter = code,
+	};
+	unsigned int n = 0, reject[2], num_reject = 0, i;
+
+	if (l->family != AF_UNSPEC) {
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_B|BPF_ABS,
+				 NLMSG_HDRLEN +
+				 offsetof(struct nfgenmsg, nfgen_family));
+		reject[num_reject++] = n;
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, l->family, 0, 0);
+	}
+	if (l->filter_mark) {
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_IMM,
+				 NLMSG_HDRLEN + sizeof(struct nfgenmsg));
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LDX|BPF_IMM, CTA_MARK);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_NLATTR);
+		/* no mark attribute, the mark is zero. */
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 0, 3, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_MISC|BPF_TAX, 0);
+		/* the mark is in network byte order, as BPF loads words. */
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_W|BPF_IND, MNL_ATTR_HDRLEN);
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JA, 1, 0, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_LD|BPF_IMM, 0);
+		code[n++] = (struct sock_filter)
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, l->mark_mask);
+		reject[num_reject++] = n;
+		code[n++] = (struct sock_filter)
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, l->mark & l->mark_mask,
+				 0, 0);
+	}
+	if (n == 0)
+		return 0;
+
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, 0xffffffff);
+	/* the jumps above go here if the event does not match. */
+	for (i = 0; i < num_reject; i++)
+		code[reject[i]].jf = n - reject[i] - 1;
+	code[n++] = (struct sock_filter) BPF_STMT(BPF_RET|BPF_K, 0);
+
+	fprog.len = n;
+	return setsockopt(mnl_socket_get_fd(l->nl), SOL_SOCKET,
+			  SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+}
+
+static int listener_open(struct listener *l)
+{
+	int on = 1;
+
+	l->nl = mnl_socket_open(NETLINK_NETFILTER);
+	if (l->nl == NULL)
+		return -1;
+
+	if (mnl_socket_bind(l->nl, l->groups, MNL_SOCKET_AUTOPID) < 0)
+		return -1;
+
+	if (listener_set_rcvbuf(l, l->rcvbuf) < 0)
+		return -1;
+
+	switch (l->delivery) {
+	case DELIVERY_RESYNC:
+		break;
+	case DELIVERY_RELIABLE:
+		if (mnl_socket_setsockopt(l->nl, NETLINK_BROADCAST_ERROR,
+					  &on, sizeof(on)) < 0)
+			return -1;
+		/* fall through */
+	case DELIVERY_NO_ENOBUFS:
+		if (mnl_socket_setsockopt(l->nl, NETLINK_NO_ENOBUFS,
+					  &on, sizeof(on)) < 0)
+			return -1;
+		break;
+	}
+
+	return listener_attach_filter(l);
+}
+
+/*
+ * Some events were lost, dump the table to get in sync again. The dump
+ * goes through its own socket, so that its replies are not dropped by the
+ * event filter, and it is filtered in the kernel in the same way.
+ */
+static int listener_resync(const struct listener *l)
 {
 	struct mnl_socket *nl;
 	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfh;
+	unsigned int seq, portid;
 	int ret;
 
 	nl = mnl_socket_open(NETLINK_NETFILTER);
-	if (nl == NULL) {
-		perror("mnl_socket_open");
-		exit(EXIT_FAILURE);
+	if (nl == NULL)
+		return -1;
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0)
+		goto err;
+
+	portid = mnl_socket_get_portid(nl);
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_GET;
+	nlh->nlmsg_flags = NLM_F_REQUEST|NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = time(NULL);
+
+	nfh = mnl_nlmsg_put_extra_header(nlh, sizeof(struct nfgenmsg));
+	nfh->nfgen_family = l->family;
+	nfh->version = NFNETLINK_V0;
+	nfh->res_id = 0;
+
+	if (l->filter_mark) {
+		mnl_attr_put_u32(nlh, CTA_MARK, htonl(l->mark));
+		mnl_attr_put_u32(nlh, CTA_MARK_MASK, htonl(l->mark_mask));
 	}
 
-	if (mnl_socket_bind(nl, NF_NETLINK_CONNTRACK_NEW |
-				NF_NETLINK_CONNTRACK_UPDATE |
-				NF_NETLINK_CONNTRACK_DESTROY,
-				MNL_SOCKET_AUTOPID) < 0) {
-		perror("mnl_socket_bind");
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+		goto err;
+
+	do {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1)
+			goto err;
+
+		ret = mnl_cb_run(buf, ret, seq, portid, data_cb, "[RESYNC] ");
+	} while (ret > MNL_CB_STOP);
+
+	mnl_socket_close(nl);
+	return ret;
+err:
+	mnl_socket_close(nl);
+	return -1;
+}
+
+static int listener_overrun(struct listener *l)
+{
+	l->overruns++;
+
+	if (l->rcvbuf < l->rcvbuf_max) {
+		int size = l->rcvbuf * 2;
+
+		if (size > l->rcvbuf_max)
+			size = l->rcvbuf_max;
+		if (listener_set_rcvbuf(l, size) < 0)
+			return -1;
+	}
+	fprintf(stderr, "events lost (overruns=%u), receive buffer is now "
+			"%d bytes, resyncing\n", l->overruns, l->rcvbuf);
+
+	return listener_resync(l);
+}
+
+static unsigned int parse_groups(char *arg)
+{
+	unsigned int groups = 0;
+	char *tok;
+
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		if (strcmp(tok, "new") == 0)
+			groups |= NF_NETLINK_CONNTRACK_NEW;
+		else if (strcmp(tok, "update") == 0)
+			groups |= NF_NETLINK_CONNTRACK_UPDATE;
+		else if (strcmp(tok, "destroy") == 0)
+			groups |= NF_NETLINK_CONNTRACK_DESTROY;
+		else
+			return 0;
+	}
+	return groups;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options]\n"
+	       "  -e, --events new,update,destroy  events to listen to\n"
+	       "  -d, --delivery resync|no-enobufs|reliable\n"
+	       "                                   what to do on overruns\n"
+	       "  -f, --family inet|inet6          only this family\n"
+	       "  -m, --mark MARK[/MASK]           only entries with this "
+	       "mark\n"
+	       "  -b, --buffer SIZE[:MAX]          receive buffer size\n",
+	       prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{ "events",	required_argument,	NULL, 'e' },
+		{ "delivery",	required_argument,	NULL, 'd' },
+		{ "family",	required_argument,	NULL, 'f' },
+		{ "mark",	required_argument,	NULL, 'm' },
+		{ "buffer",	required_argument,	NULL, 'b' },
+		{ NULL },
+	};
+	struct listener l = {
+		.groups		= NF_NETLINK_CONNTRACK_NEW |
+				  NF_NETLINK_CONNTRACK_UPDATE |
+				  NF_NETLINK_CONNTRACK_DESTROY,
+		.delivery	= DELIVERY_RESYNC,
+		.family		= AF_UNSPEC,
+		.mark_mask	= 0xffffffff,
+		.rcvbuf		= 1 << 20,
+		.rcvbuf_max	= 1 << 26,
+	};
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	int ret, opt;
+
+	while ((opt = getopt_long(argc, argv, "e:d:f:m:b:", opts, NULL)) != -1) {
+		switch (opt) {
+		case 'e':
+			l.groups = parse_groups(optarg);
+			if (l.groups == 0)
+				usage(argv[0]);
+			break;
+		case 'd':
+			if (strcmp(optarg, "resync") == 0)
+				l.delivery = DELIVERY_RESYNC;
+			else if (strcmp(optarg, "no-enobufs") == 0)
+				l.delivery = DELIVERY_NO_ENOBUFS;
+			else if (strcmp(optarg, "reliable") == 0)
+				l.delivery = DELIVERY_RELIABLE;
+			else
+				usage(argv[0]);
+			break;
+		case 'f':
+			if (strcmp(optarg, "inet") == 0)
+				l.family = AF_INET;
+			else if (strcmp(optarg, "inet6") == 0)
+				l.family = AF_INET6;
+			else
+				usage(argv[0]);
+			break;
+		case 'm':
+			l.filter_mark = true;
+			if (sscanf(optarg, "%i/%i", &l.mark, &l.mark_mask) < 1)
+				usage(argv[0]);
+			break;
+		case 'b':
+			ret = sscanf(optarg, "%i:%i", &l.rcvbuf, &l.rcvbuf_max);
+			if (ret < 1 || l.rcvbuf <= 0)
+				usage(argv[0]);
+			if (ret == 1 || l.rcvbuf_max < l.rcvbuf)
+				l.rcvbuf_max = l.rcvbuf;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (listener_open(&l) < 0) {
+		perror("listener_open");
 		exit(EXIT_FAILURE);
 	}
 
 	while (1) {
-		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		ret = mnl_socket_recvfrom(l.nl, buf, sizeof(buf));
 		if (ret == -1) {
+			if (errno == ENOBUFS) {
+				if (listener_overrun(&l) < 0) {
+					perror("listener_resync");
+					exit(EXIT_FAILURE);
+				}
+				continue;
+			}
 			perror("mnl_socket_recvfrom");
 			exit(EXIT_FAILURE);
 		}
@@ -234,7 +546,7 @@ int main(void)
 		}
 	}
 
-	mnl_socket_close(nl);
+	mnl_socket_close(l.nl);
 
 	return 0;
 }
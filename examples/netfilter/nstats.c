@@ -0,0 +1,281 @@
+/* This file is placed in the public domain. */
+/*
+ * Accounting of the conntrack entries by original source address, see
+ * nstats.h. It is used by nfct-daemon.
+ */
+#include <endian.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+
+#include "nstats.h"
+
+int nstats_table_init(struct nstats_table *t, uint32_t size)
+{
+	/* size must be a power of two. */
+	t->slots = calloc(size, sizeof(struct nstats));
+	if (t->slots == NULL)
+		return -1;
+
+	t->mask = size - 1;
+	t->count = 0;
+	pthread_mutex_init(&t->lock, NULL);
+	return 0;
+}
+
+void nstats_table_fini(struct nstats_table *t)
+{
+	pthread_mutex_destroy(&t->lock);
+	free(t->slots);
+}
+
+static uint32_t nstats_hash(const struct nstats *ns)
+{
+	uint32_t w[4], h = ns->family;
+	int i;
+
+	memcpy(w, &ns->ip6, sizeof(w));
+	for (i = 0; i < 4; i++) {
+		h ^= w[i];
+		h *= 0x9e3779b1;
+		h ^= h >> 15;
+	}
+	/* murmur3 finalizer, spreads the bits over the low ones. */
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static bool nstats_equal(const struct nstats *a, const struct nstats *b)
+{
+	return a->family == b->family &&
+	       memcmp(&a->ip6, &b->ip6, sizeof(struct in6_addr)) == 0;
+}
+
+/* returns the slot of this object, or the empty slot where it belongs. */
+static struct nstats *nstats_table_slot(const struct nstats_table *t,
+					const struct nstats *ns)
+{
+	uint32_t i = nstats_hash(ns) & t->mask;
+
+	while (t->slots[i].family != 0 && !nstats_equal(&t->slots[i], ns))
+		i = (i + 1) & t->mask;
+
+	return &t->slots[i];
+}
+
+static int nstats_table_grow(struct nstats_table *t)
+{
+	struct nstats_table bigger;
+	uint32_t i;
+
+	bigger.slots = calloc((t->mask + 1) * 2, sizeof(struct nstats));
+	if (bigger.slots == NULL)
+		return -1;
+
+	bigger.mask = (t->mask << 1) | 1;
+	for (i = 0; i <= t->mask; i++) {
+		if (t->slots[i].family != 0)
+			*nstats_table_slot(&bigger, &t->slots[i]) = t->slots[i];
+	}
+	free(t->slots);
+	t->slots = bigger.slots;
+	t->mask = bigger.mask;
+	return 0;
+}
+
+int nstats_table_add(struct nstats_table *t, const struct nstats *ns)
+{
+	struct nstats *cur;
+
+	cur = nstats_table_slot(t, ns);
+	if (cur->family == 0) {
+		if (t->count + 1 > (t->mask + 1) / 4 * 3) {
+			if (nstats_table_grow(t) < 0)
+				return -1;
+
+			cur = nstats_table_slot(t, ns);
+		}
+		*cur = *ns;
+		t->count++;
+		return 0;
+	}
+	cur->pkts += ns->pkts;
+	cur->bytes += ns->bytes;
+	return 0;
+}
+
+int nstats_table_merge(struct nstats_table *dst, struct nstats_table *src)
+{
+	uint32_t i;
+	int ret = 0;
+
+	pthread_mutex_lock(&src->lock);
+	for (i = 0; i <= src->mask && ret == 0; i++) {
+		if (src->slots[i].family != 0)
+			ret = nstats_table_add(dst, &src->slots[i]);
+	}
+	pthread_mutex_unlock(&src->lock);
+
+	return ret;
+}
+
+void nstats_table_clear(struct nstats_table *t)
+{
+	memset(t->slots, 0, (t->mask + 1) * sizeof(struct nstats));
+	t->count = 0;
+}
+
+static int parse_counters_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, CTA_COUNTERS_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTA_COUNTERS_PACKETS:
+	case CTA_COUNTERS_BYTES:
+		if (mnl_attr_validate(attr, MNL_TYPE_U64) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static void parse_counters(const struct nlattr *nest, struct nstats *ns)
+{
+	struct nlattr *tb[CTA_COUNTERS_MAX+1] = {};
+
+	mnl_attr_parse_nested(nest, parse_counters_cb, tb);
+	if (tb[CTA_COUNTERS_PACKETS])
+		ns->pkts += be64toh(mnl_attr_get_u64(tb[CTA_COUNTERS_PACKETS]));
+
+	if (tb[CTA_COUNTERS_BYTES])
+		ns->bytes += be64toh(mnl_attr_get_u64(tb[CTA_COUNTERS_BYTES]));
+}
+
+static int parse_ip_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, CTA_IP_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTA_IP_V4_SRC:
+	case CTA_IP_V4_DST:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case CTA_IP_V6_SRC:
+	case CTA_IP_V6_DST:
+		if (mnl_attr_validate2(attr, MNL_TYPE_BINARY,
+				       sizeof(struct in6_addr)) < 0) {
+			perror("mnl_attr_validate2");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static void parse_ip(const struct nlattr *nest, struct nstats *ns)
+{
+	struct nlattr *tb[CTA_IP_MAX+1] = {};
+
+	mnl_attr_parse_nested(nest, parse_ip_cb, tb);
+	if (tb[CTA_IP_V4_SRC]) {
+		struct in_addr *in = mnl_attr_get_payload(tb[CTA_IP_V4_SRC]);
+		ns->ip = *in;
+		ns->family = AF_INET;
+	}
+	if (tb[CTA_IP_V6_SRC]) {
+		struct in6_addr *in = mnl_attr_get_payload(tb[CTA_IP_V6_SRC]);
+		ns->ip6 = *in;
+		ns->family = AF_INET6;
+	}
+}
+
+static int parse_tuple_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, CTA_TUPLE_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTA_TUPLE_IP:
+		if (mnl_attr_validate(attr, MNL_TYPE_NESTED) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static void parse_tuple(const struct nlattr *nest, struct nstats *ns)
+{
+	struct nlattr *tb[CTA_TUPLE_MAX+1] = {};
+
+	mnl_attr_parse_nested(nest, parse_tuple_cb, tb);
+	if (tb[CTA_TUPLE_IP])
+		parse_ip(tb[CTA_TUPLE_IP], ns);
+}
+
+static int data_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (mnl_attr_type_valid(attr, CTA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case CTA_TUPLE_ORIG:
+	case CTA_COUNTERS_ORIG:
+	case CTA_COUNTERS_REPLY:
+		if (mnl_attr_validate(attr, MNL_TYPE_NESTED) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+void nstats_parse(const struct nlmsghdr *nlh, struct nstats *ns)
+{
+	struct nlattr *tb[CTA_MAX+1] = {};
+
+	memset(ns, 0, sizeof(*ns));
+
+	mnl_attr_parse(nlh, sizeof(struct nfgenmsg), data_attr_cb, tb);
+	if (tb[CTA_TUPLE_ORIG])
+		parse_tuple(tb[CTA_TUPLE_ORIG], ns);
+
+	if (tb[CTA_COUNTERS_ORIG])
+		parse_counters(tb[CTA_COUNTERS_ORIG], ns);
+
+	if (tb[CTA_COUNTERS_REPLY])
+		parse_counters(tb[CTA_COUNTERS_REPLY], ns);
+}
@@ -0,0 +1,50 @@
+#ifndef _NSTATS_H_
+#define _NSTATS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include <libmnl/libmnl.h>
+
+/* traffic of the conntrack entries whose original source is this address */
+struct nstats {
+	uint8_t family;
+
+	union {
+		struct in_addr	ip;
+		struct in6_addr ip6;
+	};
+	uint64_t pkts, bytes;
+};
+
+/*
+ * Statistics objects are stored in an open-addressing hash table with
+ * linear probing, keyed by family and address. Objects are stored in the
+ * slots, a slot whose family is zero is empty. The table doubles its size
+ * when it is 3/4 full. Objects are never removed.
+ *
+ * Tables are meant to be used as shards: each thread that receives
+ * updates has its own table, so writers never contend with each other,
+ * and the shards are merged into another table to report. The table lock
+ * is taken by the writer once per batch of messages, not per message, and
+ * by nstats_table_merge() while it reads the shard.
+ */
+struct nstats_table {
+	pthread_mutex_t	lock;
+	struct nstats	*slots;
+	uint32_t	mask;
+	uint32_t	count;
+};
+
+int nstats_table_init(struct nstats_table *t, uint32_t size);
+void nstats_table_fini(struct nstats_table *t);
+/* sum the counters of this object, add it if it does not exist yet. */
+int nstats_table_add(struct nstats_table *t, const struct nstats *ns);
+int nstats_table_merge(struct nstats_table *dst, struct nstats_table *src);
+void nstats_table_clear(struct nstats_table *t);
+
+/* fill ns from a ctnetlink message, family is zero if there is no address */
+void nstats_parse(const struct nlmsghdr *nlh, struct nstats *ns);
+
+#endif
@@ -0,0 +1,446 @@
+/* This example is placed in the public domain. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/if_addr.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * Link and address cache: interfaces and their addresses are kept in an
+ * array indexed by interface index, which is built from a dump and kept up
+ * to date with link and address events.
+ *
+ * The kernel sends RTM_NEWLINK for many reasons, eg. statistics or carrier
+ * changes of lower devices, and most of these messages carry the same data
+ * that we already have. The cache compares the fields that it keeps and
+ * only calls the user callback if one of the watched fields has changed.
+ */
+
+#define LLADDR_MAX	32
+
+enum link_change {
+	LINK_CHANGE_NEW		= (1 << 0),
+	LINK_CHANGE_DEL		= (1 << 1),
+	LINK_CHANGE_NAME	= (1 << 2),
+	LINK_CHANGE_MTU		= (1 << 3),
+	LINK_CHANGE_OPERSTATE	= (1 << 4),
+	LINK_CHANGE_FLAGS	= (1 << 5),
+	LINK_CHANGE_LLADDR	= (1 << 6),
+	LINK_CHANGE_ADDRS	= (1 << 7),
+};
+
+struct link_addr {
+	uint8_t		family;
+	uint8_t		prefixlen;
+	uint8_t		addr[16];
+};
+
+struct link {
+	bool			present;
+	char			name[IFNAMSIZ];
+	uint32_t		mtu;
+	uint32_t		flags;
+	uint8_t			operstate;
+	uint8_t			lladdr[LLADDR_MAX];
+	uint8_t			lladdr_len;
+	struct link_addr	*addrs;
+	unsigned int		num_addrs;
+	unsigned int		max_addrs;
+};
+
+typedef void (*link_cb_t)(uint32_t ifindex, const struct link *link,
+			  uint32_t changes, void *data);
+
+struct link_cache {
+	struct link	*links;
+	uint32_t	num_links;
+	/* changes that are reported, and to whom. */
+	uint32_t	watch;
+	link_cb_t	cb;
+	void		*data;
+};
+
+static struct link *link_cache_get(struct link_cache *c, uint32_t ifindex,
+				   bool create)
+{
+	if (ifindex >= c->num_links) {
+		struct link *links;
+		uint32_t num = c->num_links ? c->num_links : 64;
+
+		if (!create)
+			return NULL;
+
+		while (num <= ifindex)
+			num *= 2;
+
+		links = realloc(c->links, num * sizeof(struct link));
+		if (links == NULL)
+			return NULL;
+
+		memset(&links[c->num_links], 0,
+		       (num - c->num_links) * sizeof(struct link));
+		c->links = links;
+		c->num_links = num;
+	}
+	return &c->links[ifindex];
+}
+
+static void link_cache_notify(struct link_cache *c, uint32_t ifindex,
+			      uint32_t changes)
+{
+	if (c->cb && (changes & c->watch))
+		c->cb(ifindex, &c->links[ifindex], changes & c->watch, c->data);
+}
+
+/* returns the index of the address, -1 if the link does not have it. */
+static int link_addr_find(const struct link *l, const struct link_addr *a)
+{
+	unsigned int i;
+
+	for (i = 0; i < l->num_addrs; i++) {
+		if (memcmp(&l->addrs[i], a, sizeof(*a)) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static int link_addr_add(struct link *l, const struct link_addr *a)
+{
+	if (l->num_addrs == l->max_addrs) {
+		unsigned int max = l->max_addrs ? l->max_addrs * 2 : 4;
+		struct link_addr *addrs;
+
+		addrs = realloc(l->addrs, max * sizeof(struct link_addr));
+		if (addrs == NULL)
+			return -1;
+
+		l->addrs = addrs;
+		l->max_addrs = max;
+	}
+	l->addrs[l->num_addrs++] = *a;
+	return 0;
+}
+
+static int link_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	/* skip unsupported attribute in user-space */
+	if (mnl_attr_type_valid(attr, IFLA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case IFLA_MTU:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case IFLA_OPERSTATE:
+		if (mnl_attr_validate(attr, MNL_TYPE_U8) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case IFLA_IFNAME:
+		if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case IFLA_ADDRESS:
+		if (mnl_attr_validate(attr, MNL_TYPE_BINARY) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int link_cb(const struct nlmsghdr *nlh, struct link_cache *c)
+{
+	struct nlattr *tb[IFLA_MAX+1] = {};
+	struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
+	uint32_t changes = 0;
+	struct link *l;
+
+	/* bridge ports are also notified with AF_BRIDGE messages when they
+	 * join or leave a bridge, the interface itself does not change. */
+	if (ifm->ifi_family != AF_UNSPEC)
+		return MNL_CB_OK;
+
+	l = link_cache_get(c, ifm->ifi_index, nlh->nlmsg_type == RTM_NEWLINK);
+	if (l == NULL)
+		return nlh->nlmsg_type == RTM_NEWLINK ? MNL_CB_ERROR : MNL_CB_OK;
+
+	if (nlh->nlmsg_type == RTM_DELLINK) {
+		if (!l->present)
+			return MNL_CB_OK;
+
+		l->present = false;
+		link_cache_notify(c, ifm->ifi_index, LINK_CHANGE_DEL);
+		/* the kernel sends RTM_DELADDR for the addresses before,
+		 * release whatever is left, eg. if an event was lost. */
+		free(l->addrs);
+		memset(l, 0, sizeof(*l));
+		return MNL_CB_OK;
+	}
+
+	if (!l->present) {
+		l->present = true;
+		changes |= LINK_CHANGE_NEW;
+	}
+	if (l->flags != ifm->ifi_flags) {
+		l->flags = ifm->ifi_flags;
+		changes |= LINK_CHANGE_FLAGS;
+	}
+
+	mnl_attr_parse(nlh, sizeof(*ifm), link_attr_cb, tb);
+	if (tb[IFLA_IFNAME] &&
+	    strncmp(l->name, mnl_attr_get_str(tb[IFLA_IFNAME]), IFNAMSIZ)) {
+		snprintf(l->name, sizeof(l->name), "%s",
+			 mnl_attr_get_str(tb[IFLA_IFNAME]));
+		changes |= LINK_CHANGE_NAME;
+	}
+	if (tb[IFLA_MTU] && l->mtu != mnl_attr_get_u32(tb[IFLA_MTU])) {
+		l->mtu = mnl_attr_get_u32(tb[IFLA_MTU]);
+		changes |= LINK_CHANGE_MTU;
+	}
+	if (tb[IFLA_OPERSTATE] &&
+	    l->operstate != mnl_attr_get_u8(tb[IFLA_OPERSTATE])) {
+		l->operstate = mnl_attr_get_u8(tb[IFLA_OPERSTATE]);
+		changes |= LINK_CHANGE_OPERSTATE;
+	}
+	if (tb[IFLA_ADDRESS]) {
+		uint16_t len = mnl_attr_get_payload_len(tb[IFLA_ADDRESS]);
+
+		if (len > LLADDR_MAX)
+			len = LLADDR_MAX;
+		if (len != l->lladdr_len ||
+		    memcmp(l->lladdr, mnl_attr_get_payload(tb[IFLA_ADDRESS]),
+			   len)) {
+			memcpy(l->lladdr, mnl_attr_get_payload(tb[IFLA_ADDRESS]),
+			       len);
+			l->lladdr_len = len;
+			changes |= LINK_CHANGE_LLADDR;
+		}
+	}
+
+	link_cache_notify(c, ifm->ifi_index, changes);
+	return MNL_CB_OK;
+}
+
+static int addr_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	/* skip unsupported attribute in user-space */
+	if (mnl_attr_type_valid(attr, IFA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case IFA_ADDRESS:
+	case IFA_LOCAL:
+		if (mnl_attr_validate(attr, MNL_TYPE_BINARY) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int addr_cb(const struct nlmsghdr *nlh, struct link_cache *c)
+{
+	struct nlattr *tb[IFA_MAX+1] = {};
+	struct ifaddrmsg *ifa = mnl_nlmsg_get_payload(nlh);
+	struct link_addr a = {};
+	const struct nlattr *attr;
+	struct link *l;
+	int index;
+
+	l = link_cache_get(c, ifa->ifa_index, false);
+	if (l == NULL || !l->present)
+		return MNL_CB_OK;
+
+	mnl_attr_parse(nlh, sizeof(*ifa), addr_attr_cb, tb);
+	/* IFA_LOCAL is the address of point-to-point interfaces. */
+	attr = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+	if (attr == NULL || mnl_attr_get_payload_len(attr) > sizeof(a.addr))
+		return MNL_CB_OK;
+
+	a.family = ifa->ifa_family;
+	a.prefixlen = ifa->ifa_prefixlen;
+	memcpy(a.addr, mnl_attr_get_payload(attr),
+	       mnl_attr_get_payload_len(attr));
+
+	index = link_addr_find(l, &a);
+	if (nlh->nlmsg_type == RTM_NEWADDR) {
+		/* address refreshes, eg. lifetimes, are not changes. */
+		if (index >= 0)
+			return MNL_CB_OK;
+		if (link_addr_add(l, &a) < 0)
+			return MNL_CB_ERROR;
+	} else {
+		if (index < 0)
+			return MNL_CB_OK;
+		l->addrs[index] = l->addrs[--l->num_addrs];
+	}
+
+	link_cache_notify(c, ifa->ifa_index, LINK_CHANGE_ADDRS);
+	return MNL_CB_OK;
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	switch (nlh->nlmsg_type) {
+	case RTM_NEWLINK:
+	case RTM_DELLINK:
+		return link_cb(nlh, data);
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		return addr_cb(nlh, data);
+	}
+	return MNL_CB_OK;
+}
+
+static int link_cache_dump(struct link_cache *c, struct mnl_socket *nl,
+			   uint16_t type)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct rtgenmsg *rt;
+	unsigned int seq, portid = mnl_socket_get_portid(nl);
+	int ret;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = time(NULL);
+	rt = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtgenmsg));
+	rt->rtgen_family = AF_UNSPEC;
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+		return -1;
+
+	do {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1)
+			return -1;
+
+		ret = mnl_cb_run(buf, ret, seq, portid, data_cb, c);
+	} while (ret > MNL_CB_STOP);
+
+	return ret;
+}
+
+static void print_link(uint32_t ifindex, const struct link *l,
+		       uint32_t changes, void *data)
+{
+	static const char *names[] = {
+		"new", "del", "name", "mtu", "operstate", "flags", "lladdr",
+		"addrs",
+	};
+	char out[INET6_ADDRSTRLEN];
+	unsigned int i;
+
+	printf("index=%u name=%s mtu=%u operstate=%u changed=", ifindex,
+	       l->name, l->mtu, l->operstate);
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (changes & (1 << i))
+			printf("%s,", names[i]);
+	}
+	for (i = 0; i < l->num_addrs; i++) {
+		inet_ntop(l->addrs[i].family, l->addrs[i].addr,
+			  out, sizeof(out));
+		printf(" %s/%u", out, l->addrs[i].prefixlen);
+	}
+	printf("\n");
+}
+
+int main(void)
+{
+	struct link_cache c = {
+		/* statistics and carrier of lower devices are not watched. */
+		.watch	= LINK_CHANGE_NEW | LINK_CHANGE_DEL |
+			  LINK_CHANGE_NAME | LINK_CHANGE_MTU |
+			  LINK_CHANGE_OPERSTATE | LINK_CHANGE_LLADDR |
+			  LINK_CHANGE_ADDRS,
+		.cb	= print_link,
+	};
+	struct mnl_socket *nl, *events;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	uint32_t i;
+	int ret;
+
+	/* subscribe before the dump, so that no change is missed. */
+	events = mnl_socket_open(NETLINK_ROUTE);
+	if (events == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+	if (mnl_socket_bind(events, RTMGRP_LINK | RTMGRP_IPV4_IFADDR |
+				    RTMGRP_IPV6_IFADDR,
+			    MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+
+	/* links first, addresses refer to them. The initial state is
+	 * printed once, not as a sequence of changes. */
+	c.cb = NULL;
+	if (link_cache_dump(&c, nl, RTM_GETLINK) < 0 ||
+	    link_cache_dump(&c, nl, RTM_GETADDR) < 0) {
+		perror("link_cache_dump");
+		exit(EXIT_FAILURE);
+	}
+	mnl_socket_close(nl);
+
+	for (i = 0; i < c.num_links; i++) {
+		if (c.links[i].present)
+			print_link(i, &c.links[i], 0, NULL);
+	}
+	c.cb = print_link;
+
+	while (1) {
+		ret = mnl_socket_recvfrom(events, buf, sizeof(buf));
+		if (ret == -1) {
+			perror("mnl_socket_recvfrom");
+			exit(EXIT_FAILURE);
+		}
+
+		ret = mnl_cb_run(buf, ret, 0, 0, data_cb, &c);
+		if (ret == -1) {
+			perror("mnl_cb_run");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	mnl_socket_close(events);
+
+	return 0;
+}
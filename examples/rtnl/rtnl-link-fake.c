@@ -0,0 +1,331 @@
+/* This example is placed in the public domain. */
+/*
+ * Runs link dumps and link changes against a fake rtnetlink endpoint that
+ * serves any number of synthetic links, so that no privileges nor kernel
+ * are required and every run gives the same results:
+ *
+ *	rtnl-link-fake dump [links]	dump and report the throughput
+ *	rtnl-link-fake intr [links]	dump that is interrupted half-way
+ *	rtnl-link-fake set [links]	set the MTU of every link, with acks
+ *	rtnl-link-fake storm [links]	event storm that overruns the socket
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+
+struct fake_links {
+	uint64_t	count;
+	uint64_t	intr_at;
+	uint32_t	mtu;
+};
+
+static void put_link(struct nlmsghdr *nlh, uint64_t idx, uint32_t mtu)
+{
+	struct ifinfomsg *ifm;
+	char name[IFNAMSIZ];
+	uint8_t hwaddr[6] = { 0x02, 0x00, idx >> 24, idx >> 16, idx >> 8, idx };
+
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct ifinfomsg));
+	ifm->ifi_family = AF_UNSPEC;
+	ifm->ifi_type = 1;	/* ARPHRD_ETHER */
+	ifm->ifi_index = idx + 1;
+	ifm->ifi_flags = IFF_UP | IFF_RUNNING;
+
+	snprintf(name, sizeof(name), "veth%llu", (unsigned long long)idx);
+	mnl_attr_put_strz(nlh, IFLA_IFNAME, name);
+	mnl_attr_put_u32(nlh, IFLA_MTU, mtu);
+	mnl_attr_put_u32(nlh, IFLA_TXQLEN, 1000);
+	mnl_attr_put_u8(nlh, IFLA_OPERSTATE, IF_OPER_UP);
+	mnl_attr_put(nlh, IFLA_ADDRESS, sizeof(hwaddr), hwaddr);
+}
+
+static int dump_link_cb(struct nlmsghdr *nlh, uint64_t idx, void *data)
+{
+	struct fake_links *links = data;
+
+	nlh->nlmsg_type = RTM_NEWLINK;
+	put_link(nlh, idx, links->mtu);
+	return MNL_CB_OK;
+}
+
+static int responder(struct mnl_fake *f, const struct nlmsghdr *nlh,
+		     void *data)
+{
+	struct fake_links *links = data;
+	const struct ifinfomsg *ifm;
+	const struct nlattr *attr;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *ev;
+
+	switch (nlh->nlmsg_type) {
+	case RTM_GETLINK:
+		if (!(nlh->nlmsg_flags & NLM_F_DUMP))
+			return -EOPNOTSUPP;
+
+		return mnl_fake_dump(f, nlh, links->count, links->intr_at,
+				     dump_link_cb, links) < 0 ? -errno : 0;
+	case RTM_SETLINK:
+		ifm = mnl_nlmsg_get_payload(nlh);
+		if (ifm->ifi_index <= 0 || ifm->ifi_index > links->count)
+			return -ENODEV;
+
+		mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
+			if (mnl_attr_get_type(attr) != IFLA_MTU)
+				continue;
+			if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0)
+				return -EINVAL;
+
+			/* notify the change, as the kernel does. */
+			ev = mnl_nlmsg_put_header(buf);
+			ev->nlmsg_type = RTM_NEWLINK;
+			put_link(ev, ifm->ifi_index - 1,
+				 mnl_attr_get_u32(attr));
+			mnl_fake_put(f, ev, ev->nlmsg_len);
+		}
+		return 0;
+	}
+	return -EOPNOTSUPP;
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	uint64_t *n = data;
+	const struct nlattr *attr;
+
+	mnl_attr_for_each(attr, nlh, sizeof(struct ifinfomsg)) {
+		if (mnl_attr_type_valid(attr, IFLA_MAX) < 0)
+			continue;
+		if (mnl_attr_get_type(attr) == IFLA_MTU &&
+		    mnl_attr_validate(attr, MNL_TYPE_U32) < 0)
+			return MNL_CB_ERROR;
+	}
+	(*n)++;
+	return MNL_CB_OK;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int dump(struct mnl_socket *nl, uint64_t *n)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	unsigned int seq, portid = mnl_socket_get_portid(nl);
+	struct nlmsghdr *nlh;
+	struct rtgenmsg *rt;
+	int ret;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= RTM_GETLINK;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = time(NULL);
+	rt = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtgenmsg));
+	rt->rtgen_family = AF_PACKET;
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+		return -1;
+
+	*n = 0;
+	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	while (ret > 0) {
+		ret = mnl_cb_run(buf, ret, seq, portid, data_cb, n);
+		if (ret <= MNL_CB_STOP)
+			break;
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	}
+	return ret;
+}
+
+static int set_mtu(struct mnl_socket *nl, int index, uint32_t mtu,
+		   unsigned int seq)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct ifinfomsg *ifm;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = RTM_SETLINK;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nlh->nlmsg_seq = seq;
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct ifinfomsg));
+	ifm->ifi_index = index;
+	mnl_attr_put_u32(nlh, IFLA_MTU, mtu);
+
+	return mnl_socket_sendto(nl, nlh, nlh->nlmsg_len);
+}
+
+/* one ack per request, after the event that notifies the change. */
+static int set(struct mnl_socket *nl, struct fake_links *links)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	unsigned int portid = mnl_socket_get_portid(nl);
+	uint64_t i, events = 0;
+	double t;
+	int ret;
+
+	t = now();
+	for (i = 1; i <= links->count + 1; i++) {
+		if (set_mtu(nl, i, 9000, i) < 0)
+			return -1;
+
+		while ((ret = mnl_socket_recvfrom(nl, buf, sizeof(buf))) > 0) {
+			ret = mnl_cb_run(buf, ret, i, portid, data_cb, &events);
+			if (ret <= MNL_CB_STOP)
+				break;
+		}
+		if (ret == -1 && i <= links->count) {
+			perror("ack");
+			return -1;
+		}
+	}
+	t = now() - t;
+
+	/* the last request is for a link that does not exist. */
+	if (errno != ENODEV) {
+		fprintf(stderr, "unexpected error: %s\n", strerror(errno));
+		return -1;
+	}
+	printf("%llu requests, %llu events, %.0f ns/request\n",
+	       (unsigned long long)i - 1, (unsigned long long)events,
+	       t * 1e9 / (i - 1));
+	return 0;
+}
+
+/* events are dropped once 64 KBytes are queued, resync with a dump. */
+static int storm(struct mnl_fake *f, struct mnl_socket *nl,
+		 struct fake_links *links)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	uint64_t i, events = 0, n;
+	int ret, overruns = 0;
+
+	mnl_fake_set_rcvbuf(f, 65536);
+	for (i = 0; i < links->count; i++) {
+		struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+
+		nlh->nlmsg_type = RTM_NEWLINK;
+		put_link(nlh, i, 1500);
+		mnl_fake_put(f, nlh, nlh->nlmsg_len);
+	}
+	for (;;) {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1 && errno == ENOBUFS) {
+			overruns++;
+			continue;
+		}
+		if (ret == -1)
+			break;
+
+		ret = mnl_cb_run(buf, ret, 0, 0, data_cb, &events);
+		if (ret == MNL_CB_ERROR)
+			return -1;
+	}
+	if (errno != EAGAIN)
+		return -1;
+
+	printf("%llu events sent, %llu received, %d overruns\n",
+	       (unsigned long long)links->count, (unsigned long long)events,
+	       overruns);
+	if (!overruns)
+		return 0;
+
+	mnl_fake_set_rcvbuf(f, 0);
+	if (dump(nl, &n) < 0)
+		return -1;
+
+	printf("resync dump of %llu links\n", (unsigned long long)n);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fake_links links = {
+		.count		= 1000000,
+		.intr_at	= UINT64_MAX,
+		.mtu		= 1500,
+	};
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct mnl_socket *nl;
+	struct mnl_fake *f;
+	uint64_t n;
+	double t;
+	int ret;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <dump|intr|set|storm> [links]\n",
+			argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (argc > 2)
+		links.count = strtoull(argv[2], NULL, 0);
+
+	f = mnl_fake_start(NETLINK_ROUTE, responder, &links);
+	if (f == NULL) {
+		perror("mnl_fake_start");
+		exit(EXIT_FAILURE);
+	}
+	nl = mnl_fake_socket(f);
+	if (nl == NULL) {
+		perror("mnl_fake_socket");
+		exit(EXIT_FAILURE);
+	}
+
+	if (strcmp(argv[1], "dump") == 0) {
+		t = now();
+		ret = dump(nl, &n);
+		t = now() - t;
+		if (ret == -1) {
+			perror("dump");
+			exit(EXIT_FAILURE);
+		}
+		printf("%llu links in %.3f s, %.0f ns/link\n",
+		       (unsigned long long)n, t, n ? t * 1e9 / n : 0);
+	} else if (strcmp(argv[1], "intr") == 0) {
+		links.intr_at = links.count / 2;
+		ret = dump(nl, &n);
+		if (ret != -1 || errno != EINTR) {
+			fprintf(stderr, "dump was not interrupted\n");
+			exit(EXIT_FAILURE);
+		}
+		printf("dump interrupted after %llu links, retrying\n",
+		       (unsigned long long)n);
+
+		/* drop what is left of the interrupted dump. */
+		while (mnl_socket_recvfrom(nl, buf, sizeof(buf)) > 0)
+			;
+		links.intr_at = UINT64_MAX;
+		if (dump(nl, &n) == -1) {
+			perror("dump");
+			exit(EXIT_FAILURE);
+		}
+		printf("%llu links\n", (unsigned long long)n);
+	} else if (strcmp(argv[1], "set") == 0) {
+		if (set(nl, &links) < 0)
+			exit(EXIT_FAILURE);
+	} else if (strcmp(argv[1], "storm") == 0) {
+		if (storm(f, nl, &links) < 0) {
+			perror("storm");
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		fprintf(stderr, "unknown command `%s'\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
+	mnl_socket_close(nl);
+	mnl_fake_stop(f);
+
+	return 0;
+}
@@ -0,0 +1,611 @@
+/* This example is placed in the public domain. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/if_addr.h>
+#include <linux/rtnetlink.h>
+#include <linux/genetlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+
+/*
+ * "record" dumps the links as rtnl-link-dump does, with a tap attached to
+ * the socket, so that the request and the replies are stored in a pcap
+ * file, which can be opened with wireshark too. "replay" feeds the replies
+ * in the capture to the same callback without a kernel, as many times as
+ * requested, to benchmark the parser. "decode" shows all the messages in
+ * the capture, including those of other buses, with the tables below.
+ */
+
+static int data_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	/* skip unsupported attribute in user-space */
+	if (mnl_attr_type_valid(attr, IFLA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case IFLA_MTU:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case IFLA_IFNAME:
+		if (mnl_attr_validate(attr, MNL_TYPE_STRING) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct nlattr *tb[IFLA_MAX+1] = {};
+	struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
+	unsigned int *count = data;
+
+	mnl_attr_parse(nlh, sizeof(*ifm), data_attr_cb, tb);
+
+	if (tb[IFLA_IFNAME] && tb[IFLA_MTU])
+		(*count)++;
+
+	return MNL_CB_OK;
+}
+
+static int print_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct nlattr *tb[IFLA_MAX+1] = {};
+	struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
+
+	mnl_attr_parse(nlh, sizeof(*ifm), data_attr_cb, tb);
+
+	printf("index=%d ", ifm->ifi_index);
+	if (tb[IFLA_MTU])
+		printf("mtu=%d ", mnl_attr_get_u32(tb[IFLA_MTU]));
+	if (tb[IFLA_IFNAME])
+		printf("name=%s", mnl_attr_get_str(tb[IFLA_IFNAME]));
+	printf("\n");
+
+	return MNL_CB_OK;
+}
+
+/*
+ * Decoder tables: rtnetlink links, addresses and routes, ctnetlink and the
+ * generic netlink controller.
+ */
+#define ATTR(t, n, ty, fl, ne)	[t] = { n, ty, fl, ne }
+
+static const struct mnl_decode_attr ifla_info_attrs[IFLA_INFO_MAX+1] = {
+	ATTR(IFLA_INFO_KIND,	"IFLA_INFO_KIND",	MNL_TYPE_STRING, 0, NULL),
+	ATTR(IFLA_INFO_DATA,	"IFLA_INFO_DATA",	MNL_TYPE_NESTED, 0, NULL),
+	ATTR(IFLA_INFO_SLAVE_KIND, "IFLA_INFO_SLAVE_KIND", MNL_TYPE_STRING, 0, NULL),
+};
+
+static const struct mnl_decode_table ifla_info_table = {
+	IFLA_INFO_MAX, ifla_info_attrs,
+};
+
+static const struct mnl_decode_attr ifla_attrs[IFLA_MAX+1] = {
+	ATTR(IFLA_ADDRESS,	"IFLA_ADDRESS",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFLA_BROADCAST,	"IFLA_BROADCAST",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFLA_IFNAME,	"IFLA_IFNAME",		MNL_TYPE_STRING, 0, NULL),
+	ATTR(IFLA_MTU,		"IFLA_MTU",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_LINK,		"IFLA_LINK",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_QDISC,	"IFLA_QDISC",		MNL_TYPE_STRING, 0, NULL),
+	ATTR(IFLA_STATS,	"IFLA_STATS",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFLA_MASTER,	"IFLA_MASTER",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_TXQLEN,	"IFLA_TXQLEN",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_MAP,		"IFLA_MAP",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFLA_OPERSTATE,	"IFLA_OPERSTATE",	MNL_TYPE_U8, 0, NULL),
+	ATTR(IFLA_LINKMODE,	"IFLA_LINKMODE",	MNL_TYPE_U8, 0, NULL),
+	ATTR(IFLA_LINKINFO,	"IFLA_LINKINFO",	MNL_TYPE_NESTED, 0,
+	     &ifla_info_table),
+	ATTR(IFLA_IFALIAS,	"IFLA_IFALIAS",		MNL_TYPE_STRING, 0, NULL),
+	ATTR(IFLA_NUM_VF,	"IFLA_NUM_VF",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_STATS64,	"IFLA_STATS64",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFLA_AF_SPEC,	"IFLA_AF_SPEC",		MNL_TYPE_NESTED, 0, NULL),
+	ATTR(IFLA_GROUP,	"IFLA_GROUP",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_PROMISCUITY,	"IFLA_PROMISCUITY",	MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_NUM_TX_QUEUES, "IFLA_NUM_TX_QUEUES",	MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_NUM_RX_QUEUES, "IFLA_NUM_RX_QUEUES",	MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_CARRIER,	"IFLA_CARRIER",		MNL_TYPE_U8, 0, NULL),
+	ATTR(IFLA_CARRIER_CHANGES, "IFLA_CARRIER_CHANGES", MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_GSO_MAX_SEGS,	"IFLA_GSO_MAX_SEGS",	MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_GSO_MAX_SIZE,	"IFLA_GSO_MAX_SIZE",	MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_XDP,		"IFLA_XDP",		MNL_TYPE_NESTED, 0, NULL),
+	ATTR(IFLA_MIN_MTU,	"IFLA_MIN_MTU",		MNL_TYPE_U32, 0, NULL),
+	ATTR(IFLA_MAX_MTU,	"IFLA_MAX_MTU",		MNL_TYPE_U32, 0, NULL),
+};
+
+static const struct mnl_decode_table ifla_table = {
+	IFLA_MAX, ifla_attrs,
+};
+
+static const struct mnl_decode_attr ifa_attrs[IFA_MAX+1] = {
+	ATTR(IFA_ADDRESS,	"IFA_ADDRESS",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFA_LOCAL,		"IFA_LOCAL",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFA_LABEL,		"IFA_LABEL",		MNL_TYPE_STRING, 0, NULL),
+	ATTR(IFA_BROADCAST,	"IFA_BROADCAST",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFA_CACHEINFO,	"IFA_CACHEINFO",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(IFA_FLAGS,		"IFA_FLAGS",		MNL_TYPE_U32,
+	     MNL_DECODE_F_HEX, NULL),
+};
+
+static const struct mnl_decode_table ifa_table = {
+	IFA_MAX, ifa_attrs,
+};
+
+static const struct mnl_decode_attr rta_attrs[RTA_MAX+1] = {
+	ATTR(RTA_DST,		"RTA_DST",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(RTA_SRC,		"RTA_SRC",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(RTA_IIF,		"RTA_IIF",		MNL_TYPE_U32, 0, NULL),
+	ATTR(RTA_OIF,		"RTA_OIF",		MNL_TYPE_U32, 0, NULL),
+	ATTR(RTA_GATEWAY,	"RTA_GATEWAY",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(RTA_PRIORITY,	"RTA_PRIORITY",		MNL_TYPE_U32, 0, NULL),
+	ATTR(RTA_PREFSRC,	"RTA_PREFSRC",		MNL_TYPE_BINARY, 0, NULL),
+	ATTR(RTA_METRICS,	"RTA_METRICS",		MNL_TYPE_NESTED, 0, NULL),
+	ATTR(RTA_MULTIPATH,	"RTA_MULTIPATH",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(RTA_TABLE,		"RTA_TABLE",		MNL_TYPE_U32, 0, NULL),
+	ATTR(RTA_MARK,		"RTA_MARK",		MNL_TYPE_U32,
+	     MNL_DECODE_F_HEX, NULL),
+	ATTR(RTA_PREF,		"RTA_PREF",		MNL_TYPE_U8, 0, NULL),
+};
+
+static const struct mnl_decode_table rta_table = {
+	RTA_MAX, rta_attrs,
+};
+
+static const struct mnl_decode_msg rtnl_msgs[] = {
+	{ RTM_NEWLINK,	"RTM_NEWLINK",	sizeof(struct ifinfomsg), &ifla_table },
+	{ RTM_DELLINK,	"RTM_DELLINK",	sizeof(struct ifinfomsg), &ifla_table },
+	{ RTM_GETLINK,	"RTM_GETLINK",	sizeof(struct ifinfomsg), &ifla_table },
+	{ RTM_SETLINK,	"RTM_SETLINK",	sizeof(struct ifinfomsg), &ifla_table },
+	{ RTM_NEWADDR,	"RTM_NEWADDR",	sizeof(struct ifaddrmsg), &ifa_table },
+	{ RTM_DELADDR,	"RTM_DELADDR",	sizeof(struct ifaddrmsg), &ifa_table },
+	{ RTM_GETADDR,	"RTM_GETADDR",	sizeof(struct ifaddrmsg), &ifa_table },
+	{ RTM_NEWROUTE,	"RTM_NEWROUTE",	sizeof(struct rtmsg), &rta_table },
+	{ RTM_DELROUTE,	"RTM_DELROUTE",	sizeof(struct rtmsg), &rta_table },
+	{ RTM_GETROUTE,	"RTM_GETROUTE",	sizeof(struct rtmsg), &rta_table },
+};
+
+/* ctnetlink sends its integers in network byte order. */
+#define BE	MNL_DECODE_F_BE
+
+static const struct mnl_decode_attr cta_ip_attrs[CTA_IP_MAX+1] = {
+	ATTR(CTA_IP_V4_SRC,	"CTA_IP_V4_SRC",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(CTA_IP_V4_DST,	"CTA_IP_V4_DST",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(CTA_IP_V6_SRC,	"CTA_IP_V6_SRC",	MNL_TYPE_BINARY, 0, NULL),
+	ATTR(CTA_IP_V6_DST,	"CTA_IP_V6_DST",	MNL_TYPE_BINARY, 0, NULL),
+};
+
+static const struct mnl_decode_table cta_ip_table = {
+	CTA_IP_MAX, cta_ip_attrs,
+};
+
+static const struct mnl_decode_attr cta_proto_attrs[CTA_PROTO_MAX+1] = {
+	ATTR(CTA_PROTO_NUM,	"CTA_PROTO_NUM",	MNL_TYPE_U8, 0, NULL),
+	ATTR(CTA_PROTO_SRC_PORT, "CTA_PROTO_SRC_PORT",	MNL_TYPE_U16, BE, NULL),
+	ATTR(CTA_PROTO_DST_PORT, "CTA_PROTO_DST_PORT",	MNL_TYPE_U16, BE, NULL),
+	ATTR(CTA_PROTO_ICMP_ID,	"CTA_PROTO_ICMP_ID",	MNL_TYPE_U16, BE, NULL),
+	ATTR(CTA_PROTO_ICMP_TYPE, "CTA_PROTO_ICMP_TYPE", MNL_TYPE_U8, 0, NULL),
+	ATTR(CTA_PROTO_ICMP_CODE, "CTA_PROTO_ICMP_CODE", MNL_TYPE_U8, 0, NULL),
+};
+
+static const struct mnl_decode_table cta_proto_table = {
+	CTA_PROTO_MAX, cta_proto_attrs,
+};
+
+static const struct mnl_decode_attr cta_tuple_attrs[CTA_TUPLE_MAX+1] = {
+	ATTR(CTA_TUPLE_IP,	"CTA_TUPLE_IP",		MNL_TYPE_NESTED, 0,
+	     &cta_ip_table),
+	ATTR(CTA_TUPLE_PROTO,	"CTA_TUPLE_PROTO",	MNL_TYPE_NESTED, 0,
+	     &cta_proto_table),
+};
+
+static const struct mnl_decode_table cta_tuple_table = {
+	CTA_TUPLE_MAX, cta_tuple_attrs,
+};
+
+static const struct mnl_decode_attr cta_counters_attrs[CTA_COUNTERS_MAX+1] = {
+	ATTR(CTA_COUNTERS_PACKETS, "CTA_COUNTERS_PACKETS", MNL_TYPE_U64, BE, NULL),
+	ATTR(CTA_COUNTERS_BYTES, "CTA_COUNTERS_BYTES",	MNL_TYPE_U64, BE, NULL),
+};
+
+static const struct mnl_decode_table cta_counters_table = {
+	CTA_COUNTERS_MAX, cta_counters_attrs,
+};
+
+static const struct mnl_decode_attr cta_attrs[CTA_MAX+1] = {
+	ATTR(CTA_TUPLE_ORIG,	"CTA_TUPLE_ORIG",	MNL_TYPE_NESTED, 0,
+	     &cta_tuple_table),
+	ATTR(CTA_TUPLE_REPLY,	"CTA_TUPLE_REPLY",	MNL_TYPE_NESTED, 0,
+	     &cta_tuple_table),
+	ATTR(CTA_STATUS,	"CTA_STATUS",		MNL_TYPE_U32,
+	     BE | MNL_DECODE_F_HEX, NULL),
+	ATTR(CTA_PROTOINFO,	"CTA_PROTOINFO",	MNL_TYPE_NESTED, 0, NULL),
+	ATTR(CTA_TIMEOUT,	"CTA_TIMEOUT",		MNL_TYPE_U32, BE, NULL),
+	ATTR(CTA_MARK,		"CTA_MARK",		MNL_TYPE_U32,
+	     BE | MNL_DECODE_F_HEX, NULL),
+	ATTR(CTA_COUNTERS_ORIG,	"CTA_COUNTERS_ORIG",	MNL_TYPE_NESTED, 0,
+	     &cta_counters_table),
+	ATTR(CTA_COUNTERS_REPLY, "CTA_COUNTERS_REPLY",	MNL_TYPE_NESTED, 0,
+	     &cta_counters_table),
+	ATTR(CTA_USE,		"CTA_USE",		MNL_TYPE_U32, BE, NULL),
+	ATTR(CTA_ID,		"CTA_ID",		MNL_TYPE_U32, BE, NULL),
+	ATTR(CTA_ZONE,		"CTA_ZONE",		MNL_TYPE_U16, BE, NULL),
+	ATTR(CTA_SECMARK,	"CTA_SECMARK",		MNL_TYPE_U32, BE, NULL),
+	ATTR(CTA_TIMESTAMP,	"CTA_TIMESTAMP",	MNL_TYPE_NESTED, 0, NULL),
+	ATTR(CTA_MARK_MASK,	"CTA_MARK_MASK",	MNL_TYPE_U32,
+	     BE | MNL_DECODE_F_HEX, NULL),
+	ATTR(CTA_LABELS,	"CTA_LABELS",		MNL_TYPE_BINARY, 0, NULL),
+};
+
+static const struct mnl_decode_table cta_table = {
+	CTA_MAX, cta_attrs,
+};
+
+#define CT_MSG(t)	((NFNL_SUBSYS_CTNETLINK << 8) | (t))
+
+static const struct mnl_decode_msg ctnl_msgs[] = {
+	{ CT_MSG(IPCTNL_MSG_CT_NEW), "IPCTNL_MSG_CT_NEW",
+	  sizeof(struct nfgenmsg), &cta_table },
+	{ CT_MSG(IPCTNL_MSG_CT_GET), "IPCTNL_MSG_CT_GET",
+	  sizeof(struct nfgenmsg), &cta_table },
+	{ CT_MSG(IPCTNL_MSG_CT_DELETE), "IPCTNL_MSG_CT_DELETE",
+	  sizeof(struct nfgenmsg), &cta_table },
+	{ CT_MSG(IPCTNL_MSG_CT_GET_CTRZERO), "IPCTNL_MSG_CT_GET_CTRZERO",
+	  sizeof(struct nfgenmsg), &cta_table },
+};
+
+static const struct mnl_decode_attr ctrl_op_attrs[CTRL_ATTR_OP_MAX+1] = {
+	ATTR(CTRL_ATTR_OP_ID,	"CTRL_ATTR_OP_ID",	MNL_TYPE_U32, 0, NULL),
+	ATTR(CTRL_ATTR_OP_FLAGS, "CTRL_ATTR_OP_FLAGS",	MNL_TYPE_U32,
+	     MNL_DECODE_F_HEX, NULL),
+};
+
+static const struct mnl_decode_table ctrl_op_table = {
+	CTRL_ATTR_OP_MAX, ctrl_op_attrs,
+};
+
+static const struct mnl_decode_attr ctrl_grp_attrs[CTRL_ATTR_MCAST_GRP_MAX+1] = {
+	ATTR(CTRL_ATTR_MCAST_GRP_NAME, "CTRL_ATTR_MCAST_GRP_NAME",
+	     MNL_TYPE_STRING, 0, NULL),
+	ATTR(CTRL_ATTR_MCAST_GRP_ID, "CTRL_ATTR_MCAST_GRP_ID",
+	     MNL_TYPE_U32, 0, NULL),
+};
+
+static const struct mnl_decode_table ctrl_grp_table = {
+	CTRL_ATTR_MCAST_GRP_MAX, ctrl_grp_attrs,
+};
+
+static const struct mnl_decode_attr ctrl_attrs[CTRL_ATTR_MAX+1] = {
+	ATTR(CTRL_ATTR_FAMILY_ID, "CTRL_ATTR_FAMILY_ID", MNL_TYPE_U16, 0, NULL),
+	ATTR(CTRL_ATTR_FAMILY_NAME, "CTRL_ATTR_FAMILY_NAME",
+	     MNL_TYPE_STRING, 0, NULL),
+	ATTR(CTRL_ATTR_VERSION,	"CTRL_ATTR_VERSION",	MNL_TYPE_U32, 0, NULL),
+	ATTR(CTRL_ATTR_HDRSIZE,	"CTRL_ATTR_HDRSIZE",	MNL_TYPE_U32, 0, NULL),
+	ATTR(CTRL_ATTR_MAXATTR,	"CTRL_ATTR_MAXATTR",	MNL_TYPE_U32, 0, NULL),
+	ATTR(CTRL_ATTR_OPS,	"CTRL_ATTR_OPS",	MNL_TYPE_NESTED,
+	     MNL_DECODE_F_ARRAY, &ctrl_op_table),
+	ATTR(CTRL_ATTR_MCAST_GROUPS, "CTRL_ATTR_MCAST_GROUPS", MNL_TYPE_NESTED,
+	     MNL_DECODE_F_ARRAY, &ctrl_grp_table),
+};
+
+static const struct mnl_decode_table ctrl_table = {
+	CTRL_ATTR_MAX, ctrl_attrs,
+};
+
+static const struct mnl_decode_msg genl_msgs[] = {
+	{ GENL_ID_CTRL,	"GENL_ID_CTRL",	GENL_HDRLEN, &ctrl_table },
+};
+
+static struct mnl_decoder *decoder_start(enum mnl_decode_mode mode,
+					 const struct mnl_decode_msg *msgs,
+					 unsigned int n)
+{
+	struct mnl_decoder *d = mnl_decoder_start(mode);
+
+	if (d == NULL || mnl_decoder_add(d, msgs, n) < 0) {
+		perror("mnl_decoder_start");
+		exit(EXIT_FAILURE);
+	}
+	return d;
+}
+
+static int record(const char *path)
+{
+	struct mnl_socket *nl;
+	struct mnl_tap *tap;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct rtgenmsg *rt;
+	int ret, fd;
+	unsigned int seq, portid;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open");
+		exit(EXIT_FAILURE);
+	}
+
+	tap = mnl_tap_start(fd, 256 * 1024);
+	if (tap == NULL) {
+		perror("mnl_tap_start");
+		exit(EXIT_FAILURE);
+	}
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= RTM_GETLINK;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = time(NULL);
+	rt = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtgenmsg));
+	rt->rtgen_family = AF_PACKET;
+
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+	portid = mnl_socket_get_portid(nl);
+
+	if (mnl_socket_set_tap(nl, tap) < 0) {
+		perror("mnl_socket_set_tap");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+		perror("mnl_socket_sendto");
+		exit(EXIT_FAILURE);
+	}
+
+	ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	while (ret > 0) {
+		ret = mnl_cb_run(buf, ret, seq, portid, print_cb, NULL);
+		if (ret <= MNL_CB_STOP)
+			break;
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	}
+	if (ret == -1) {
+		perror("error");
+		exit(EXIT_FAILURE);
+	}
+
+	mnl_socket_set_tap(nl, NULL);
+	mnl_socket_close(nl);
+
+	if (mnl_tap_flush(tap) < 0) {
+		perror("mnl_tap_flush");
+		exit(EXIT_FAILURE);
+	}
+	mnl_tap_stop(tap);
+	close(fd);
+
+	return 0;
+}
+
+/* feeds the replies of rtnetlink in the capture to the callback. */
+static void replay_pass(struct mnl_tap_replay *r, mnl_cb_t cb, void *data)
+{
+	struct mnl_tap_info info;
+	const void *buf;
+
+	mnl_tap_replay_rewind(r);
+	while ((buf = mnl_tap_replay_next(r, &info)) != NULL) {
+		if (info.protocol != NETLINK_ROUTE || info.dir != MNL_TAP_RECV)
+			continue;
+
+		/* the port id and the sequence number are those of the
+		 * recording, do not check them. */
+		if (mnl_cb_run(buf, info.len, 0, 0, cb, data) == -1) {
+			perror("mnl_cb_run");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (errno) {
+		perror("mnl_tap_replay_next");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static int replay(const char *path, unsigned int iterations)
+{
+	struct mnl_tap_replay *r;
+	struct timespec start, end;
+	struct stat st;
+	unsigned int i, count = 0;
+	double secs;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror("open");
+		exit(EXIT_FAILURE);
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+
+	r = mnl_tap_replay_start(data, st.st_size);
+	if (r == NULL) {
+		perror("mnl_tap_replay_start");
+		exit(EXIT_FAILURE);
+	}
+
+	/* the links are printed once, out of the measurement. */
+	replay_pass(r, print_cb, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 1; i < iterations; i++)
+		replay_pass(r, data_cb, &count);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (iterations > 1)
+		printf("%u messages in %.3f s, %.0f messages/s\n", count,
+		       secs, count / secs);
+
+	mnl_tap_replay_stop(r);
+	munmap(data, st.st_size);
+	close(fd);
+
+	return 0;
+}
+
+static void print_raw(const void *buf, size_t len, uint16_t dir,
+		      enum mnl_decode_mode mode)
+{
+	const uint8_t *p = buf;
+	size_t i;
+
+	if (mode == MNL_DECODE_TEXT)
+		printf("%s len=%zu payload=\"", dir == MNL_TAP_SEND ? ">" : "<",
+		       len);
+	else
+		printf("{\"len\":%zu,\"payload\":\"", len);
+
+	for (i = 0; i < len; i++)
+		printf("%02x", p[i]);
+
+	fputs(mode == MNL_DECODE_TEXT ? "\"\n" : "\"}\n", stdout);
+}
+
+static int decode(const char *path, enum mnl_decode_mode mode)
+{
+	struct mnl_decoder *rtnl, *ctnl, *genl, *other, *d;
+	struct mnl_tap_replay *r;
+	struct mnl_tap_info info;
+	struct stat st;
+	const void *buf;
+	char *out;
+	size_t out_size = 1 << 20, len;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror("open");
+		exit(EXIT_FAILURE);
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+
+	r = mnl_tap_replay_start(data, st.st_size);
+	if (r == NULL) {
+		perror("mnl_tap_replay_start");
+		exit(EXIT_FAILURE);
+	}
+
+	out = malloc(out_size);
+	if (out == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* message types overlap between buses, one decoder per bus. */
+	rtnl = decoder_start(mode, rtnl_msgs, MNL_ARRAY_SIZE(rtnl_msgs));
+	ctnl = decoder_start(mode, ctnl_msgs, MNL_ARRAY_SIZE(ctnl_msgs));
+	genl = decoder_start(mode, genl_msgs, MNL_ARRAY_SIZE(genl_msgs));
+	other = decoder_start(mode, NULL, 0);
+
+	while ((buf = mnl_tap_replay_next(r, &info)) != NULL) {
+		const struct nlmsghdr *nlh = buf;
+		int left = info.len;
+
+		switch (info.protocol) {
+		case NETLINK_ROUTE:
+			d = rtnl;
+			break;
+		case NETLINK_NETFILTER:
+			d = ctnl;
+			break;
+		case NETLINK_GENERIC:
+			d = genl;
+			break;
+		default:
+			d = other;
+			break;
+		}
+
+		/* not netlink messages, eg. uevents: show the bytes. */
+		if (!mnl_nlmsg_ok(nlh, left)) {
+			print_raw(buf, info.len, info.dir, mode);
+			continue;
+		}
+
+		for (; mnl_nlmsg_ok(nlh, left); nlh = mnl_nlmsg_next(nlh, &left)) {
+			len = mnl_decoder_nlmsg(d, nlh, out, out_size);
+			if (len >= out_size)
+				len = out_size - 1;
+
+			if (mode == MNL_DECODE_TEXT)
+				fputs(info.dir == MNL_TAP_SEND ? "> " : "< ",
+				      stdout);
+			out[len++] = '\n';
+			fwrite(out, 1, len, stdout);
+		}
+	}
+	if (errno) {
+		perror("mnl_tap_replay_next");
+		exit(EXIT_FAILURE);
+	}
+
+	mnl_decoder_stop(rtnl);
+	mnl_decoder_stop(ctnl);
+	mnl_decoder_stop(genl);
+	mnl_decoder_stop(other);
+	mnl_tap_replay_stop(r);
+	free(out);
+	munmap(data, st.st_size);
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && strcmp(argv[1], "record") == 0)
+		return record(argv[2]);
+	if ((argc == 3 || argc == 4) && strcmp(argv[1], "replay") == 0)
+		return replay(argv[2], argc == 4 ? atoi(argv[3]) : 1);
+	if (argc == 3 && strcmp(argv[1], "decode") == 0)
+		return decode(argv[2], MNL_DECODE_TEXT);
+	if (argc == 4 && strcmp(argv[1], "decode") == 0 &&
+	    strcmp(argv[3], "json") == 0)
+		return decode(argv[2], MNL_DECODE_JSON);
+
+	fprintf(stderr, "Usage: %s record <file>\n"
+			"       %s replay <file> [iterations]\n"
+			"       %s decode <file> [json]\n",
+		argv[0], argv[0], argv[0]);
+	exit(EXIT_FAILURE);
+}
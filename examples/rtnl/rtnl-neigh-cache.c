@@ -0,0 +1,477 @@
+/* This example is placed in the public domain. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+/*
+ * Neighbor cache: a mirror of the ARP and ND tables that is built from a
+ * dump and kept up to date with RTM_NEWNEIGH and RTM_DELNEIGH events.
+ *
+ * Neighbors are stored in an open-addressing hash table with linear probing,
+ * keyed by interface index, family and address. The table does not grow,
+ * so that readers never see it move: its size is set at start. Deleted
+ * neighbors leave a dead entry that keeps its key, so that the probe
+ * sequences of other neighbors are not broken, and the entry is revived if
+ * the neighbor shows up again, which is the common case. Dead entries of
+ * other neighbors are only reused for new ones.
+ *
+ * There is one writer, the thread that handles the events, and any number
+ * of lock-free readers. Each entry is protected by a sequence counter that
+ * is odd while the writer updates it: readers copy the entry and retry if
+ * the counter was odd or has changed meanwhile.
+ */
+
+#define NEIGH_ADDR_LEN		16
+#define NEIGH_LLADDR_LEN	32
+
+enum neigh_status {
+	NEIGH_EMPTY,
+	NEIGH_LIVE,
+	NEIGH_DEAD,
+};
+
+struct neigh_info {
+	uint32_t	ifindex;
+	uint8_t		family;
+	uint8_t		flags;
+	uint16_t	state;
+	uint8_t		addr[NEIGH_ADDR_LEN];
+	uint8_t		lladdr[NEIGH_LLADDR_LEN];
+	uint8_t		lladdr_len;
+};
+
+struct neigh {
+	_Atomic uint32_t	seq;
+	uint8_t			status;
+	struct neigh_info	info;
+};
+
+/* NUD_NONE, then one counter per NUD_* bit, see neigh_state_index(). */
+#define NEIGH_STATES	9
+
+static const char *neigh_state_names[NEIGH_STATES] = {
+	"none", "incomplete", "reachable", "stale", "delay",
+	"probe", "failed", "noarp", "permanent",
+};
+
+struct neigh_cache {
+	struct neigh		*slots;
+	uint32_t		mask;
+	/* slots that are not empty, dead ones included. */
+	uint32_t		used;
+	_Atomic uint32_t	counters[NEIGH_STATES];
+};
+
+static struct neigh_cache *neigh_cache_alloc(uint32_t size)
+{
+	struct neigh_cache *c;
+
+	c = calloc(1, sizeof(struct neigh_cache));
+	if (c == NULL)
+		return NULL;
+
+	/* size must be a power of two. */
+	c->slots = calloc(size, sizeof(struct neigh));
+	if (c->slots == NULL) {
+		free(c);
+		return NULL;
+	}
+	c->mask = size - 1;
+	return c;
+}
+
+static void neigh_cache_free(struct neigh_cache *c)
+{
+	free(c->slots);
+	free(c);
+}
+
+static uint32_t neigh_hash(uint32_t ifindex, uint8_t family,
+			   const uint8_t *addr)
+{
+	uint32_t w[NEIGH_ADDR_LEN / 4], h = ifindex ^ (family << 24);
+	int i;
+
+	memcpy(w, addr, sizeof(w));
+	for (i = 0; i < NEIGH_ADDR_LEN / 4; i++) {
+		h ^= w[i];
+		h *= 0x9e3779b1;
+		h ^= h >> 15;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
+
+static bool neigh_match(const struct neigh_info *info, uint32_t ifindex,
+			uint8_t family, const uint8_t *addr)
+{
+	return info->ifindex == ifindex && info->family == family &&
+	       memcmp(info->addr, addr, NEIGH_ADDR_LEN) == 0;
+}
+
+static int neigh_state_index(uint16_t state)
+{
+	return state ? ffs(state & 0xff) : 0;
+}
+
+/*
+ * Reader side.
+ */
+
+/* copy one entry, consistently. */
+static uint8_t neigh_read(const struct neigh *n, struct neigh_info *info)
+{
+	uint32_t seq;
+	uint8_t status;
+
+	do {
+		seq = atomic_load_explicit(&n->seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+
+		status = n->status;
+		memcpy(info, &n->info, sizeof(*info));
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) ||
+		 seq != atomic_load_explicit(&n->seq, memory_order_relaxed));
+
+	return status;
+}
+
+/* addr is in network byte order, padded with zeroes to 16 bytes. */
+static bool neigh_cache_lookup(const struct neigh_cache *c, uint32_t ifindex,
+			       uint8_t family, const uint8_t *addr,
+			       struct neigh_info *info)
+{
+	uint32_t i = neigh_hash(ifindex, family, addr) & c->mask, n;
+	uint8_t status;
+
+	for (n = 0; n <= c->mask; n++, i = (i + 1) & c->mask) {
+		status = neigh_read(&c->slots[i], info);
+		if (status == NEIGH_EMPTY)
+			return false;
+		if (neigh_match(info, ifindex, family, addr))
+			return status == NEIGH_LIVE;
+	}
+	return false;
+}
+
+static uint32_t neigh_cache_count(const struct neigh_cache *c, int index)
+{
+	return atomic_load_explicit(&c->counters[index], memory_order_relaxed);
+}
+
+/*
+ * Writer side.
+ */
+
+static void neigh_write(struct neigh_cache *c, struct neigh *n,
+			uint8_t status, const struct neigh_info *info)
+{
+	if (n->status == NEIGH_LIVE) {
+		atomic_fetch_sub_explicit(&c->counters[neigh_state_index(n->info.state)],
+					  1, memory_order_relaxed);
+	}
+	if (status == NEIGH_LIVE) {
+		atomic_fetch_add_explicit(&c->counters[neigh_state_index(info->state)],
+					  1, memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&n->seq, n->seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	n->status = status;
+	n->info = *info;
+	atomic_store_explicit(&n->seq, n->seq + 1, memory_order_release);
+}
+
+static int neigh_cache_update(struct neigh_cache *c,
+			      const struct neigh_info *info, bool del)
+{
+	uint32_t i = neigh_hash(info->ifindex, info->family, info->addr) &
+		     c->mask, n;
+	struct neigh *dead = NULL;
+
+	for (n = 0; n <= c->mask; n++, i = (i + 1) & c->mask) {
+		struct neigh *cur = &c->slots[i];
+
+		if (cur->status == NEIGH_EMPTY)
+			break;
+
+		if (neigh_match(&cur->info, info->ifindex, info->family,
+				info->addr)) {
+			/* the dead entry keeps the key, not the rest. */
+			neigh_write(c, cur, del ? NEIGH_DEAD : NEIGH_LIVE,
+				    del ? &cur->info : info);
+			return 0;
+		}
+		if (cur->status == NEIGH_DEAD && dead == NULL)
+			dead = cur;
+	}
+	if (del)
+		return 0;
+
+	if (dead == NULL) {
+		/* keep some empty slots, so that probe sequences end. */
+		if (c->used + 1 > (c->mask + 1) / 4 * 3) {
+			errno = ENOSPC;
+			return -1;
+		}
+		dead = &c->slots[i];
+		c->used++;
+	}
+	neigh_write(c, dead, NEIGH_LIVE, info);
+	return 0;
+}
+
+/*
+ * Netlink side.
+ */
+
+static int data_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	/* skip unsupported attribute in user-space */
+	if (mnl_attr_type_valid(attr, NDA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case NDA_DST:
+	case NDA_LLADDR:
+		if (mnl_attr_validate(attr, MNL_TYPE_BINARY) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct neigh_cache *c = data;
+	struct nlattr *tb[NDA_MAX + 1] = {};
+	struct ndmsg *ndm = mnl_nlmsg_get_payload(nlh);
+	struct neigh_info info = {};
+	uint16_t len;
+
+	if (ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6)
+		return MNL_CB_OK;
+
+	mnl_attr_parse(nlh, sizeof(*ndm), data_attr_cb, tb);
+	if (!tb[NDA_DST])
+		return MNL_CB_OK;
+
+	info.ifindex = ndm->ndm_ifindex;
+	info.family = ndm->ndm_family;
+	info.state = ndm->ndm_state;
+	info.flags = ndm->ndm_flags;
+
+	len = mnl_attr_get_payload_len(tb[NDA_DST]);
+	if (len > NEIGH_ADDR_LEN)
+		return MNL_CB_OK;
+	memcpy(info.addr, mnl_attr_get_payload(tb[NDA_DST]), len);
+
+	if (tb[NDA_LLADDR]) {
+		len = mnl_attr_get_payload_len(tb[NDA_LLADDR]);
+		if (len > NEIGH_LLADDR_LEN)
+			len = NEIGH_LLADDR_LEN;
+		memcpy(info.lladdr, mnl_attr_get_payload(tb[NDA_LLADDR]), len);
+		info.lladdr_len = len;
+	}
+
+	if (neigh_cache_update(c, &info, nlh->nlmsg_type == RTM_DELNEIGH) < 0) {
+		perror("neigh_cache_update");
+		return MNL_CB_ERROR;
+	}
+	return MNL_CB_OK;
+}
+
+static int neigh_cache_dump(struct neigh_cache *c)
+{
+	struct mnl_socket *nl;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct rtgenmsg *rt;
+	unsigned int seq, portid;
+	int ret;
+
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (nl == NULL)
+		return -1;
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0)
+		goto err;
+
+	portid = mnl_socket_get_portid(nl);
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type	= RTM_GETNEIGH;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = time(NULL);
+	/* both IPv4 and IPv6 neighbors. */
+	rt = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtgenmsg));
+	rt->rtgen_family = AF_UNSPEC;
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+		goto err;
+
+	do {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1)
+			goto err;
+
+		ret = mnl_cb_run(buf, ret, seq, portid, data_cb, c);
+	} while (ret > MNL_CB_STOP);
+
+	mnl_socket_close(nl);
+	return ret;
+err:
+	mnl_socket_close(nl);
+	return -1;
+}
+
+struct reader_args {
+	struct neigh_cache	*cache;
+	int			num_args;
+	char			**args;
+};
+
+static void print_neigh(const char *name, const struct neigh_info *info)
+{
+	char out[INET6_ADDRSTRLEN];
+	int i;
+
+	inet_ntop(info->family, info->addr, out, sizeof(out));
+	printf("%s dev %s lladdr ", out, name);
+	for (i = 0; i < info->lladdr_len; i++)
+		printf("%s%02x", i ? ":" : "", info->lladdr[i]);
+	printf(" %s\n", neigh_state_names[neigh_state_index(info->state)]);
+}
+
+/* a data-plane thread: it looks up the neighbors once per second. */
+static void *reader_thread(void *data)
+{
+	struct reader_args *args = data;
+	struct neigh_cache *c = args->cache;
+	int i;
+
+	for (;;) {
+		for (i = 0; i + 1 < args->num_args; i += 2) {
+			uint8_t addr[NEIGH_ADDR_LEN] = {};
+			struct neigh_info info;
+			uint32_t ifindex;
+			uint8_t family;
+
+			ifindex = if_nametoindex(args->args[i]);
+			if (inet_pton(AF_INET, args->args[i + 1], addr) == 1)
+				family = AF_INET;
+			else if (inet_pton(AF_INET6, args->args[i + 1], addr) == 1)
+				family = AF_INET6;
+			else
+				continue;
+
+			if (neigh_cache_lookup(c, ifindex, family, addr, &info))
+				print_neigh(args->args[i], &info);
+			else
+				printf("%s dev %s not found\n",
+				       args->args[i + 1], args->args[i]);
+		}
+
+		for (i = 0; i < NEIGH_STATES; i++) {
+			uint32_t count = neigh_cache_count(c, i);
+
+			if (count)
+				printf("%s=%u ", neigh_state_names[i], count);
+		}
+		printf("\n");
+
+		sleep(1);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct mnl_socket *nl;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct reader_args args;
+	struct neigh_cache *c;
+	pthread_t thread;
+	int ret;
+
+	if (argc % 2 != 1) {
+		fprintf(stderr, "Usage: %s [<ifname> <address>]...\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* room for about 190k neighbors. */
+	c = neigh_cache_alloc(1 << 18);
+	if (c == NULL) {
+		perror("neigh_cache_alloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* subscribe before the dump, so that no change is missed. */
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+	if (mnl_socket_bind(nl, RTMGRP_NEIGH, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+
+	if (neigh_cache_dump(c) < 0) {
+		perror("neigh_cache_dump");
+		exit(EXIT_FAILURE);
+	}
+
+	args.cache = c;
+	args.num_args = argc - 1;
+	args.args = &argv[1];
+	errno = pthread_create(&thread, NULL, reader_thread, &args);
+	if (errno != 0) {
+		perror("pthread_create");
+		exit(EXIT_FAILURE);
+	}
+
+	while (1) {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1) {
+			perror("mnl_socket_recvfrom");
+			exit(EXIT_FAILURE);
+		}
+
+		ret = mnl_cb_run(buf, ret, 0, 0, data_cb, c);
+		if (ret == -1) {
+			perror("mnl_cb_run");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	mnl_socket_close(nl);
+	neigh_cache_free(c);
+
+	return 0;
+}
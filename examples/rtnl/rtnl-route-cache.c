@@ -0,0 +1,763 @@
+/* This example is placed in the public domain. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <libmnl/libmnl.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * IPv4 route cache: a mirror of the main routing table that is built from
+ * a dump and kept up to date with route events.
+ *
+ * Lookups use a DIR-24-8 table: the first 24 bits of the address index a
+ * table of 2^24 entries. If there are prefixes longer than /24 under an
+ * entry, it refers to a group of 256 entries that is indexed by the last
+ * byte of the address. Thus, a lookup takes one or two memory accesses.
+ * Both tables are allocated once, the kernel only backs the pages that are
+ * written, and the memory does not depend on the number of prefixes but on
+ * how they spread over the address space.
+ *
+ * Each entry stores the index of the next hop and the length of the prefix
+ * it comes from, so that a prefix only overwrites entries of less specific
+ * prefixes. The prefixes themselves are also kept in a hash table that is
+ * only used by the writer to find the prefix that replaces a deleted one.
+ *
+ * There is one writer, the thread that handles the events, and any number
+ * of lock-free readers. Entries are read and written atomically. A group of
+ * 256 entries that is released may still be in use by a reader, so it is
+ * only reused once all readers have gone through a quiescent state after
+ * its release (see route_cache_quiescent()).
+ */
+
+#define TBL24_SIZE		(1 << 24)
+#define TBL8_GROUP_SIZE		256
+#define TBL8_GROUPS		(1 << 14)
+#define NEXTHOPS_MAX		(1 << 16)
+#define READERS_MAX		16
+
+/* entries: prefix length plus one, zero if there is no route. */
+#define ENTRY_GROUP		0x80000000
+#define ENTRY_DEPTH(e)		(((e) >> 24) & 0x3f)
+#define ENTRY_INDEX(e)		((e) & 0xffffff)
+#define ENTRY(len, index)	((((uint32_t)(len) + 1) << 24) | (index))
+
+struct nexthop {
+	struct in_addr	gw;
+	uint32_t	oif;
+};
+
+struct prefix {
+	uint32_t	addr;
+	uint8_t		len;
+	bool		used;
+	uint32_t	nh;
+};
+
+struct route_cache_reader {
+	/* last epoch seen by this reader, UINT64_MAX if offline. */
+	_Atomic uint64_t	epoch;
+	_Atomic bool		used;
+};
+
+struct released_group {
+	uint32_t	group;
+	uint64_t	epoch;
+};
+
+struct route_cache {
+	_Atomic uint32_t	*tbl24;
+	_Atomic uint32_t	*tbl8;
+
+	/* next hops, they are never released. */
+	struct nexthop		*nexthops;
+	uint32_t		num_nexthops;
+
+	/* prefixes, open addressing with linear probing. */
+	struct prefix		*prefixes;
+	uint32_t		prefixes_mask;
+	uint32_t		num_prefixes;
+
+	/* groups that were never used, then released ones, oldest first. */
+	uint32_t		next_group;
+	struct released_group	released[TBL8_GROUPS];
+	uint32_t		released_head;
+	uint32_t		num_released;
+
+	_Atomic uint64_t	epoch;
+	struct route_cache_reader readers[READERS_MAX];
+};
+
+static struct route_cache *route_cache_alloc(void)
+{
+	struct route_cache *c;
+
+	c = calloc(1, sizeof(struct route_cache));
+	if (c == NULL)
+		return NULL;
+
+	c->tbl24 = calloc(TBL24_SIZE, sizeof(uint32_t));
+	c->tbl8 = calloc(TBL8_GROUPS * TBL8_GROUP_SIZE, sizeof(uint32_t));
+	c->nexthops = calloc(NEXTHOPS_MAX, sizeof(struct nexthop));
+	c->prefixes_mask = 1023;
+	c->prefixes = calloc(c->prefixes_mask + 1, sizeof(struct prefix));
+	if (!c->tbl24 || !c->tbl8 || !c->nexthops || !c->prefixes) {
+		free(c->tbl24);
+		free(c->tbl8);
+		free(c->nexthops);
+		free(c->prefixes);
+		free(c);
+		return NULL;
+	}
+	c->epoch = 1;
+	return c;
+}
+
+static void route_cache_free(struct route_cache *c)
+{
+	free(c->tbl24);
+	free(c->tbl8);
+	free(c->nexthops);
+	free(c->prefixes);
+	free(c);
+}
+
+/*
+ * Reader side.
+ */
+
+/*
+ * The reader does not hold any entry it got from previous lookups. The
+ * fence orders the store of the epoch before the loads of the next lookups,
+ * it pairs with the one in group_reusable().
+ */
+static void route_cache_quiescent(struct route_cache *c,
+				  struct route_cache_reader *r)
+{
+	atomic_store_explicit(&r->epoch,
+			      atomic_load_explicit(&c->epoch,
+						   memory_order_acquire),
+			      memory_order_release);
+	atomic_thread_fence(memory_order_seq_cst);
+}
+
+static struct route_cache_reader *
+route_cache_reader_register(struct route_cache *c)
+{
+	int i;
+
+	for (i = 0; i < READERS_MAX; i++) {
+		bool used = false;
+
+		if (atomic_compare_exchange_strong(&c->readers[i].used, &used,
+						   true)) {
+			route_cache_quiescent(c, &c->readers[i]);
+			return &c->readers[i];
+		}
+	}
+	return NULL;
+}
+
+/* the reader does not perform lookups until the next quiescent state. */
+static void route_cache_offline(struct route_cache_reader *r)
+{
+	atomic_store_explicit(&r->epoch, UINT64_MAX, memory_order_release);
+}
+
+/* returns the next hop for this address, in network byte order. */
+static const struct nexthop *
+route_cache_lookup(const struct route_cache *c, uint32_t addr)
+{
+	uint32_t e;
+
+	addr = ntohl(addr);
+	e = atomic_load_explicit(&c->tbl24[addr >> 8], memory_order_acquire);
+	if (e & ENTRY_GROUP) {
+		e = atomic_load_explicit(&c->tbl8[ENTRY_INDEX(e) * TBL8_GROUP_SIZE +
+						  (addr & 0xff)],
+					 memory_order_acquire);
+	}
+	if (ENTRY_DEPTH(e) == 0)
+		return NULL;
+
+	return &c->nexthops[ENTRY_INDEX(e)];
+}
+
+/*
+ * Writer side.
+ */
+
+static uint32_t prefix_mask(uint8_t len)
+{
+	return len ? ~0U << (32 - len) : 0;
+}
+
+static uint32_t prefix_hash(uint32_t addr, uint8_t len)
+{
+	uint32_t h = addr ^ (len * 0x9e3779b1);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static struct prefix *prefix_slot(const struct route_cache *c,
+				  uint32_t addr, uint8_t len)
+{
+	uint32_t i = prefix_hash(addr, len) & c->prefixes_mask;
+
+	while (c->prefixes[i].used &&
+	       (c->prefixes[i].addr != addr || c->prefixes[i].len != len))
+		i = (i + 1) & c->prefixes_mask;
+
+	return &c->prefixes[i];
+}
+
+static int prefix_grow(struct route_cache *c)
+{
+	struct prefix *old = c->prefixes;
+	uint32_t i, old_mask = c->prefixes_mask;
+
+	c->prefixes = calloc((old_mask + 1) * 2, sizeof(struct prefix));
+	if (c->prefixes == NULL) {
+		c->prefixes = old;
+		return -1;
+	}
+	c->prefixes_mask = (old_mask << 1) | 1;
+
+	for (i = 0; i <= old_mask; i++) {
+		if (old[i].used)
+			*prefix_slot(c, old[i].addr, old[i].len) = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+/* backward shift deletion, so that no tombstones are needed. */
+static void prefix_remove(struct route_cache *c, struct prefix *p)
+{
+	uint32_t i = p - c->prefixes, j = i, home;
+
+	for (;;) {
+		j = (j + 1) & c->prefixes_mask;
+		if (!c->prefixes[j].used)
+			break;
+
+		home = prefix_hash(c->prefixes[j].addr, c->prefixes[j].len) &
+		       c->prefixes_mask;
+		/* move it back if its home is not between i and j. */
+		if (((j - home) & c->prefixes_mask) >=
+		    ((j - i) & c->prefixes_mask)) {
+			c->prefixes[i] = c->prefixes[j];
+			i = j;
+		}
+	}
+	c->prefixes[i].used = false;
+	c->num_prefixes--;
+}
+
+static int nexthop_get(struct route_cache *c, const struct nexthop *nh)
+{
+	uint32_t i;
+
+	/* there are only a few next hops, even with many prefixes. */
+	for (i = 0; i < c->num_nexthops; i++) {
+		if (c->nexthops[i].gw.s_addr == nh->gw.s_addr &&
+		    c->nexthops[i].oif == nh->oif)
+			return i;
+	}
+	if (c->num_nexthops == NEXTHOPS_MAX)
+		return -1;
+
+	c->nexthops[c->num_nexthops] = *nh;
+	return c->num_nexthops++;
+}
+
+static bool group_reusable(const struct route_cache *c, uint64_t epoch)
+{
+	int i;
+
+	/* the group was unlinked before, see route_cache_quiescent(). */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	for (i = 0; i < READERS_MAX; i++) {
+		if (atomic_load_explicit(&c->readers[i].used,
+					 memory_order_acquire) &&
+		    atomic_load_explicit(&c->readers[i].epoch,
+					 memory_order_acquire) < epoch)
+			return false;
+	}
+	return true;
+}
+
+static int group_alloc(struct route_cache *c)
+{
+	/* released groups are sorted by epoch, check the oldest one. */
+	if (c->num_released > 0 &&
+	    group_reusable(c, c->released[c->released_head].epoch)) {
+		uint32_t group = c->released[c->released_head].group;
+
+		c->released_head = (c->released_head + 1) % TBL8_GROUPS;
+		c->num_released--;
+		return group;
+	}
+	if (c->next_group == TBL8_GROUPS)
+		return -1;
+
+	return c->next_group++;
+}
+
+static void group_release(struct route_cache *c, uint32_t group)
+{
+	struct released_group *r;
+
+	r = &c->released[(c->released_head + c->num_released++) % TBL8_GROUPS];
+
+	r->group = group;
+	/* readers that have seen this epoch do not refer to the group. */
+	r->epoch = atomic_fetch_add_explicit(&c->epoch, 1,
+					     memory_order_acq_rel) + 1;
+}
+
+/* set the entries of prefixes not longer than len to the new value. */
+static void group_add(struct route_cache *c, uint32_t group, uint32_t first,
+		      uint32_t count, uint8_t len, uint32_t value)
+{
+	_Atomic uint32_t *tbl8 = &c->tbl8[group * TBL8_GROUP_SIZE];
+	uint32_t i;
+
+	for (i = first; i < first + count; i++) {
+		if (ENTRY_DEPTH(atomic_load_explicit(&tbl8[i],
+						     memory_order_relaxed)) <=
+		    len + 1)
+			atomic_store_explicit(&tbl8[i], value,
+					      memory_order_release);
+	}
+}
+
+/* set the entries of the prefix with this length to its replacement. */
+static void group_del(struct route_cache *c, uint32_t group, uint32_t first,
+		      uint32_t count, uint8_t len, uint32_t value)
+{
+	_Atomic uint32_t *tbl8 = &c->tbl8[group * TBL8_GROUP_SIZE];
+	uint32_t i;
+
+	for (i = first; i < first + count; i++) {
+		if (ENTRY_DEPTH(atomic_load_explicit(&tbl8[i],
+						     memory_order_relaxed)) ==
+		    len + 1)
+			atomic_store_explicit(&tbl8[i], value,
+					      memory_order_release);
+	}
+}
+
+/* if no prefix longer than /24 is left in the group, release it. */
+static void group_collapse(struct route_cache *c, uint32_t index)
+{
+	uint32_t e = atomic_load_explicit(&c->tbl24[index],
+					  memory_order_relaxed);
+	uint32_t group = ENTRY_INDEX(e), i, first;
+
+	for (i = 0; i < TBL8_GROUP_SIZE; i++) {
+		e = atomic_load_explicit(&c->tbl8[group * TBL8_GROUP_SIZE + i],
+					 memory_order_relaxed);
+		if (ENTRY_DEPTH(e) > 24 + 1)
+			return;
+		/* all of them come from the same prefix. */
+		if (i == 0)
+			first = e;
+	}
+	atomic_store_explicit(&c->tbl24[index], first, memory_order_release);
+	group_release(c, group);
+}
+
+static int route_cache_update(struct route_cache *c, uint32_t addr,
+			      uint8_t len, uint32_t value, bool add)
+{
+	uint32_t i, first, count, e;
+
+	if (len <= 24) {
+		first = addr >> 8;
+		count = 1 << (24 - len);
+
+		for (i = first; i < first + count; i++) {
+			e = atomic_load_explicit(&c->tbl24[i],
+						 memory_order_relaxed);
+			if (e & ENTRY_GROUP) {
+				if (add) {
+					group_add(c, ENTRY_INDEX(e), 0,
+						  TBL8_GROUP_SIZE, len, value);
+				} else {
+					group_del(c, ENTRY_INDEX(e), 0,
+						  TBL8_GROUP_SIZE, len, value);
+				}
+			} else if ((add && ENTRY_DEPTH(e) <= len + 1) ||
+				   (!add && ENTRY_DEPTH(e) == len + 1)) {
+				atomic_store_explicit(&c->tbl24[i], value,
+						      memory_order_release);
+			}
+		}
+		return 0;
+	}
+
+	i = addr >> 8;
+	first = addr & 0xff;
+	count = 1 << (32 - len);
+
+	e = atomic_load_explicit(&c->tbl24[i], memory_order_relaxed);
+	if (!(e & ENTRY_GROUP)) {
+		int group;
+
+		/* nothing to delete. */
+		if (!add)
+			return 0;
+
+		group = group_alloc(c);
+		if (group < 0)
+			return -1;
+
+		/* fill the group before readers can see it. */
+		group_add(c, group, 0, TBL8_GROUP_SIZE, 32, e);
+		e = ENTRY_GROUP | group;
+		atomic_store_explicit(&c->tbl24[i], e, memory_order_release);
+	}
+
+	if (add) {
+		group_add(c, ENTRY_INDEX(e), first, count, len, value);
+	} else {
+		group_del(c, ENTRY_INDEX(e), first, count, len, value);
+		group_collapse(c, i);
+	}
+	return 0;
+}
+
+/* addr in host byte order, already masked. */
+static int route_cache_add(struct route_cache *c, uint32_t addr, uint8_t len,
+			   const struct nexthop *nh)
+{
+	struct prefix *p;
+	int index;
+
+	index = nexthop_get(c, nh);
+	if (index < 0)
+		return -1;
+
+	p = prefix_slot(c, addr, len);
+	if (!p->used) {
+		if (c->num_prefixes + 1 > (c->prefixes_mask + 1) / 4 * 3) {
+			if (prefix_grow(c) < 0)
+				return -1;
+
+			p = prefix_slot(c, addr, len);
+		}
+		p->addr = addr;
+		p->len = len;
+		p->used = true;
+		c->num_prefixes++;
+	}
+	p->nh = index;
+
+	return route_cache_update(c, addr, len, ENTRY(len, index), true);
+}
+
+static int route_cache_del(struct route_cache *c, uint32_t addr, uint8_t len)
+{
+	struct prefix *p;
+	uint32_t value = 0;
+	int l;
+
+	p = prefix_slot(c, addr, len);
+	if (!p->used)
+		return 0;
+
+	prefix_remove(c, p);
+
+	/* the longest prefix that covers this one takes its place. */
+	for (l = len - 1; l >= 0; l--) {
+		p = prefix_slot(c, addr & prefix_mask(l), l);
+		if (p->used) {
+			value = ENTRY(l, p->nh);
+			break;
+		}
+	}
+
+	return route_cache_update(c, addr, len, value, false);
+}
+
+/*
+ * Netlink side: only unicast routes of the main table are mirrored. Routes
+ * to the same prefix that only differ in their metric are not told apart,
+ * the last one wins.
+ */
+
+static int data_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	/* skip unsupported attribute in user-space */
+	if (mnl_attr_type_valid(attr, RTA_MAX) < 0)
+		return MNL_CB_OK;
+
+	switch(type) {
+	case RTA_TABLE:
+	case RTA_DST:
+	case RTA_OIF:
+	case RTA_GATEWAY:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			perror("mnl_attr_validate");
+			return MNL_CB_ERROR;
+		}
+		break;
+	case RTA_MULTIPATH:
+		/* struct rtnexthop, then the attributes of the next hop. */
+		if (mnl_attr_get_payload_len(attr) < sizeof(struct rtnexthop)) {
+			fprintf(stderr, "RTA_MULTIPATH is too short\n");
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+/*
+ * There is one next hop per prefix in the cache: the first one of multipath
+ * routes that is alive and well-formed is used.
+ */
+static void parse_multipath(const struct nlattr *attr, struct nexthop *nh)
+{
+	const struct rtnexthop *rtnh = mnl_attr_get_payload(attr);
+	int len = mnl_attr_get_payload_len(attr);
+
+	while (len >= (int)sizeof(*rtnh) && RTNH_OK(rtnh, len)) {
+		struct nlattr *tb[RTA_MAX+1] = {};
+
+		if (!(rtnh->rtnh_flags & (RTNH_F_DEAD | RTNH_F_LINKDOWN)) &&
+		    mnl_attr_parse_payload(RTNH_DATA(rtnh),
+					   rtnh->rtnh_len - sizeof(*rtnh),
+					   data_attr_cb, tb) >= 0) {
+			nh->oif = rtnh->rtnh_ifindex;
+			if (tb[RTA_GATEWAY])
+				nh->gw.s_addr =
+					mnl_attr_get_u32(tb[RTA_GATEWAY]);
+			return;
+		}
+		len -= RTNH_ALIGN(rtnh->rtnh_len);
+		rtnh = RTNH_NEXT(rtnh);
+	}
+}
+
+static int data_cb(const struct nlmsghdr *nlh, void *data)
+{
+	struct route_cache *c = data;
+	struct nlattr *tb[RTA_MAX+1] = {};
+	struct rtmsg *rm = mnl_nlmsg_get_payload(nlh);
+	struct nexthop nh = {};
+	uint32_t table = rm->rtm_table, addr = 0;
+	int ret;
+
+	if (rm->rtm_family != AF_INET || (rm->rtm_flags & RTM_F_CLONED))
+		return MNL_CB_OK;
+
+	/* a route that cannot be parsed is not cached with a wrong next hop. */
+	if (mnl_attr_parse(nlh, sizeof(*rm), data_attr_cb, tb) < 0)
+		return MNL_CB_OK;
+	if (tb[RTA_TABLE])
+		table = mnl_attr_get_u32(tb[RTA_TABLE]);
+	if (table != RT_TABLE_MAIN || rm->rtm_dst_len > 32)
+		return MNL_CB_OK;
+
+	if (tb[RTA_DST])
+		addr = ntohl(mnl_attr_get_u32(tb[RTA_DST]));
+	addr &= prefix_mask(rm->rtm_dst_len);
+
+	if (nlh->nlmsg_type == RTM_DELROUTE) {
+		ret = route_cache_del(c, addr, rm->rtm_dst_len);
+	} else {
+		if (rm->rtm_type != RTN_UNICAST)
+			return MNL_CB_OK;
+
+		if (tb[RTA_OIF])
+			nh.oif = mnl_attr_get_u32(tb[RTA_OIF]);
+		if (tb[RTA_GATEWAY])
+			nh.gw.s_addr = mnl_attr_get_u32(tb[RTA_GATEWAY]);
+		if (tb[RTA_MULTIPATH])
+			parse_multipath(tb[RTA_MULTIPATH], &nh);
+
+		ret = route_cache_add(c, addr, rm->rtm_dst_len, &nh);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "route cache is full\n");
+		return MNL_CB_ERROR;
+	}
+	return MNL_CB_OK;
+}
+
+static int route_cache_dump(struct route_cache *c)
+{
+	struct mnl_socket *nl;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh;
+	struct rtmsg *rtm;
+	unsigned int seq, portid;
+	int ret;
+
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (nl == NULL)
+		return -1;
+
+	if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0)
+		goto err;
+
+	portid = mnl_socket_get_portid(nl);
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = RTM_GETROUTE;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = time(NULL);
+	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtmsg));
+	rtm->rtm_family = AF_INET;
+
+	if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+		goto err;
+
+	do {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1)
+			goto err;
+
+		ret = mnl_cb_run(buf, ret, seq, portid, data_cb, c);
+	} while (ret > MNL_CB_STOP);
+
+	mnl_socket_close(nl);
+	return ret;
+err:
+	mnl_socket_close(nl);
+	return -1;
+}
+
+struct reader_args {
+	struct route_cache	*cache;
+	int			num_addrs;
+	char			**addrs;
+};
+
+/* a data-plane thread: it looks up the addresses once per second. */
+static void *reader_thread(void *data)
+{
+	struct reader_args *args = data;
+	struct route_cache *c = args->cache;
+	struct route_cache_reader *r;
+	int i;
+
+	r = route_cache_reader_register(c);
+	if (r == NULL)
+		return NULL;
+
+	for (;;) {
+		route_cache_quiescent(c, r);
+
+		for (i = 0; i < args->num_addrs; i++) {
+			const struct nexthop *nh;
+			struct in_addr addr;
+
+			if (inet_pton(AF_INET, args->addrs[i], &addr) != 1)
+				continue;
+
+			nh = route_cache_lookup(c, addr.s_addr);
+			if (nh == NULL) {
+				printf("%s unreachable\n", args->addrs[i]);
+				continue;
+			}
+			printf("%s ", args->addrs[i]);
+			if (nh->gw.s_addr)
+				printf("via %s ", inet_ntoa(nh->gw));
+			printf("oif %u\n", nh->oif);
+		}
+
+		route_cache_offline(r);
+		sleep(1);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct mnl_socket *nl;
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct reader_args args;
+	struct route_cache *c;
+	pthread_t thread;
+	int ret;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <address> [address...]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	c = route_cache_alloc();
+	if (c == NULL) {
+		perror("route_cache_alloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* subscribe before the dump, so that no change is missed. */
+	nl = mnl_socket_open(NETLINK_ROUTE);
+	if (nl == NULL) {
+		perror("mnl_socket_open");
+		exit(EXIT_FAILURE);
+	}
+	if (mnl_socket_bind(nl, RTMGRP_IPV4_ROUTE, MNL_SOCKET_AUTOPID) < 0) {
+		perror("mnl_socket_bind");
+		exit(EXIT_FAILURE);
+	}
+
+	if (route_cache_dump(c) < 0) {
+		perror("route_cache_dump");
+		exit(EXIT_FAILURE);
+	}
+	printf("%u prefixes, %u next hops, %u groups\n",
+	       c->num_prefixes, c->num_nexthops, c->next_group);
+
+	args.cache = c;
+	args.num_addrs = argc - 1;
+	args.addrs = &argv[1];
+	errno = pthread_create(&thread, NULL, reader_thread, &args);
+	if (errno != 0) {
+		perror("pthread_create");
+		exit(EXIT_FAILURE);
+	}
+
+	while (1) {
+		ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+		if (ret == -1) {
+			perror("mnl_socket_recvfrom");
+			exit(EXIT_FAILURE);
+		}
+
+		ret = mnl_cb_run(buf, ret, 0, 0, data_cb, c);
+		if (ret == -1) {
+			perror("mnl_cb_run");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	mnl_socket_close(nl);
+	route_cache_free(c);
+
+	return 0;
+}
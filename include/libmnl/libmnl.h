@@ -33,6 +33,49 @@ extern ssize_t mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf, size_
 extern int mnl_socket_setsockopt(const struct mnl_socket *nl, int type, void *buf, socklen_t len);
 extern int mnl_socket_getsockopt(const struct mnl_socket *nl, int type, void *buf, socklen_t *len);
 
+/* Netlink traffic capture */
+struct mnl_tap;
+struct mnl_tap_replay;
+
+enum mnl_tap_dir {
+	MNL_TAP_SEND	= 7,	/* PACKET_KERNEL, to kernel space */
+	MNL_TAP_RECV	= 6,	/* PACKET_USER, to user space */
+};
+
+struct mnl_tap_info {
+	uint32_t	sec;
+	uint32_t	nsec;
+	uint16_t	protocol;	/* NETLINK_* bus */
+	uint16_t	dir;		/* enum mnl_tap_dir */
+	uint32_t	len;		/* bytes in the capture */
+	uint32_t	orig_len;	/* bytes in the original datagram */
+};
+
+extern int mnl_socket_set_tap(struct mnl_socket *nl, struct mnl_tap *t);
+extern struct mnl_tap *mnl_tap_start(int fd, size_t bufsiz);
+extern void mnl_tap_stop(struct mnl_tap *t);
+extern int mnl_tap_flush(struct mnl_tap *t);
+extern int mnl_tap_put(struct mnl_tap *t, const void *buf, size_t len, uint16_t protocol, enum mnl_tap_dir dir);
+extern struct mnl_tap_replay *mnl_tap_replay_start(const void *data, size_t len);
+extern void mnl_tap_replay_stop(struct mnl_tap_replay *r);
+extern void mnl_tap_replay_rewind(struct mnl_tap_replay *r);
+extern const void *mnl_tap_replay_next(struct mnl_tap_replay *r, struct mnl_tap_info *info);
+
+/* Fake kernel endpoint */
+struct mnl_fake;
+
+typedef int (*mnl_fake_cb_t)(struct mnl_fake *f, const struct nlmsghdr *nlh, void *data);
+typedef int (*mnl_fake_dump_cb_t)(struct nlmsghdr *nlh, uint64_t idx, void *data);
+
+extern struct mnl_fake *mnl_fake_start(int bus, mnl_fake_cb_t cb, void *data);
+extern void mnl_fake_stop(struct mnl_fake *f);
+extern struct mnl_socket *mnl_fake_socket(struct mnl_fake *f);
+extern int mnl_fake_set_rcvbuf(struct mnl_fake *f, size_t size);
+extern void mnl_fake_enobufs(struct mnl_fake *f);
+extern int mnl_fake_put(struct mnl_fake *f, const void *buf, size_t len);
+extern int mnl_fake_ack(struct mnl_fake *f, const struct nlmsghdr *req, int error);
+extern int mnl_fake_dump(struct mnl_fake *f, const struct nlmsghdr *req, uint64_t count, uint64_t intr_at, mnl_fake_dump_cb_t cb, void *data);
+
 /*
  * Netlink message API
  */
@@ -77,6 +120,36 @@ extern void *mnl_nlmsg_batch_head(struct mnl_nlmsg_batch *b);
 extern void *mnl_nlmsg_batch_current(struct mnl_nlmsg_batch *b);
 extern bool mnl_nlmsg_batch_is_empty(struct mnl_nlmsg_batch *b);
 
+/* Message templates */
+struct mnl_nlmsg_tmpl;
+extern struct mnl_nlmsg_tmpl *mnl_nlmsg_tmpl_start(const struct nlmsghdr *nlh, unsigned int max_fields);
+extern void mnl_nlmsg_tmpl_stop(struct mnl_nlmsg_tmpl *t);
+extern int mnl_nlmsg_tmpl_add_field(struct mnl_nlmsg_tmpl *t, const struct nlmsghdr *nlh, const void *field, size_t len);
+extern struct nlmsghdr *mnl_nlmsg_tmpl_put(struct mnl_nlmsg_tmpl *t, void *buf);
+extern void mnl_nlmsg_tmpl_set_field(const struct mnl_nlmsg_tmpl *t, struct nlmsghdr *nlh, unsigned int index, const void *data);
+extern void *mnl_nlmsg_tmpl_get_field(const struct mnl_nlmsg_tmpl *t, struct nlmsghdr *nlh, unsigned int index);
+
+/* Message arena */
+struct mnl_arena;
+extern struct mnl_arena *mnl_arena_start(size_t chunk_size);
+extern void mnl_arena_stop(struct mnl_arena *a);
+extern struct nlmsghdr *mnl_arena_nlmsg_put_header(struct mnl_arena *a);
+extern size_t mnl_arena_buflen(const struct mnl_arena *a, const struct nlmsghdr *nlh);
+extern struct nlmsghdr *mnl_arena_grow(struct mnl_arena *a, struct nlmsghdr *nlh, size_t len);
+extern void mnl_arena_reset(struct mnl_arena *a);
+extern unsigned int mnl_arena_chunks(const struct mnl_arena *a);
+extern void *mnl_arena_chunk(const struct mnl_arena *a, unsigned int index, size_t *len);
+
+/* Message batch acknowledgment tracking */
+struct mnl_nlmsg_batch_ack;
+extern struct mnl_nlmsg_batch_ack *mnl_nlmsg_batch_ack_start(const void *buf, size_t len);
+extern void mnl_nlmsg_batch_ack_stop(struct mnl_nlmsg_batch_ack *a);
+extern unsigned int mnl_nlmsg_batch_ack_pending(const struct mnl_nlmsg_batch_ack *a);
+extern unsigned int mnl_nlmsg_batch_ack_count(const struct mnl_nlmsg_batch_ack *a);
+extern uint32_t mnl_nlmsg_batch_ack_get_seq(const struct mnl_nlmsg_batch_ack *a, unsigned int index);
+extern int mnl_nlmsg_batch_ack_get_error(const struct mnl_nlmsg_batch_ack *a, unsigned int index);
+extern int mnl_nlmsg_batch_ack_next_failed(const struct mnl_nlmsg_batch_ack *a, unsigned int index);
+
 /*
  * Netlink attributes API
  */
@@ -165,6 +238,30 @@ extern int mnl_attr_parse(const struct nlmsghdr *nlh, unsigned int offset, mnl_a
 extern int mnl_attr_parse_nested(const struct nlattr *attr, mnl_attr_cb_t cb, void *data);
 extern int mnl_attr_parse_payload(const void *payload, size_t payload_len, mnl_attr_cb_t cb, void *data);
 
+/* TLV bulk scanner and policy-based parser */
+struct mnl_attr_span {
+	uint32_t	offset;	/* offset to the beginning of the payload */
+	uint16_t	len;	/* attribute length, including header */
+	uint16_t	type;	/* attribute type, without flags */
+};
+
+struct mnl_attr_policy {
+	enum mnl_attr_data_type	type;
+	uint16_t		len;	/* expected payload length, if any */
+};
+
+extern int mnl_attr_scan(const void *payload, size_t payload_len, struct mnl_attr_span *spans, unsigned int max);
+extern int mnl_attr_parse_policy(const void *payload, const struct mnl_attr_span *spans, unsigned int n, const struct mnl_attr_policy *policy, uint16_t maxtype, const struct nlattr **tb);
+
+/* TLV attribute index */
+struct mnl_attr_index;
+extern struct mnl_attr_index *mnl_attr_index_start(uint16_t maxtype);
+extern void mnl_attr_index_stop(struct mnl_attr_index *idx);
+extern void mnl_attr_index_reset(struct mnl_attr_index *idx, const struct nlmsghdr *nlh, unsigned int offset);
+extern void mnl_attr_index_reset_nested(struct mnl_attr_index *idx, const struct nlattr *nested);
+extern void mnl_attr_index_reset_payload(struct mnl_attr_index *idx, const void *payload, size_t payload_len);
+extern const struct nlattr *mnl_attr_index_get(struct mnl_attr_index *idx, uint16_t type);
+
 /*
  * callback API
  */
@@ -182,6 +279,75 @@ extern int mnl_cb_run2(const void *buf, size_t numbytes, unsigned int seq,
 		       const mnl_cb_t *cb_ctl_array,
 		       unsigned int cb_ctl_array_len);
 
+/* pull-style alternative to the callback runqueue */
+struct mnl_nlmsg_iter {
+	/* private, do not access these fields directly. */
+	const struct nlmsghdr	*nlh;
+	int			len;
+	unsigned int		seq;
+	unsigned int		portid;
+	int			ret;
+};
+
+extern void mnl_nlmsg_iter_init(struct mnl_nlmsg_iter *it, const void *buf,
+				size_t numbytes, unsigned int seq,
+				unsigned int portid);
+extern const struct nlmsghdr *mnl_nlmsg_iter_next(struct mnl_nlmsg_iter *it);
+extern int mnl_nlmsg_iter_status(const struct mnl_nlmsg_iter *it);
+
+extern int mnl_cb_index(const void *buf, size_t numbytes, unsigned int seq,
+			unsigned int portid, uint32_t *offsets,
+			unsigned int max);
+
+extern int mnl_cb_run_index(const void *buf, const uint32_t *offsets,
+			    unsigned int n, mnl_cb_t cb_data, void *data,
+			    const mnl_cb_t *cb_ctl_array,
+			    unsigned int cb_ctl_array_len);
+
+extern int mnl_nlmsg_batch_ack_run(struct mnl_nlmsg_batch_ack *a,
+				   const void *buf, size_t numbytes,
+				   unsigned int portid, mnl_cb_t cb_err,
+				   void *data);
+
+/*
+ * structured decoder API
+ */
+#define MNL_DECODE_F_BE		(1 << 0)	/* integer in network byte order */
+#define MNL_DECODE_F_HEX	(1 << 1)	/* integer shown in hexadecimal */
+#define MNL_DECODE_F_ARRAY	(1 << 2)	/* nest of nests indexed by number */
+
+struct mnl_decode_table;
+
+struct mnl_decode_attr {
+	const char			*name;
+	enum mnl_attr_data_type		type;
+	uint16_t			flags;
+	const struct mnl_decode_table	*nested;
+};
+
+struct mnl_decode_table {
+	uint16_t			maxtype;
+	const struct mnl_decode_attr	*attrs;	/* maxtype + 1 elements */
+};
+
+struct mnl_decode_msg {
+	uint16_t			type;
+	const char			*name;
+	uint16_t			hdrlen;	/* family header size */
+	const struct mnl_decode_table	*table;
+};
+
+enum mnl_decode_mode {
+	MNL_DECODE_TEXT,
+	MNL_DECODE_JSON,
+};
+
+struct mnl_decoder;
+extern struct mnl_decoder *mnl_decoder_start(enum mnl_decode_mode mode);
+extern void mnl_decoder_stop(struct mnl_decoder *d);
+extern int mnl_decoder_add(struct mnl_decoder *d, const struct mnl_decode_msg *msgs, unsigned int n);
+extern size_t mnl_decoder_nlmsg(const struct mnl_decoder *d, const struct nlmsghdr *nlh, char *buf, size_t size);
+
 /*
  * other declarations
  */
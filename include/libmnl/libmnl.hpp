@@ -0,0 +1,972 @@
+#ifndef _LIBMNL_HPP_
+#define _LIBMNL_HPP_
+
+/*
+ * Header-only C++20 layer on top of libmnl.
+ *
+ * This provides RAII ownership of struct mnl_socket, ranges over Netlink
+ * messages and attributes, typed attribute getters, coroutine-based dumps
+ * and compile-time attribute policies to build and parse messages.
+ * Everything is inline and templated on the callables that you pass, so
+ * there is no std::function, no virtual call and no type erasure in the
+ * message and attribute loops.
+ *
+ * Errors on the socket are reported via std::system_error, the callable
+ * return values follow the MNL_CB_* conventions of the C API.
+ */
+
+#if __cplusplus < 202002L
+#error "libmnl.hpp requires C++20"
+#endif
+
+#include <libmnl/libmnl.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+namespace mnl {
+
+[[noreturn]] inline void throw_errno(const char *what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+/*
+ * Netlink socket
+ */
+
+class socket {
+public:
+	explicit socket(int bus, int flags = 0)
+		: nl_(mnl_socket_open2(bus, flags))
+	{
+		if (nl_ == nullptr)
+			throw_errno("mnl_socket_open2");
+	}
+	/* takes ownership of an existing socket, eg. mnl_socket_fdopen(). */
+	explicit socket(struct mnl_socket *nl) noexcept : nl_(nl) {}
+
+	socket(const socket &) = delete;
+	socket &operator=(const socket &) = delete;
+	socket(socket &&other) noexcept
+		: nl_(std::exchange(other.nl_, nullptr)) {}
+	socket &operator=(socket &&other) noexcept
+	{
+		if (this != &other) {
+			close();
+			nl_ = std::exchange(other.nl_, nullptr);
+		}
+		return *this;
+	}
+	~socket() { close(); }
+
+	void close() noexcept
+	{
+		if (nl_ != nullptr)
+			mnl_socket_close(std::exchange(nl_, nullptr));
+	}
+	struct mnl_socket *get() const noexcept { return nl_; }
+	struct mnl_socket *release() noexcept
+	{
+		return std::exchange(nl_, nullptr);
+	}
+
+	void bind(unsigned int groups = 0, pid_t pid = MNL_SOCKET_AUTOPID)
+	{
+		if (mnl_socket_bind(nl_, groups, pid) < 0)
+			throw_errno("mnl_socket_bind");
+	}
+	int fd() const noexcept { return mnl_socket_get_fd(nl_); }
+	unsigned int portid() const noexcept
+	{
+		return mnl_socket_get_portid(nl_);
+	}
+
+	size_t send(const void *buf, size_t len) const
+	{
+		ssize_t ret = mnl_socket_sendto(nl_, buf, len);
+		if (ret < 0)
+			throw_errno("mnl_socket_sendto");
+		return ret;
+	}
+	size_t send(const struct nlmsghdr *nlh) const
+	{
+		return send(nlh, nlh->nlmsg_len);
+	}
+
+	/* returns the number of bytes that have been received. */
+	size_t recv(std::span<std::byte> buf) const
+	{
+		ssize_t ret = try_recv(buf);
+		if (ret < 0)
+			throw_errno("mnl_socket_recvfrom");
+		return ret;
+	}
+	/* same as recv() but it does not throw, eg. for non-blocking use. */
+	ssize_t try_recv(std::span<std::byte> buf) const noexcept
+	{
+		return mnl_socket_recvfrom(nl_, buf.data(), buf.size());
+	}
+
+	template <typename T>
+	void setsockopt(int type, const T &value) const
+	{
+		if (mnl_socket_setsockopt(nl_, type, const_cast<T *>(&value),
+					  sizeof(T)) < 0)
+			throw_errno("mnl_socket_setsockopt");
+	}
+
+private:
+	struct mnl_socket *nl_;
+};
+
+/*
+ * Inline accessors
+ *
+ * These are equivalent to the mnl_nlmsg_* and mnl_attr_* functions, but the
+ * compiler can see through them.
+ */
+
+inline const void *payload(const struct nlmsghdr *nlh) noexcept
+{
+	return reinterpret_cast<const char *>(nlh) + MNL_NLMSG_HDRLEN;
+}
+
+inline const void *payload_offset(const struct nlmsghdr *nlh,
+				  size_t offset) noexcept
+{
+	return reinterpret_cast<const char *>(nlh) + MNL_NLMSG_HDRLEN +
+	       MNL_ALIGN(offset);
+}
+
+inline const void *payload_tail(const struct nlmsghdr *nlh) noexcept
+{
+	return reinterpret_cast<const char *>(nlh) + MNL_ALIGN(nlh->nlmsg_len);
+}
+
+inline bool nlmsg_ok(const struct nlmsghdr *nlh, int len) noexcept
+{
+	return len >= static_cast<int>(sizeof(struct nlmsghdr)) &&
+	       nlh->nlmsg_len >= sizeof(struct nlmsghdr) &&
+	       static_cast<int>(nlh->nlmsg_len) <= len;
+}
+
+inline uint16_t attr_type(const struct nlattr *attr) noexcept
+{
+	return attr->nla_type & NLA_TYPE_MASK;
+}
+
+inline const void *payload(const struct nlattr *attr) noexcept
+{
+	return reinterpret_cast<const char *>(attr) + MNL_ATTR_HDRLEN;
+}
+
+inline uint16_t payload_len(const struct nlattr *attr) noexcept
+{
+	return attr->nla_len - MNL_ATTR_HDRLEN;
+}
+
+inline bool attr_ok(const struct nlattr *attr, int len) noexcept
+{
+	return len >= static_cast<int>(sizeof(struct nlattr)) &&
+	       attr->nla_len >= sizeof(struct nlattr) &&
+	       static_cast<int>(attr->nla_len) <= len;
+}
+
+/*
+ * Typed attribute getters
+ *
+ * get<uint32_t>(attr) and friends are align-safe loads of the attribute
+ * payload. You still have to validate the attribute before, eg. with
+ * mnl_attr_validate().
+ */
+
+template <typename T>
+inline T get(const struct nlattr *attr) noexcept
+{
+	static_assert(std::is_trivially_copyable_v<T>,
+		      "no attribute getter for this type");
+	T value;
+	std::memcpy(&value, payload(attr), sizeof(T));
+	return value;
+}
+
+/* without the trailing NUL, if any. */
+template <>
+inline std::string_view get<std::string_view>(const struct nlattr *attr) noexcept
+{
+	const char *str = static_cast<const char *>(payload(attr));
+	size_t len = payload_len(attr);
+
+	return std::string_view(str, strnlen(str, len));
+}
+
+template <>
+inline std::span<const std::byte>
+get<std::span<const std::byte>>(const struct nlattr *attr) noexcept
+{
+	return { static_cast<const std::byte *>(payload(attr)),
+		 payload_len(attr) };
+}
+
+/*
+ * Ranges
+ */
+
+/* Attributes in a memory area: for (const nlattr *attr : attrs(nlh, off)) */
+class attr_range {
+public:
+	struct sentinel {};
+
+	class iterator {
+	public:
+		using value_type = const struct nlattr *;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		iterator(const struct nlattr *attr, int len) noexcept
+			: attr_(attr), len_(len) {}
+
+		value_type operator*() const noexcept { return attr_; }
+		iterator &operator++() noexcept
+		{
+			len_ -= MNL_ALIGN(attr_->nla_len);
+			attr_ = reinterpret_cast<const struct nlattr *>(
+				reinterpret_cast<const char *>(attr_) +
+				MNL_ALIGN(attr_->nla_len));
+			return *this;
+		}
+		iterator operator++(int) noexcept
+		{
+			iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		bool operator==(sentinel) const noexcept
+		{
+			return !attr_ok(attr_, len_);
+		}
+
+	private:
+		const struct nlattr *attr_ = nullptr;
+		int len_ = 0;
+	};
+
+	attr_range(const void *data, size_t len) noexcept
+		: begin_(static_cast<const struct nlattr *>(data)),
+		  len_(len) {}
+
+	iterator begin() const noexcept { return iterator(begin_, len_); }
+	sentinel end() const noexcept { return {}; }
+
+private:
+	const struct nlattr *begin_;
+	int len_;
+};
+
+inline attr_range attrs(const struct nlmsghdr *nlh, size_t offset) noexcept
+{
+	const char *start = static_cast<const char *>(payload_offset(nlh, offset));
+
+	return attr_range(start,
+		static_cast<const char *>(payload_tail(nlh)) - start);
+}
+
+inline attr_range attrs(const struct nlattr *nest) noexcept
+{
+	return attr_range(payload(nest), payload_len(nest));
+}
+
+/* Messages in a buffer, without any check but boundaries. */
+class nlmsg_range {
+public:
+	struct sentinel {};
+
+	class iterator {
+	public:
+		using value_type = const struct nlmsghdr *;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		iterator(const struct nlmsghdr *nlh, int len) noexcept
+			: nlh_(nlh), len_(len) {}
+
+		value_type operator*() const noexcept { return nlh_; }
+		iterator &operator++() noexcept
+		{
+			len_ -= MNL_ALIGN(nlh_->nlmsg_len);
+			nlh_ = static_cast<const struct nlmsghdr *>(
+				payload_tail(nlh_));
+			return *this;
+		}
+		iterator operator++(int) noexcept
+		{
+			iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		bool operator==(sentinel) const noexcept
+		{
+			return !nlmsg_ok(nlh_, len_);
+		}
+
+	private:
+		const struct nlmsghdr *nlh_ = nullptr;
+		int len_ = 0;
+	};
+
+	explicit nlmsg_range(std::span<const std::byte> buf) noexcept
+		: buf_(buf) {}
+
+	iterator begin() const noexcept
+	{
+		return iterator(reinterpret_cast<const struct nlmsghdr *>(
+				buf_.data()), buf_.size());
+	}
+	sentinel end() const noexcept { return {}; }
+
+private:
+	std::span<const std::byte> buf_;
+};
+
+inline nlmsg_range nlmsgs(std::span<const std::byte> buf) noexcept
+{
+	return nlmsg_range(buf);
+}
+
+/*
+ * Callback runqueue
+ */
+
+namespace detail {
+
+template <typename F, typename... Args>
+inline int invoke_cb(F &&f, Args &&...args)
+{
+	if constexpr (std::is_void_v<std::invoke_result_t<F, Args...>>) {
+		std::forward<F>(f)(std::forward<Args>(args)...);
+		return MNL_CB_OK;
+	} else {
+		return std::forward<F>(f)(std::forward<Args>(args)...);
+	}
+}
+
+/* same checks as mnl_cb_run(), returns false and sets errno on failure. */
+inline bool check(const struct nlmsghdr *nlh, unsigned int seq,
+		  unsigned int portid) noexcept
+{
+	if (nlh->nlmsg_pid && portid && nlh->nlmsg_pid != portid) {
+		errno = ESRCH;
+		return false;
+	}
+	if (nlh->nlmsg_seq && seq && nlh->nlmsg_seq != seq) {
+		errno = EPROTO;
+		return false;
+	}
+	if (nlh->nlmsg_flags & NLM_F_DUMP_INTR) {
+		errno = EINTR;
+		return false;
+	}
+	return true;
+}
+
+/* default control message handling, as in mnl_cb_run(). */
+inline int control(const struct nlmsghdr *nlh) noexcept
+{
+	const struct nlmsgerr *err;
+
+	switch (nlh->nlmsg_type) {
+	case NLMSG_ERROR:
+		if (nlh->nlmsg_len < MNL_NLMSG_HDRLEN + sizeof(struct nlmsgerr)) {
+			errno = EBADMSG;
+			return MNL_CB_ERROR;
+		}
+		err = static_cast<const struct nlmsgerr *>(payload(nlh));
+		errno = err->error < 0 ? -err->error : err->error;
+		return err->error == 0 ? MNL_CB_STOP : MNL_CB_ERROR;
+	case NLMSG_DONE:
+		return MNL_CB_STOP;
+	default:
+		return MNL_CB_OK;
+	}
+}
+
+} /* namespace detail */
+
+/*
+ * Equivalent to mnl_cb_run() but cb is any callable that takes a
+ * const struct nlmsghdr * and returns MNL_CB_* (or void, meaning
+ * MNL_CB_OK), so it is inlined into the message loop.
+ */
+template <typename F>
+inline int cb_run(std::span<const std::byte> buf, unsigned int seq,
+		  unsigned int portid, F &&cb)
+{
+	int ret = MNL_CB_OK;
+
+	for (const struct nlmsghdr *nlh : nlmsgs(buf)) {
+		if (!detail::check(nlh, seq, portid))
+			return MNL_CB_ERROR;
+
+		if (nlh->nlmsg_type >= NLMSG_MIN_TYPE)
+			ret = detail::invoke_cb(cb, nlh);
+		else
+			ret = detail::control(nlh);
+
+		if (ret <= MNL_CB_STOP)
+			break;
+	}
+	return ret;
+}
+
+/*
+ * Equivalent to mnl_attr_parse() with an inlined callable that takes a
+ * const struct nlattr * and returns MNL_CB_* (or void).
+ */
+template <typename F>
+inline int attr_parse(const struct nlmsghdr *nlh, size_t offset, F &&cb)
+{
+	int ret = MNL_CB_OK;
+
+	for (const struct nlattr *attr : attrs(nlh, offset)) {
+		if ((ret = detail::invoke_cb(cb, attr)) <= MNL_CB_STOP)
+			break;
+	}
+	return ret;
+}
+
+template <typename F>
+inline int attr_parse_nested(const struct nlattr *nest, F &&cb)
+{
+	int ret = MNL_CB_OK;
+
+	for (const struct nlattr *attr : attrs(nest)) {
+		if ((ret = detail::invoke_cb(cb, attr)) <= MNL_CB_STOP)
+			break;
+	}
+	return ret;
+}
+
+/*
+ * Compile-time attribute policies
+ *
+ * You describe the attributes of a message family with the types below,
+ * eg. for a ctnetlink tuple:
+ *
+ *	using ip_src = mnl::attr<CTA_IP_V4_SRC, uint32_t>;
+ *	using ip_dst = mnl::attr<CTA_IP_V4_DST, uint32_t>;
+ *	using tuple_ip = mnl::nest_attr<CTA_TUPLE_IP, ip_src, ip_dst>;
+ *	using ct_policy = mnl::policy<tuple_ip, ...>;
+ *
+ * From this description, the validation table and the maximum size of the
+ * message are computed at compile time. mnl::builder uses the maximum size
+ * to place the message in a buffer that is large enough, so there is no
+ * need for the _check putters. mnl::parser validates each attribute with
+ * a table lookup and a length comparison, the typed getters know the type
+ * of each attribute at compile time.
+ *
+ * The maximum size assumes that each attribute is added at most once.
+ */
+
+/* maps C++ types to libmnl data types, anything else is binary. */
+template <typename T>
+struct attr_data_type : std::integral_constant<enum mnl_attr_data_type,
+					       MNL_TYPE_BINARY> {};
+template <>
+struct attr_data_type<uint8_t> : std::integral_constant<enum mnl_attr_data_type,
+						       MNL_TYPE_U8> {};
+template <>
+struct attr_data_type<uint16_t> : std::integral_constant<enum mnl_attr_data_type,
+							MNL_TYPE_U16> {};
+template <>
+struct attr_data_type<uint32_t> : std::integral_constant<enum mnl_attr_data_type,
+							MNL_TYPE_U32> {};
+template <>
+struct attr_data_type<uint64_t> : std::integral_constant<enum mnl_attr_data_type,
+							MNL_TYPE_U64> {};
+
+namespace detail {
+
+inline struct nlattr *attr_put_hdr(struct nlmsghdr *nlh, uint16_t type,
+				   size_t len) noexcept
+{
+	struct nlattr *attr = reinterpret_cast<struct nlattr *>(
+		reinterpret_cast<char *>(nlh) + MNL_ALIGN(nlh->nlmsg_len));
+
+	attr->nla_type = type;
+	attr->nla_len = MNL_ATTR_HDRLEN + len;
+	nlh->nlmsg_len += MNL_ALIGN(attr->nla_len);
+	return attr;
+}
+
+inline void attr_put(struct nlmsghdr *nlh, uint16_t type, size_t len,
+		     const void *data) noexcept
+{
+	struct nlattr *attr = attr_put_hdr(nlh, type, len);
+	char *dst = reinterpret_cast<char *>(attr) + MNL_ATTR_HDRLEN;
+
+	std::memcpy(dst, data, len);
+	std::memset(dst + len, 0, MNL_ALIGN(len) - len);
+}
+
+} /* namespace detail */
+
+/* fixed-size attribute, eg. attr<IFLA_MTU, uint32_t>. */
+template <uint16_t Type, typename T>
+struct attr {
+	static_assert(std::is_trivially_copyable_v<T>);
+
+	using value_type = T;
+	static constexpr uint16_t type = Type;
+	static constexpr enum mnl_attr_data_type data_type =
+		attr_data_type<T>::value;
+	static constexpr size_t min_len = sizeof(T);
+	static constexpr size_t max_len = sizeof(T);
+	static constexpr size_t max_size = MNL_ATTR_HDRLEN + MNL_ALIGN(sizeof(T));
+
+	template <typename A>
+	static constexpr bool contains = false;
+
+	static T load(const struct nlattr *a) noexcept { return get<T>(a); }
+	static void store(struct nlmsghdr *nlh, const T &value) noexcept
+	{
+		detail::attr_put(nlh, Type, sizeof(T), &value);
+	}
+};
+
+/* NUL-terminated string of up to MaxLen characters. */
+template <uint16_t Type, size_t MaxLen>
+struct string_attr {
+	using value_type = std::string_view;
+	static constexpr uint16_t type = Type;
+	static constexpr enum mnl_attr_data_type data_type = MNL_TYPE_NUL_STRING;
+	static constexpr size_t min_len = 1;
+	static constexpr size_t max_len = MaxLen + 1;
+	static constexpr size_t max_size = MNL_ATTR_HDRLEN + MNL_ALIGN(MaxLen + 1);
+
+	template <typename A>
+	static constexpr bool contains = false;
+
+	static std::string_view load(const struct nlattr *a) noexcept
+	{
+		return get<std::string_view>(a);
+	}
+	/* strings longer than MaxLen are truncated. */
+	static void store(struct nlmsghdr *nlh, std::string_view value) noexcept
+	{
+		size_t len = value.size() < MaxLen ? value.size() : MaxLen;
+		struct nlattr *a = detail::attr_put_hdr(nlh, Type, len + 1);
+		char *dst = reinterpret_cast<char *>(a) + MNL_ATTR_HDRLEN;
+
+		std::memcpy(dst, value.data(), len);
+		std::memset(dst + len, 0, MNL_ALIGN(len + 1) - len);
+	}
+};
+
+/* attribute without payload, its presence is the value. */
+template <uint16_t Type>
+struct flag_attr {
+	using value_type = bool;
+	static constexpr uint16_t type = Type;
+	static constexpr enum mnl_attr_data_type data_type = MNL_TYPE_FLAG;
+	static constexpr size_t min_len = 0;
+	static constexpr size_t max_len = 0;
+	static constexpr size_t max_size = MNL_ATTR_HDRLEN;
+
+	template <typename A>
+	static constexpr bool contains = false;
+
+	static bool load(const struct nlattr *a) noexcept { return a != nullptr; }
+	static void store(struct nlmsghdr *nlh, bool value) noexcept
+	{
+		if (value)
+			detail::attr_put_hdr(nlh, Type, 0);
+	}
+};
+
+/* attribute nest, parse its content with parser<policy<Attrs...>>. */
+template <uint16_t Type, typename... Attrs>
+struct nest_attr {
+	using value_type = const struct nlattr *;
+	static constexpr uint16_t type = Type;
+	static constexpr enum mnl_attr_data_type data_type = MNL_TYPE_NESTED;
+	static constexpr size_t min_len = 0;
+	static constexpr size_t max_len = (size_t(0) + ... + Attrs::max_size);
+	static constexpr size_t max_size = MNL_ATTR_HDRLEN + max_len;
+
+	template <typename A>
+	static constexpr bool contains =
+		((std::is_same_v<A, Attrs> || Attrs::template contains<A>) || ...);
+
+	static const struct nlattr *load(const struct nlattr *a) noexcept
+	{
+		return a;
+	}
+};
+
+template <typename... Attrs>
+struct policy {
+	static_assert(sizeof...(Attrs) > 0, "empty policy");
+
+	static constexpr uint16_t max_type = std::max({ Attrs::type... });
+	static constexpr size_t max_size = (size_t(0) + ... + Attrs::max_size);
+
+	/* true if A can be added to a message that follows this policy. */
+	template <typename A>
+	static constexpr bool contains =
+		((std::is_same_v<A, Attrs> || Attrs::template contains<A>) || ...);
+
+	/* true if A is one of the top-level attributes of this policy. */
+	template <typename A>
+	static constexpr bool has = (std::is_same_v<A, Attrs> || ...);
+
+	struct entry {
+		uint16_t	min_len;
+		uint16_t	span;	/* max_len - min_len */
+		bool		known;
+		bool		nul;
+	};
+
+	static constexpr std::array<entry, max_type + 1> table = [] {
+		std::array<entry, max_type + 1> t{};
+		/* nests may carry attributes that we don't know about. */
+		((t[Attrs::type] = entry{
+			static_cast<uint16_t>(Attrs::min_len),
+			Attrs::data_type == MNL_TYPE_NESTED ? UINT16_MAX :
+			static_cast<uint16_t>(Attrs::max_len - Attrs::min_len),
+			true,
+			Attrs::data_type == MNL_TYPE_NUL_STRING }), ...);
+		return t;
+	}();
+
+	/* the same policy for mnl_attr_parse_policy(), if you prefer. */
+	static constexpr std::array<struct mnl_attr_policy, max_type + 1>
+	c_policy = [] {
+		std::array<struct mnl_attr_policy, max_type + 1> t{};
+		/* only fixed-size attributes have an exact length. */
+		((t[Attrs::type] = { Attrs::data_type,
+			static_cast<uint16_t>(Attrs::min_len == Attrs::max_len ?
+					      Attrs::max_len : 0) }), ...);
+		return t;
+	}();
+};
+
+template <typename Policy>
+class parser {
+public:
+	/*
+	 * Returns 0 on success, otherwise -1 and errno is set to ERANGE if the
+	 * length of one attribute is not the expected, or EINVAL if a string
+	 * is not NUL-terminated. Attributes that are not in the policy are
+	 * skipped.
+	 */
+	int parse(const void *data, size_t len) noexcept
+	{
+		tb_ = {};
+		for (const struct nlattr *a : attr_range(data, len)) {
+			uint16_t t = attr_type(a);
+			uint16_t plen = payload_len(a);
+
+			if (t > Policy::max_type || !Policy::table[t].known)
+				continue;
+
+			const auto &e = Policy::table[t];
+			/* one unsigned comparison for both boundaries. */
+			if (static_cast<uint16_t>(plen - e.min_len) > e.span) {
+				errno = ERANGE;
+				return -1;
+			}
+			if (e.nul &&
+			    static_cast<const char *>(payload(a))[plen - 1] != '\0') {
+				errno = EINVAL;
+				return -1;
+			}
+			tb_[t] = a;
+		}
+		return 0;
+	}
+	int parse(const struct nlmsghdr *nlh, size_t offset) noexcept
+	{
+		const char *start = static_cast<const char *>(
+			payload_offset(nlh, offset));
+
+		return parse(start,
+			static_cast<const char *>(payload_tail(nlh)) - start);
+	}
+	int parse(const struct nlattr *nest) noexcept
+	{
+		return parse(payload(nest), payload_len(nest));
+	}
+
+	template <typename A>
+	bool has() const noexcept
+	{
+		static_assert(Policy::template has<A>,
+			      "attribute is not in this policy");
+		return tb_[A::type] != nullptr;
+	}
+
+	/* the attribute must be present, see has(). */
+	template <typename A>
+	typename A::value_type get() const noexcept
+	{
+		static_assert(Policy::template has<A>,
+			      "attribute is not in this policy");
+		return A::load(tb_[A::type]);
+	}
+
+	template <typename A>
+	const struct nlattr *raw() const noexcept
+	{
+		static_assert(Policy::template has<A>,
+			      "attribute is not in this policy");
+		return tb_[A::type];
+	}
+
+private:
+	std::array<const struct nlattr *, Policy::max_type + 1> tb_{};
+};
+
+/*
+ * Message builder whose buffer is sized at compile time after the extra
+ * header (void if none) and the attribute policy, so that every attribute
+ * of the policy can be put once. The putters check that the attribute fits
+ * against its maximum size, which is a single comparison with a constant;
+ * like mnl_attr_put_check(), they return false and write nothing if it
+ * does not, eg. if an attribute is put twice.
+ */
+template <typename ExtraHeader, typename Policy>
+class builder {
+	static constexpr size_t extra_size = [] {
+		if constexpr (std::is_void_v<ExtraHeader>)
+			return size_t(0);
+		else
+			return MNL_ALIGN(sizeof(ExtraHeader));
+	}();
+
+public:
+	static constexpr size_t max_size = MNL_NLMSG_HDRLEN + extra_size +
+					   Policy::max_size;
+
+	builder(uint16_t type, uint16_t flags, uint32_t seq = 0) noexcept
+	{
+		reset(type, flags, seq);
+	}
+
+	/* start a new message, only the headers are cleared. */
+	void reset(uint16_t type, uint16_t flags, uint32_t seq = 0) noexcept
+	{
+		struct nlmsghdr *h = nlh();
+
+		std::memset(buf_, 0, MNL_NLMSG_HDRLEN + extra_size);
+		h->nlmsg_len = MNL_NLMSG_HDRLEN + extra_size;
+		h->nlmsg_type = type;
+		h->nlmsg_flags = flags;
+		h->nlmsg_seq = seq;
+	}
+
+	struct nlmsghdr *nlh() noexcept
+	{
+		return reinterpret_cast<struct nlmsghdr *>(buf_);
+	}
+
+	template <typename H = ExtraHeader>
+	requires (!std::is_void_v<H>)
+	H &extra() noexcept
+	{
+		return *reinterpret_cast<H *>(buf_ + MNL_NLMSG_HDRLEN);
+	}
+
+	template <typename A>
+	bool put(const typename A::value_type &value) noexcept
+	{
+		static_assert(Policy::template contains<A>,
+			      "attribute is not in this policy");
+		if (!fits(A::max_size))
+			return false;
+
+		A::store(nlh(), value);
+		return true;
+	}
+
+	/* returns nullptr if the nest and its attributes may not fit. */
+	template <typename N>
+	struct nlattr *nest_start() noexcept
+	{
+		static_assert(Policy::template contains<N>,
+			      "attribute is not in this policy");
+		static_assert(N::data_type == MNL_TYPE_NESTED);
+		if (!fits(N::max_size))
+			return nullptr;
+
+		return detail::attr_put_hdr(nlh(), NLA_F_NESTED | N::type, 0);
+	}
+
+	void nest_end(struct nlattr *start) noexcept
+	{
+		start->nla_len = static_cast<const char *>(payload_tail(nlh())) -
+				 reinterpret_cast<char *>(start);
+	}
+
+	const void *data() const noexcept { return buf_; }
+	size_t size() const noexcept
+	{
+		return reinterpret_cast<const struct nlmsghdr *>(buf_)->nlmsg_len;
+	}
+
+private:
+	bool fits(size_t len) const noexcept
+	{
+		return size() + len <= max_size;
+	}
+
+	alignas(MNL_ALIGNTO) std::byte buf_[max_size];
+};
+
+/*
+ * Generator
+ *
+ * Minimal synchronous generator, since std::generator is C++23.
+ */
+
+template <typename T>
+class generator {
+public:
+	struct promise_type {
+		T value;
+		std::exception_ptr exception;
+
+		generator get_return_object() noexcept
+		{
+			return generator(handle::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(T v) noexcept
+		{
+			value = v;
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept
+		{
+			exception = std::current_exception();
+		}
+	};
+	using handle = std::coroutine_handle<promise_type>;
+
+	struct sentinel {};
+
+	class iterator {
+	public:
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		explicit iterator(handle h) noexcept : h_(h) {}
+
+		T operator*() const noexcept { return h_.promise().value; }
+		iterator &operator++()
+		{
+			resume(h_);
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+		bool operator==(sentinel) const noexcept { return h_.done(); }
+
+	private:
+		handle h_;
+	};
+
+	generator(const generator &) = delete;
+	generator &operator=(const generator &) = delete;
+	generator(generator &&other) noexcept
+		: h_(std::exchange(other.h_, nullptr)) {}
+	generator &operator=(generator &&other) noexcept
+	{
+		if (this != &other) {
+			if (h_)
+				h_.destroy();
+			h_ = std::exchange(other.h_, nullptr);
+		}
+		return *this;
+	}
+	~generator()
+	{
+		if (h_)
+			h_.destroy();
+	}
+
+	iterator begin()
+	{
+		resume(h_);
+		return iterator(h_);
+	}
+	sentinel end() const noexcept { return {}; }
+
+private:
+	explicit generator(handle h) noexcept : h_(h) {}
+
+	static void resume(handle h)
+	{
+		h.resume();
+		if (h.done() && h.promise().exception)
+			std::rethrow_exception(h.promise().exception);
+	}
+
+	handle h_;
+};
+
+/*
+ * Sends the request and yields the data messages of the reply until
+ * NLMSG_DONE or the acknowledgment is received. The receive buffer is
+ * provided by the caller, so the only allocation is the coroutine frame.
+ * Errors, including NLMSG_ERROR, are thrown as std::system_error when the
+ * generator is advanced.
+ *
+ *	for (const struct nlmsghdr *nlh : mnl::dump(nl, req, buf))
+ *		...
+ */
+inline generator<const struct nlmsghdr *>
+dump(const socket &nl, const struct nlmsghdr *req, std::span<std::byte> buf)
+{
+	unsigned int seq = req->nlmsg_seq;
+	unsigned int portid = nl.portid();
+
+	nl.send(req);
+	for (;;) {
+		size_t len = nl.recv(buf);
+
+		for (const struct nlmsghdr *nlh : nlmsgs(buf.first(len))) {
+			if (!detail::check(nlh, seq, portid))
+				throw_errno("netlink dump");
+
+			if (nlh->nlmsg_type >= NLMSG_MIN_TYPE) {
+				co_yield nlh;
+				continue;
+			}
+			switch (detail::control(nlh)) {
+			case MNL_CB_ERROR:
+				throw_errno("netlink dump");
+			case MNL_CB_STOP:
+				co_return;
+			}
+		}
+	}
+}
+
+} /* namespace mnl */
+
+#endif
@@ -0,0 +1,356 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <libmnl/libmnl.h>
+#include "internal.h"
+
+/**
+ * \defgroup arena Netlink message arena
+ *
+ * If you build many requests, eg. to load a large ruleset, allocating and
+ * clearing one buffer per request is a waste. The arena places the messages
+ * one after another in chunks of memory that are a multiple of the page
+ * size. A new chunk is allocated only if the current one is full, and the
+ * arena can be reset in O(1) once the messages have been sent, keeping the
+ * chunks for the next round.
+ *
+ * Since the messages in a chunk are contiguous, each chunk is a batch that
+ * can be sent in one go (see mnl_arena_chunk()).
+ *
+ * You obtain room for a new message via mnl_arena_nlmsg_put_header(), then
+ * you use the usual message and attribute helpers to complete it. Only the
+ * Netlink header is cleared, as mnl_nlmsg_put_header() does.
+ *
+ * mnl_arena_buflen() tells how much room is left for the last message in
+ * its chunk, which is what you have to pass to the _check putters. If one
+ * of them fails, you can call mnl_arena_grow() to move the message to a
+ * chunk with enough room and retry:
+ *
+ * \verbatim
+	while (!mnl_attr_put_u32_check(nlh, mnl_arena_buflen(a, nlh),
+				       type, value)) {
+		nlh = mnl_arena_grow(a, nlh, MNL_ATTR_HDRLEN + sizeof(value));
+		if (nlh == NULL)
+			return -1;
+	}
+\endverbatim
+ *
+ * Note that, if the message is moved, any pointer to the message that you
+ * keep, such as attribute nests, refers to the old location. You have to
+ * keep the offset to the beginning of the message instead.
+ *
+ * @{
+ */
+
+struct mnl_arena_chunk {
+	size_t	size;
+	size_t	len;
+	char	data[];
+};
+
+struct mnl_arena {
+	/* default chunk size, multiple of the page size. */
+	size_t			chunk_size;
+	/* chunks allocated so far, they are kept on reset. */
+	struct mnl_arena_chunk	**chunks;
+	unsigned int		num_chunks;
+	unsigned int		max_chunks;
+	/* chunk where messages are being placed. */
+	unsigned int		cur;
+	/* last message, its length is not accounted in the chunk yet. */
+	struct nlmsghdr		*last;
+};
+
+static size_t mnl_arena_round(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) / page * page;
+}
+
+static struct mnl_arena_chunk *mnl_arena_chunk_alloc(size_t size)
+{
+	struct mnl_arena_chunk *c;
+
+	c = malloc(sizeof(struct mnl_arena_chunk) + size);
+	if (c == NULL)
+		return NULL;
+
+	c->size = size;
+	c->len = 0;
+	return c;
+}
+
+/**
+ * mnl_arena_start - allocate a message arena
+ * \param chunk_size size of the chunks, rounded up to the page size
+ *
+ * The chunk size is also the maximum size of the batch that you send, so
+ * a good choice is MNL_SOCKET_BUFFER_SIZE or a few times that. The first
+ * chunk is allocated by this function.
+ *
+ * On error, it returns NULL and errno is set. Otherwise, it returns a pointer
+ * to the arena that you have to release via mnl_arena_stop().
+ */
+EXPORT_SYMBOL(mnl_arena_start);
+struct mnl_arena *mnl_arena_start(size_t chunk_size)
+{
+	struct mnl_arena *a;
+
+	if (chunk_size < MNL_NLMSG_HDRLEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	a = calloc(1, sizeof(struct mnl_arena));
+	if (a == NULL)
+		return NULL;
+
+	a->chunk_size = mnl_arena_round(chunk_size);
+	a->max_chunks = 4;
+	a->chunks = calloc(a->max_chunks, sizeof(struct mnl_arena_chunk *));
+	if (a->chunks == NULL)
+		goto err;
+
+	a->chunks[0] = mnl_arena_chunk_alloc(a->chunk_size);
+	if (a->chunks[0] == NULL)
+		goto err;
+
+	a->num_chunks = 1;
+	return a;
+err:
+	free(a->chunks);
+	free(a);
+	return NULL;
+}
+
+/**
+ * mnl_arena_stop - release a message arena
+ * \param a pointer to the arena
+ *
+ * This releases the arena and all its chunks.
+ */
+EXPORT_SYMBOL(mnl_arena_stop);
+void mnl_arena_stop(struct mnl_arena *a)
+{
+	unsigned int i;
+
+	for (i = 0; i < a->num_chunks; i++)
+		free(a->chunks[i]);
+	free(a->chunks);
+	free(a);
+}
+
+/* account the last message in its chunk. */
+static void mnl_arena_commit(struct mnl_arena *a)
+{
+	if (a->last) {
+		a->chunks[a->cur]->len += MNL_ALIGN(a->last->nlmsg_len);
+		a->last = NULL;
+	}
+}
+
+/* move to the next chunk with at least size bytes, allocate it if needed. */
+static struct mnl_arena_chunk *mnl_arena_next(struct mnl_arena *a, size_t size)
+{
+	struct mnl_arena_chunk *c;
+
+	if (a->cur + 1 < a->num_chunks) {
+		c = a->chunks[a->cur + 1];
+		if (c->size < size) {
+			struct mnl_arena_chunk *bigger;
+
+			bigger = mnl_arena_chunk_alloc(mnl_arena_round(size));
+			if (bigger == NULL)
+				return NULL;
+
+			free(c);
+			a->chunks[a->cur + 1] = c = bigger;
+		}
+	} else {
+		if (a->num_chunks == a->max_chunks) {
+			struct mnl_arena_chunk **chunks;
+
+			chunks = realloc(a->chunks, 2 * a->max_chunks *
+					 sizeof(struct mnl_arena_chunk *));
+			if (chunks == NULL)
+				return NULL;
+
+			a->chunks = chunks;
+			a->max_chunks *= 2;
+		}
+		c = mnl_arena_chunk_alloc(size > a->chunk_size ?
+					  mnl_arena_round(size) :
+					  a->chunk_size);
+		if (c == NULL)
+			return NULL;
+
+		a->chunks[a->num_chunks++] = c;
+	}
+	/* chunks are recycled after reset, so this is the time to rewind. */
+	c->len = 0;
+	a->cur++;
+	return c;
+}
+
+/**
+ * mnl_arena_nlmsg_put_header - reserve and prepare room for a new message
+ * \param a pointer to the arena
+ *
+ * This function places a new Netlink header after the last message, or at
+ * the beginning of a new chunk if there is no room left. As it happens in
+ * mnl_nlmsg_put_header(), only the room for the Netlink header is cleared
+ * and the nlmsg_len field is initialized to the size of the header.
+ *
+ * On error, it returns NULL and errno is set. Otherwise, it returns a pointer
+ * to the Netlink header.
+ */
+EXPORT_SYMBOL(mnl_arena_nlmsg_put_header);
+struct nlmsghdr *mnl_arena_nlmsg_put_header(struct mnl_arena *a)
+{
+	struct mnl_arena_chunk *c;
+
+	mnl_arena_commit(a);
+
+	c = a->chunks[a->cur];
+	if (c->len + MNL_NLMSG_HDRLEN > c->size) {
+		c = mnl_arena_next(a, MNL_NLMSG_HDRLEN);
+		if (c == NULL)
+			return NULL;
+	}
+	a->last = mnl_nlmsg_put_header(c->data + c->len);
+	return a->last;
+}
+
+/**
+ * mnl_arena_buflen - room for the last message in the arena
+ * \param a pointer to the arena
+ * \param nlh pointer to the last message, returned by
+ * mnl_arena_nlmsg_put_header() or mnl_arena_grow()
+ *
+ * This function returns the size of the buffer that stores the message,
+ * ie. from the beginning of the message to the end of its chunk. You can
+ * pass it to the _check putters.
+ */
+EXPORT_SYMBOL(mnl_arena_buflen);
+size_t mnl_arena_buflen(const struct mnl_arena *a, const struct nlmsghdr *nlh)
+{
+	const struct mnl_arena_chunk *c = a->chunks[a->cur];
+
+	return c->data + c->size - (const char *)nlh;
+}
+
+/**
+ * mnl_arena_grow - make room for the last message in the arena
+ * \param a pointer to the arena
+ * \param nlh pointer to the last message
+ * \param len number of bytes that you want to add to the message
+ *
+ * If there is not enough room for len more bytes after the message in its
+ * chunk, the message is copied to the next chunk, which is allocated with
+ * a larger size if the message does not fit into a regular chunk.
+ *
+ * On error, it returns NULL and errno is set, the message is left
+ * untouched. Otherwise, it returns a pointer to the message, which may
+ * have been moved.
+ */
+EXPORT_SYMBOL(mnl_arena_grow);
+struct nlmsghdr *mnl_arena_grow(struct mnl_arena *a, struct nlmsghdr *nlh,
+				size_t len)
+{
+	struct mnl_arena_chunk *c;
+	size_t size = MNL_ALIGN(nlh->nlmsg_len) + MNL_ALIGN(len);
+
+	if (nlh != a->last) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (size <= mnl_arena_buflen(a, nlh))
+		return nlh;
+
+	c = a->chunks[a->cur];
+	if (c->len == 0) {
+		/* this message is alone in its chunk, enlarge the chunk. */
+		size = mnl_arena_round(size);
+		c = realloc(c, sizeof(struct mnl_arena_chunk) + size);
+		if (c == NULL)
+			return NULL;
+
+		c->size = size;
+		a->chunks[a->cur] = c;
+	} else {
+		/* the message leaves this chunk, its room is free again. */
+		c = mnl_arena_next(a, size);
+		if (c == NULL)
+			return NULL;
+
+		memcpy(c->data, nlh, nlh->nlmsg_len);
+	}
+	a->last = (struct nlmsghdr *)c->data;
+	return a->last;
+}
+
+/**
+ * mnl_arena_reset - release all the messages in the arena
+ * \param a pointer to the arena
+ *
+ * This function rewinds the arena in O(1), so that new messages are placed
+ * at the beginning of the first chunk. The memory is kept for reuse.
+ */
+EXPORT_SYMBOL(mnl_arena_reset);
+void mnl_arena_reset(struct mnl_arena *a)
+{
+	a->cur = 0;
+	a->last = NULL;
+	a->chunks[0]->len = 0;
+}
+
+/**
+ * mnl_arena_chunks - number of chunks that store messages
+ * \param a pointer to the arena
+ */
+EXPORT_SYMBOL(mnl_arena_chunks);
+unsigned int mnl_arena_chunks(const struct mnl_arena *a)
+{
+	return a->cur + 1;
+}
+
+/**
+ * mnl_arena_chunk - get the messages stored in one chunk
+ * \param a pointer to the arena
+ * \param index index of the chunk, lower than mnl_arena_chunks()
+ * \param len pointer to store the length of the messages in this chunk
+ *
+ * This function returns a pointer to the first message in the chunk. The
+ * messages are contiguous, so you can send them in one single datagram. If
+ * the index is out of range, it returns NULL.
+ */
+EXPORT_SYMBOL(mnl_arena_chunk);
+void *mnl_arena_chunk(const struct mnl_arena *a, unsigned int index,
+		      size_t *len)
+{
+	const struct mnl_arena_chunk *c;
+
+	if (index > a->cur)
+		return NULL;
+
+	c = a->chunks[index];
+	*len = c->len;
+	/* the last message is accounted on commit, add it here. */
+	if (index == a->cur && a->last)
+		*len += MNL_ALIGN(a->last->nlmsg_len);
+
+	return (void *)c->data;
+}
+
+/**
+ * @}
+ */
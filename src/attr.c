@@ -8,6 +8,7 @@
  */
 #include <limits.h>	/* for INT_MAX */
 #include <libmnl/libmnl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include "internal.h"
@@ -332,6 +333,127 @@ int mnl_attr_parse_payload(const void *payload, size_t payload_len,
 	return ret;
 }
 
+/**
+ * mnl_attr_scan - record the boundaries of a sequence of attributes
+ * \param payload pointer to the area that contains the attributes
+ * \param payload_len length of the area that contains the attributes
+ * \param spans array to store the offset, length and type of each attribute
+ * \param max number of elements in the spans array
+ *
+ * This function walks over the attributes in one tight loop that does not
+ * invoke any callback, and it stores the offset to payload, the length and
+ * the type (without flags) of each attribute in the spans array. Unlike
+ * the attribute iterators, which silently stop on the first malformed
+ * attribute, this function validates the length of all the attributes. If
+ * the area ends with less bytes than the attribute header, they are
+ * considered padding.
+ *
+ * You can pass the result to mnl_attr_parse_policy() to validate the
+ * attributes and to store them in an array indexed by type.
+ *
+ * On success, this function returns the number of attributes that have been
+ * found. On error, it returns -1 and errno is explicitly set. If one
+ * attribute is malformed or truncated, errno is set to EBADMSG. If there are
+ * more than max attributes, errno is set to ENOSPC.
+ */
+EXPORT_SYMBOL(mnl_attr_scan);
+int mnl_attr_scan(const void *payload, size_t payload_len,
+		  struct mnl_attr_span *spans, unsigned int max)
+{
+	const char *base = payload;
+	size_t off = 0;
+	unsigned int n = 0;
+
+	if (payload_len > UINT32_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* the length of each attribute tells us where the next one is, so
+	 * the only thing we can do is to keep the loop body small. */
+	while (payload_len - off >= sizeof(struct nlattr)) {
+		const struct nlattr *attr = (const struct nlattr *)(base + off);
+		uint16_t len = attr->nla_len;
+
+		if (__builtin_expect(len < sizeof(struct nlattr) ||
+				     len > payload_len - off, 0)) {
+			errno = EBADMSG;
+			return -1;
+		}
+		if (__builtin_expect(n >= max, 0)) {
+			errno = ENOSPC;
+			return -1;
+		}
+		spans[n].offset = off;
+		spans[n].len = len;
+		spans[n].type = attr->nla_type & NLA_TYPE_MASK;
+		n++;
+
+		off += MNL_ALIGN(len);
+		if (off > payload_len)
+			break;
+	}
+	return n;
+}
+
+/**
+ * mnl_attr_parse_policy - validate attributes according to a policy
+ * \param payload pointer to the area that contains the attributes
+ * \param spans array that was filled by mnl_attr_scan()
+ * \param n number of elements in the spans array
+ * \param policy array of attribute policies indexed by attribute type
+ * \param maxtype maximum attribute type in the policy array
+ * \param tb array of maxtype + 1 elements to store the attributes
+ *
+ * This function validates each attribute against the policy that applies
+ * to its type, as mnl_attr_validate2() does, and it stores a pointer to the
+ * attribute in the tb array. If the length of the policy is zero, the
+ * expected length for the data type is used (see mnl_attr_validate()).
+ * Attributes whose policy type is MNL_TYPE_UNSPEC are stored without
+ * validation. Attributes whose type is higher than maxtype are skipped, see
+ * mnl_attr_type_valid() for the reasons.
+ *
+ * The tb array is not cleared by this function, so that you can call it
+ * several times to fill it from different areas.
+ *
+ * On error, this function returns -1 and errno is explicitly set, in that
+ * case the tb array contains the attributes that have been validated so far.
+ * On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_attr_parse_policy);
+int mnl_attr_parse_policy(const void *payload,
+			  const struct mnl_attr_span *spans, unsigned int n,
+			  const struct mnl_attr_policy *policy,
+			  uint16_t maxtype, const struct nlattr **tb)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		const struct nlattr *attr;
+		const struct mnl_attr_policy *p;
+		size_t exp_len;
+
+		if (spans[i].type > maxtype)
+			continue;
+
+		attr = (const struct nlattr *)((const char *)payload +
+					       spans[i].offset);
+		p = &policy[spans[i].type];
+		if (p->type != MNL_TYPE_UNSPEC) {
+			if (p->type >= MNL_TYPE_MAX) {
+				errno = EINVAL;
+				return -1;
+			}
+			exp_len = p->len ? p->len :
+				  mnl_attr_data_type_len[p->type];
+			if (__mnl_attr_validate(attr, p->type, exp_len) < 0)
+				return -1;
+		}
+		tb[spans[i].type] = attr;
+	}
+	return 0;
+}
+
 /**
  * mnl_attr_get_u8 - returns 8-bit unsigned integer attribute payload
  * \param attr pointer to netlink attribute
@@ -741,3 +863,160 @@ void mnl_attr_nest_cancel(struct nlmsghdr *nlh, struct nlattr *start)
 /**
  * @}
  */
+
+/**
+ * \defgroup attr_index Netlink attribute index
+ *
+ * If you look up several attributes of the same message from different
+ * parts of your code, you either have to parse the message several times or
+ * to carry an array of attributes around. The attribute index is a small
+ * dense array of offsets keyed by attribute type that you can attach to one
+ * message. It is built on the first lookup, so subsequent lookups are O(1)
+ * without copying the message.
+ *
+ * The index object is allocated once with mnl_attr_index_start() and it can
+ * be reused for many messages: mnl_attr_index_reset() only binds the index
+ * to a new message, it does not walk over the attributes.
+ *
+ * @{
+ */
+
+struct mnl_attr_index {
+	/* beginning of the sequence of attributes. */
+	const void	*payload;
+	size_t		len;
+	uint16_t	maxtype;
+	bool		built;
+	/* offset to payload plus one, zero means attribute is not present. */
+	uint32_t	off[];
+};
+
+/**
+ * mnl_attr_index_start - allocate an attribute index
+ * \param maxtype maximum attribute type that is indexed
+ *
+ * Attributes whose type is higher than maxtype are skipped when building
+ * the index. On error, it returns NULL and errno is set. Otherwise, it
+ * returns a pointer to the index that you have to release with
+ * mnl_attr_index_stop().
+ */
+EXPORT_SYMBOL(mnl_attr_index_start);
+struct mnl_attr_index *mnl_attr_index_start(uint16_t maxtype)
+{
+	struct mnl_attr_index *idx;
+
+	idx = calloc(1, sizeof(struct mnl_attr_index) +
+			(maxtype + 1) * sizeof(uint32_t));
+	if (idx == NULL)
+		return NULL;
+
+	idx->maxtype = maxtype;
+	return idx;
+}
+
+/**
+ * mnl_attr_index_stop - release an attribute index
+ * \param idx pointer to the index obtained via mnl_attr_index_start()
+ */
+EXPORT_SYMBOL(mnl_attr_index_stop);
+void mnl_attr_index_stop(struct mnl_attr_index *idx)
+{
+	free(idx);
+}
+
+/**
+ * mnl_attr_index_reset_payload - bind index to a sequence of attributes
+ * \param idx pointer to the index
+ * \param payload pointer to the area that contains the attributes
+ * \param payload_len length of the area that contains the attributes
+ *
+ * This function does not walk over the attributes, this happens on the
+ * first lookup. The memory area must remain valid while you use the index.
+ */
+EXPORT_SYMBOL(mnl_attr_index_reset_payload);
+void mnl_attr_index_reset_payload(struct mnl_attr_index *idx,
+				  const void *payload, size_t payload_len)
+{
+	idx->payload = payload;
+	idx->len = payload_len;
+	idx->built = false;
+}
+
+/**
+ * mnl_attr_index_reset - bind index to the attributes of a Netlink message
+ * \param idx pointer to the index
+ * \param nlh pointer to the Netlink message
+ * \param offset offset to the attributes (if payload is after any header)
+ *
+ * This function is like mnl_attr_index_reset_payload() but it takes the
+ * same parameters as mnl_attr_parse().
+ */
+EXPORT_SYMBOL(mnl_attr_index_reset);
+void mnl_attr_index_reset(struct mnl_attr_index *idx,
+			  const struct nlmsghdr *nlh, unsigned int offset)
+{
+	const char *payload = mnl_nlmsg_get_payload_offset(nlh, offset);
+
+	mnl_attr_index_reset_payload(idx, payload,
+			(const char *)mnl_nlmsg_get_payload_tail(nlh) - payload);
+}
+
+/**
+ * mnl_attr_index_reset_nested - bind index to the attributes inside a nest
+ * \param idx pointer to the index
+ * \param nested pointer to netlink attribute that contains a nest
+ */
+EXPORT_SYMBOL(mnl_attr_index_reset_nested);
+void mnl_attr_index_reset_nested(struct mnl_attr_index *idx,
+				 const struct nlattr *nested)
+{
+	mnl_attr_index_reset_payload(idx, mnl_attr_get_payload(nested),
+				     mnl_attr_get_payload_len(nested));
+}
+
+static void mnl_attr_index_build(struct mnl_attr_index *idx)
+{
+	const struct nlattr *attr;
+
+	memset(idx->off, 0, (idx->maxtype + 1) * sizeof(uint32_t));
+
+	/* the last attribute wins if there are duplicates, as it happens
+	 * if you store them in an array from your mnl_attr_parse() callback. */
+	mnl_attr_for_each_payload(idx->payload, idx->len) {
+		uint16_t type = mnl_attr_get_type(attr);
+
+		if (type <= idx->maxtype)
+			idx->off[type] = (const char *)attr -
+					 (const char *)idx->payload + 1;
+	}
+	idx->built = true;
+}
+
+/**
+ * mnl_attr_index_get - look up an attribute by type
+ * \param idx pointer to the index
+ * \param type attribute type
+ *
+ * The first lookup after mnl_attr_index_reset() walks over the attributes
+ * to build the index, subsequent lookups are O(1). This function returns
+ * NULL if the attribute is not present or if its type is higher than the
+ * maximum type of the index. Note that this does not validate the attribute
+ * payload, use mnl_attr_validate() for this.
+ */
+EXPORT_SYMBOL(mnl_attr_index_get);
+const struct nlattr *mnl_attr_index_get(struct mnl_attr_index *idx,
+					uint16_t type)
+{
+	if (!idx->built)
+		mnl_attr_index_build(idx);
+
+	if (type > idx->maxtype || idx->off[type] == 0)
+		return NULL;
+
+	return (const struct nlattr *)((const char *)idx->payload +
+				       idx->off[type] - 1);
+}
+
+/**
+ * @}
+ */
@@ -45,6 +45,47 @@ static const mnl_cb_t default_cb_array[NLMSG_MIN_TYPE] = {
 	[NLMSG_OVERRUN]	= mnl_cb_noop,
 };
 
+/* returns ret if there is no handler for this message. */
+static inline int __mnl_cb_dispatch(const struct nlmsghdr *nlh, int ret,
+				    mnl_cb_t cb_data, void *data,
+				    const mnl_cb_t *cb_ctl_array,
+				    unsigned int cb_ctl_array_len)
+{
+	/* netlink data message handling */
+	if (nlh->nlmsg_type >= NLMSG_MIN_TYPE) {
+		if (cb_data)
+			return cb_data(nlh, data);
+	} else if (nlh->nlmsg_type < cb_ctl_array_len) {
+		if (cb_ctl_array && cb_ctl_array[nlh->nlmsg_type])
+			return cb_ctl_array[nlh->nlmsg_type](nlh, data);
+	} else if (default_cb_array[nlh->nlmsg_type]) {
+		return default_cb_array[nlh->nlmsg_type](nlh, data);
+	}
+	return ret;
+}
+
+static inline int __mnl_cb_check(const struct nlmsghdr *nlh,
+				 unsigned int seq, unsigned int portid)
+{
+	/* check message source */
+	if (!mnl_nlmsg_portid_ok(nlh, portid)) {
+		errno = ESRCH;
+		return -1;
+	}
+	/* perform sequence tracking */
+	if (!mnl_nlmsg_seq_ok(nlh, seq)) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	/* dump was interrupted */
+	if (nlh->nlmsg_flags & NLM_F_DUMP_INTR) {
+		errno = EINTR;
+		return -1;
+	}
+	return 0;
+}
+
 static inline int __mnl_cb_run(const void *buf, size_t numbytes,
 			       unsigned int seq, unsigned int portid,
 			       mnl_cb_t cb_data, void *data,
@@ -55,41 +96,14 @@ static inline int __mnl_cb_run(const void *buf, size_t numbytes,
 	const struct nlmsghdr *nlh = buf;
 
 	while (mnl_nlmsg_ok(nlh, len)) {
-		/* check message source */
-		if (!mnl_nlmsg_portid_ok(nlh, portid)) {
-			errno = ESRCH;
+		if (__mnl_cb_check(nlh, seq, portid) < 0)
 			return -1;
-		}
-		/* perform sequence tracking */
-		if (!mnl_nlmsg_seq_ok(nlh, seq)) {
-			errno = EPROTO;
-			return -1;
-		}
 
-		/* dump was interrupted */
-		if (nlh->nlmsg_flags & NLM_F_DUMP_INTR) {
-			errno = EINTR;
-			return -1;
-		}
+		ret = __mnl_cb_dispatch(nlh, ret, cb_data, data,
+					cb_ctl_array, cb_ctl_array_len);
+		if (ret <= MNL_CB_STOP)
+			goto out;
 
-		/* netlink data message handling */
-		if (nlh->nlmsg_type >= NLMSG_MIN_TYPE) { 
-			if (cb_data){
-				ret = cb_data(nlh, data);
-				if (ret <= MNL_CB_STOP)
-					goto out;
-			}
-		} else if (nlh->nlmsg_type < cb_ctl_array_len) {
-			if (cb_ctl_array && cb_ctl_array[nlh->nlmsg_type]) {
-				ret = cb_ctl_array[nlh->nlmsg_type](nlh, data);
-				if (ret <= MNL_CB_STOP)
-					goto out;
-			}
-		} else if (default_cb_array[nlh->nlmsg_type]) {
-			ret = default_cb_array[nlh->nlmsg_type](nlh, data);
-			if (ret <= MNL_CB_STOP)
-				goto out;
-		}
 		nlh = mnl_nlmsg_next(nlh, &len);
 	}
 out:
@@ -162,6 +176,197 @@ int mnl_cb_run(const void *buf, size_t numbytes, unsigned int seq,
 	return __mnl_cb_run(buf, numbytes, seq, portid, cb_data, data, NULL, 0);
 }
 
+/**
+ * mnl_cb_index - validate a buffer of netlink messages and index them
+ * \param buf buffer that contains the netlink messages
+ * \param numbytes number of bytes stored in the buffer
+ * \param seq sequence number that we expect to receive
+ * \param portid Netlink PortID that we expect to receive
+ * \param offsets array to store the offset of each message in the buffer
+ * \param max number of elements in the offsets array
+ *
+ * This function performs the same checks as mnl_cb_run2() on all the
+ * messages in the buffer in one pass, without calling any handler, and it
+ * stores the offset of each message in the offsets array. Since this loop
+ * only touches the message headers, it runs faster than interleaving the
+ * checks with your handlers, and it allows you to know how many messages
+ * there are before processing them. Then, you can use mnl_cb_run_index()
+ * to dispatch them, or split the array into ranges to process them from
+ * several threads.
+ *
+ * Unlike mnl_cb_run2(), this function does not stop on NLMSG_DONE or
+ * NLMSG_ERROR: all the messages in the buffer are indexed, including
+ * control messages. A truncated message at the end of the buffer is
+ * silently ignored, as mnl_cb_run2() does.
+ *
+ * On success, it returns the number of messages that have been indexed.
+ * On error, it returns -1 and errno is explicitly set. See mnl_cb_run2() for
+ * the errno values that are related to the message checks. If there are
+ * more than max messages in the buffer, errno is set to ENOSPC.
+ */
+EXPORT_SYMBOL(mnl_cb_index);
+int mnl_cb_index(const void *buf, size_t numbytes, unsigned int seq,
+		 unsigned int portid, uint32_t *offsets, unsigned int max)
+{
+	const struct nlmsghdr *nlh = buf;
+	int len = numbytes;
+	unsigned int n = 0;
+
+	while (mnl_nlmsg_ok(nlh, len)) {
+		const struct nlmsghdr *next;
+
+		/* fetch the next header while we check this one. */
+		next = (const struct nlmsghdr *)((const char *)nlh +
+						 MNL_ALIGN(nlh->nlmsg_len));
+		__builtin_prefetch(next);
+
+		if (__builtin_expect(__mnl_cb_check(nlh, seq, portid) < 0, 0))
+			return -1;
+
+		if (__builtin_expect(n >= max, 0)) {
+			errno = ENOSPC;
+			return -1;
+		}
+		offsets[n++] = (const char *)nlh - (const char *)buf;
+
+		len -= MNL_ALIGN(nlh->nlmsg_len);
+		nlh = next;
+	}
+	return n;
+}
+
+/**
+ * mnl_cb_run_index - callback runqueue for indexed netlink messages
+ * \param buf buffer that contains the netlink messages
+ * \param offsets array of message offsets filled by mnl_cb_index()
+ * \param n number of elements in the offsets array
+ * \param cb_data callback handler for data messages
+ * \param data pointer to data that will be passed to the data callback handler
+ * \param cb_ctl_array array of custom callback handlers from control messages
+ * \param cb_ctl_array_len array length of custom control callback handlers
+ *
+ * This function is like mnl_cb_run2() but it does not perform any check on
+ * the messages, since mnl_cb_index() already did. You can pass a range of
+ * the offsets array (ie. offsets + i and n - i) to process only part of the
+ * messages, eg. from different threads.
+ *
+ * This function propagates the callback return value.
+ */
+EXPORT_SYMBOL(mnl_cb_run_index);
+int mnl_cb_run_index(const void *buf, const uint32_t *offsets, unsigned int n,
+		     mnl_cb_t cb_data, void *data,
+		     const mnl_cb_t *cb_ctl_array,
+		     unsigned int cb_ctl_array_len)
+{
+	int ret = MNL_CB_OK;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		const struct nlmsghdr *nlh;
+
+		nlh = (const struct nlmsghdr *)((const char *)buf + offsets[i]);
+		ret = __mnl_cb_dispatch(nlh, ret, cb_data, data,
+					cb_ctl_array, cb_ctl_array_len);
+		if (ret <= MNL_CB_STOP)
+			break;
+	}
+	return ret;
+}
+
+/**
+ * mnl_nlmsg_iter_init - initialize a netlink message iterator
+ * \param it pointer to the iterator
+ * \param buf buffer that contains the netlink messages
+ * \param numbytes number of bytes stored in the buffer
+ * \param seq sequence number that we expect to receive
+ * \param portid Netlink PortID that we expect to receive
+ *
+ * The iterator is an alternative to mnl_cb_run() that does not require a
+ * callback: you obtain the data messages one by one via
+ * mnl_nlmsg_iter_next() from your own loop, so you can keep your state in
+ * local variables and you can stop and resume the iteration at any point.
+ * The iterator applies the same checks and handles the control messages in
+ * the same way as mnl_cb_run() does. The iterator does not allocate memory,
+ * so you can place it in the stack.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_iter_init);
+void mnl_nlmsg_iter_init(struct mnl_nlmsg_iter *it, const void *buf,
+			 size_t numbytes, unsigned int seq, unsigned int portid)
+{
+	it->nlh = buf;
+	it->len = numbytes;
+	it->seq = seq;
+	it->portid = portid;
+	it->ret = MNL_CB_OK;
+}
+
+/**
+ * mnl_nlmsg_iter_next - get the next data message
+ * \param it pointer to the iterator
+ *
+ * This function returns the next data message in the buffer, ie. a message
+ * whose type is equal or higher than NLMSG_MIN_TYPE. Control messages are
+ * handled internally. If there are no more data messages, it returns NULL
+ * and you have to check mnl_nlmsg_iter_status() to know why.
+ *
+ * A typical loop looks like:
+ *
+ * \verbatim
+	mnl_nlmsg_iter_init(&it, buf, ret, seq, portid);
+	while ((nlh = mnl_nlmsg_iter_next(&it)) != NULL) {
+		... handle message ...
+	}
+	ret = mnl_nlmsg_iter_status(&it);
+\endverbatim
+ */
+EXPORT_SYMBOL(mnl_nlmsg_iter_next);
+const struct nlmsghdr *mnl_nlmsg_iter_next(struct mnl_nlmsg_iter *it)
+{
+	const struct nlmsghdr *nlh = it->nlh;
+
+	while (mnl_nlmsg_ok(nlh, it->len)) {
+		if (__mnl_cb_check(nlh, it->seq, it->portid) < 0) {
+			it->ret = -1;
+			goto out;
+		}
+
+		it->nlh = mnl_nlmsg_next(nlh, &it->len);
+		if (nlh->nlmsg_type >= NLMSG_MIN_TYPE)
+			return nlh;
+
+		if (default_cb_array[nlh->nlmsg_type]) {
+			it->ret = default_cb_array[nlh->nlmsg_type](nlh, NULL);
+			if (it->ret <= MNL_CB_STOP)
+				goto out;
+		}
+		nlh = it->nlh;
+	}
+	return NULL;
+out:
+	/* subsequent calls to mnl_nlmsg_iter_next() return NULL. */
+	it->len = 0;
+	return NULL;
+}
+
+/**
+ * mnl_nlmsg_iter_status - get the status of the iterator
+ * \param it pointer to the iterator
+ *
+ * Once mnl_nlmsg_iter_next() has returned NULL, this function returns the
+ * same value that mnl_cb_run() would have returned for this buffer:
+ *	- MNL_CB_ERROR (-1): an error has occurred, errno is set. This includes
+ *	  the NLMSG_ERROR messages carrying an error, see mnl_cb_run2() for the
+ *	  errno values set by the message checks.
+ *	- MNL_CB_STOP (0): NLMSG_DONE or an acknowledgment has been received.
+ *	- MNL_CB_OK (1): the buffer has been consumed, you have to receive more
+ *	  messages and call mnl_nlmsg_iter_init() again.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_iter_status);
+int mnl_nlmsg_iter_status(const struct mnl_nlmsg_iter *it)
+{
+	return it->ret;
+}
+
 /**
  * @}
  */
@@ -0,0 +1,556 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <libmnl/libmnl.h>
+#include "internal.h"
+
+/**
+ * \defgroup decode Structured message decoder
+ *
+ * mnl_nlmsg_fprintf() shows the layout of the messages byte by byte, which
+ * is useful to debug the construction of a message, but not to follow the
+ * traffic of an application. The decoder renders each message in one line,
+ * with the names of the message type and of the attributes, either as
+ * compact text:
+ *
+ * \verbatim
+	RTM_NEWLINK len=1292 flags=0x2 seq=1 pid=4242 hdr="00000100..." IFLA_IFNAME="lo" IFLA_MTU=65536 IFLA_LINKINFO={IFLA_INFO_KIND="veth"}
+\endverbatim
+ *
+ * or as one JSON object per message. The output is written into a buffer
+ * that you provide, with no memory allocation nor stdio calls, so you can
+ * log it the way that suits you.
+ *
+ * The decoder knows nothing about the Netlink buses, you describe the
+ * messages that you want to decode via mnl_decoder_add(): for each message
+ * type, its name, the size of its family header and the table that gives
+ * the name and the data type of its attributes. Since message types
+ * overlap between buses, use one decoder per bus. Anything that is not
+ * described is rendered by number, with the payload in hexadecimal.
+ *
+ * @{
+ */
+
+/* deeper nests are shown in hexadecimal. */
+#define MNL_DECODE_MAX_DEPTH	16
+
+struct mnl_decoder {
+	enum mnl_decode_mode	mode;
+	/* sorted by type. */
+	struct mnl_decode_msg	*msgs;
+	unsigned int		num_msgs;
+};
+
+/**
+ * mnl_decoder_start - allocate a message decoder
+ * \param mode MNL_DECODE_TEXT or MNL_DECODE_JSON
+ *
+ * On error, it returns NULL and errno is set. Otherwise, it returns a pointer
+ * to the decoder that you have to release via mnl_decoder_stop().
+ */
+EXPORT_SYMBOL(mnl_decoder_start);
+struct mnl_decoder *mnl_decoder_start(enum mnl_decode_mode mode)
+{
+	struct mnl_decoder *d;
+
+	if (mode != MNL_DECODE_TEXT && mode != MNL_DECODE_JSON) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	d = calloc(1, sizeof(struct mnl_decoder));
+	if (d == NULL)
+		return NULL;
+
+	d->mode = mode;
+	return d;
+}
+
+/**
+ * mnl_decoder_stop - release a message decoder
+ * \param d pointer to the decoder
+ */
+EXPORT_SYMBOL(mnl_decoder_stop);
+void mnl_decoder_stop(struct mnl_decoder *d)
+{
+	free(d->msgs);
+	free(d);
+}
+
+static int mnl_decode_msg_cmp(const void *a, const void *b)
+{
+	const struct mnl_decode_msg *ma = a, *mb = b;
+
+	return (int)ma->type - (int)mb->type;
+}
+
+/**
+ * mnl_decoder_add - describe message types to the decoder
+ * \param d pointer to the decoder
+ * \param msgs array of message descriptions
+ * \param n number of elements in the array
+ *
+ * The descriptions are copied, but the names and the attribute tables they
+ * point to are not, so they have to outlive the decoder, which is the case
+ * of static tables. A message type that is already known is replaced.
+ *
+ * On error, it returns -1 and errno is set. On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_decoder_add);
+int mnl_decoder_add(struct mnl_decoder *d, const struct mnl_decode_msg *msgs,
+		    unsigned int n)
+{
+	struct mnl_decode_msg *m;
+	unsigned int i, j;
+
+	m = realloc(d->msgs, (d->num_msgs + n) * sizeof(struct mnl_decode_msg));
+	if (m == NULL)
+		return -1;
+
+	d->msgs = m;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < d->num_msgs; j++) {
+			if (d->msgs[j].type == msgs[i].type)
+				break;
+		}
+		d->msgs[j] = msgs[i];
+		if (j == d->num_msgs)
+			d->num_msgs++;
+	}
+	qsort(d->msgs, d->num_msgs, sizeof(struct mnl_decode_msg),
+	      mnl_decode_msg_cmp);
+	return 0;
+}
+
+static const struct mnl_decode_msg *
+mnl_decoder_lookup(const struct mnl_decoder *d, uint16_t type)
+{
+	const struct mnl_decode_msg key = { .type = type };
+
+	if (d->num_msgs == 0)
+		return NULL;
+
+	return bsearch(&key, d->msgs, d->num_msgs,
+		       sizeof(struct mnl_decode_msg), mnl_decode_msg_cmp);
+}
+
+/*
+ * Output buffer: the length keeps growing when the buffer is full, so that
+ * the caller learns how much room the whole message needs, as snprintf()
+ * does.
+ */
+struct mnl_decode_out {
+	char		*buf;
+	size_t		size;
+	size_t		len;
+	bool		json;
+};
+
+static void out_mem(struct mnl_decode_out *o, const char *s, size_t n)
+{
+	if (o->len < o->size) {
+		size_t room = o->size - o->len;
+
+		memcpy(o->buf + o->len, s, n < room ? n : room);
+	}
+	o->len += n;
+}
+
+static void out_str(struct mnl_decode_out *o, const char *s)
+{
+	out_mem(o, s, strlen(s));
+}
+
+static void out_char(struct mnl_decode_out *o, char c)
+{
+	if (o->len < o->size)
+		o->buf[o->len] = c;
+	o->len++;
+}
+
+static void out_u64(struct mnl_decode_out *o, uint64_t v)
+{
+	char tmp[20];
+	int i = sizeof(tmp);
+
+	do {
+		tmp[--i] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	out_mem(o, tmp + i, sizeof(tmp) - i);
+}
+
+static void out_i64(struct mnl_decode_out *o, int64_t v)
+{
+	if (v < 0) {
+		out_char(o, '-');
+		out_u64(o, -(uint64_t)v);
+	} else {
+		out_u64(o, v);
+	}
+}
+
+static const char mnl_decode_hex[] = "0123456789abcdef";
+
+static void out_hex_u64(struct mnl_decode_out *o, uint64_t v)
+{
+	char tmp[16];
+	int i = sizeof(tmp);
+
+	do {
+		tmp[--i] = mnl_decode_hex[v & 0xf];
+		v >>= 4;
+	} while (v);
+
+	/* JSON has no hexadecimal numbers, make it a string there. */
+	if (o->json)
+		out_char(o, '"');
+	out_mem(o, "0x", 2);
+	out_mem(o, tmp + i, sizeof(tmp) - i);
+	if (o->json)
+		out_char(o, '"');
+}
+
+static void out_hex_mem(struct mnl_decode_out *o, const void *data, size_t n)
+{
+	const uint8_t *p = data;
+	size_t i;
+
+	out_char(o, '"');
+	for (i = 0; i < n; i++) {
+		out_char(o, mnl_decode_hex[p[i] >> 4]);
+		out_char(o, mnl_decode_hex[p[i] & 0xf]);
+	}
+	out_char(o, '"');
+}
+
+/* quoted string, stops at the first NUL, escaped in the JSON way. */
+static void out_quoted(struct mnl_decode_out *o, const char *s, size_t n)
+{
+	size_t i, start = 0;
+
+	out_char(o, '"');
+	for (i = 0; i < n && s[i]; i++) {
+		unsigned char c = s[i];
+
+		if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f)
+			continue;
+
+		out_mem(o, s + start, i - start);
+		start = i + 1;
+		if (c == '"' || c == '\\') {
+			out_char(o, '\\');
+			out_char(o, c);
+		} else {
+			out_mem(o, "\\u00", 4);
+			out_char(o, mnl_decode_hex[c >> 4]);
+			out_char(o, mnl_decode_hex[c & 0xf]);
+		}
+	}
+	out_mem(o, s + start, i - start);
+	out_char(o, '"');
+}
+
+/* attribute or field name, followed by the separator of the mode. */
+static void out_key(struct mnl_decode_out *o, const char *name, uint16_t type)
+{
+	if (o->json)
+		out_char(o, '"');
+	if (name)
+		out_str(o, name);
+	else
+		out_u64(o, type);
+	if (o->json)
+		out_mem(o, "\":", 2);
+	else
+		out_char(o, '=');
+}
+
+static void out_sep(struct mnl_decode_out *o, bool *first)
+{
+	if (!*first)
+		out_char(o, o->json ? ',' : ' ');
+	*first = false;
+}
+
+static void mnl_decode_attrs(struct mnl_decode_out *o, const void *payload,
+			     size_t len, const struct mnl_decode_table *t,
+			     unsigned int depth);
+
+static void mnl_decode_int(struct mnl_decode_out *o, const struct nlattr *attr,
+			   const struct mnl_decode_attr *a)
+{
+	uint16_t len = mnl_attr_get_payload_len(attr);
+	const void *p = mnl_attr_get_payload(attr);
+	bool be = a->flags & MNL_DECODE_F_BE;
+	uint64_t v;
+
+	switch (a->type) {
+	case MNL_TYPE_U8:
+		if (len != sizeof(uint8_t))
+			goto hex;
+		v = *(const uint8_t *)p;
+		break;
+	case MNL_TYPE_U16:
+		if (len != sizeof(uint16_t))
+			goto hex;
+		v = be ? ntohs(*(const uint16_t *)p) : *(const uint16_t *)p;
+		break;
+	case MNL_TYPE_U32:
+		if (len != sizeof(uint32_t))
+			goto hex;
+		v = be ? ntohl(*(const uint32_t *)p) : *(const uint32_t *)p;
+		break;
+	default:
+		if (len != sizeof(uint64_t))
+			goto hex;
+		memcpy(&v, p, sizeof(v));
+		if (be)
+			v = be64toh(v);
+		break;
+	}
+	if (a->flags & MNL_DECODE_F_HEX)
+		out_hex_u64(o, v);
+	else
+		out_u64(o, v);
+	return;
+hex:
+	out_hex_mem(o, p, len);
+}
+
+static void mnl_decode_attr(struct mnl_decode_out *o, const struct nlattr *nla,
+			    const struct mnl_decode_attr *a, unsigned int depth)
+{
+	static const struct mnl_decode_attr unknown = {};
+	const void *p = mnl_attr_get_payload(nla);
+	uint16_t len = mnl_attr_get_payload_len(nla);
+
+	if (a == NULL) {
+		/* nests that are not described can only be told apart if
+		 * they are flagged, which rtnetlink and ctnetlink mostly do
+		 * not do, so the others are shown as hex. */
+		if (!(nla->nla_type & NLA_F_NESTED) ||
+		    depth >= MNL_DECODE_MAX_DEPTH) {
+			out_hex_mem(o, p, len);
+			return;
+		}
+		a = &unknown;
+		goto nested;
+	}
+
+	switch (a->type) {
+	case MNL_TYPE_U8:
+	case MNL_TYPE_U16:
+	case MNL_TYPE_U32:
+	case MNL_TYPE_U64:
+	case MNL_TYPE_MSECS:
+		mnl_decode_int(o, nla, a);
+		break;
+	case MNL_TYPE_STRING:
+	case MNL_TYPE_NUL_STRING:
+		out_quoted(o, p, len);
+		break;
+	case MNL_TYPE_FLAG:
+		out_str(o, "true");
+		break;
+	case MNL_TYPE_NESTED:
+	case MNL_TYPE_NESTED_COMPAT:
+		if (depth >= MNL_DECODE_MAX_DEPTH) {
+			out_hex_mem(o, p, len);
+			break;
+		}
+		goto nested;
+	default:
+		out_hex_mem(o, p, len);
+		break;
+	}
+	return;
+nested:
+	if (a->flags & MNL_DECODE_F_ARRAY) {
+		const struct nlattr *attr;
+		bool first = true;
+
+		/* the types of the elements are indexes, not names. */
+		out_char(o, '[');
+		mnl_attr_for_each_payload(p, len) {
+			out_sep(o, &first);
+			out_char(o, '{');
+			mnl_decode_attrs(o, mnl_attr_get_payload(attr),
+					 mnl_attr_get_payload_len(attr),
+					 a->nested, depth + 1);
+			out_char(o, '}');
+		}
+		out_char(o, ']');
+	} else {
+		out_char(o, '{');
+		mnl_decode_attrs(o, p, len, a->nested, depth + 1);
+		out_char(o, '}');
+	}
+}
+
+static void mnl_decode_attrs(struct mnl_decode_out *o, const void *payload,
+			     size_t len, const struct mnl_decode_table *t,
+			     unsigned int depth)
+{
+	const struct nlattr *attr;
+	bool first = true;
+	size_t left;
+
+	mnl_attr_for_each_payload(payload, len) {
+		uint16_t type = mnl_attr_get_type(attr);
+		const struct mnl_decode_attr *a = NULL;
+
+		if (t && type <= t->maxtype && t->attrs[type].name)
+			a = &t->attrs[type];
+
+		out_sep(o, &first);
+		out_key(o, a ? a->name : NULL, type);
+		mnl_decode_attr(o, attr, a, depth);
+	}
+
+	/* the iterator stops at the first malformed attribute. */
+	left = (const char *)payload + len - (const char *)attr;
+	if (left >= MNL_ATTR_HDRLEN) {
+		out_sep(o, &first);
+		out_key(o, "truncated", 0);
+		out_u64(o, left);
+	}
+}
+
+static void mnl_decode_field_u64(struct mnl_decode_out *o, bool *first,
+				 const char *name, uint64_t v, bool hex)
+{
+	out_sep(o, first);
+	out_key(o, name, 0);
+	if (hex)
+		out_hex_u64(o, v);
+	else
+		out_u64(o, v);
+}
+
+/**
+ * mnl_decoder_nlmsg - render one message
+ * \param d pointer to the decoder
+ * \param nlh pointer to the message, whose length has been validated, eg.
+ * by mnl_nlmsg_ok()
+ * \param buf buffer to store the output
+ * \param size size of the buffer
+ *
+ * The output is one line with no trailing newline, it is always terminated
+ * with a NUL byte if size is not zero. As snprintf() does, this function
+ * returns the length of the whole output, without the NUL byte, so if the
+ * returned value is size or more, the output was truncated.
+ */
+EXPORT_SYMBOL(mnl_decoder_nlmsg);
+size_t mnl_decoder_nlmsg(const struct mnl_decoder *d,
+			 const struct nlmsghdr *nlh, char *buf, size_t size)
+{
+	struct mnl_decode_out o = {
+		.buf	= buf,
+		.size	= size,
+		.json	= d->mode == MNL_DECODE_JSON,
+	};
+	const struct mnl_decode_msg *m = NULL;
+	const char *payload = mnl_nlmsg_get_payload(nlh);
+	size_t payload_len = mnl_nlmsg_get_payload_len(nlh);
+	bool first = true;
+
+	if (nlh->nlmsg_type >= NLMSG_MIN_TYPE)
+		m = mnl_decoder_lookup(d, nlh->nlmsg_type);
+
+	if (o.json)
+		out_char(&o, '{');
+
+	/* the message type goes first, with no key in text mode. */
+	if (o.json) {
+		out_sep(&o, &first);
+		out_key(&o, "type", 0);
+		out_char(&o, '"');
+	}
+	switch (nlh->nlmsg_type) {
+	case NLMSG_NOOP:
+		out_str(&o, "NLMSG_NOOP");
+		break;
+	case NLMSG_ERROR:
+		out_str(&o, "NLMSG_ERROR");
+		break;
+	case NLMSG_DONE:
+		out_str(&o, "NLMSG_DONE");
+		break;
+	case NLMSG_OVERRUN:
+		out_str(&o, "NLMSG_OVERRUN");
+		break;
+	default:
+		if (m && m->name)
+			out_str(&o, m->name);
+		else
+			out_u64(&o, nlh->nlmsg_type);
+		break;
+	}
+	if (o.json)
+		out_char(&o, '"');
+	first = false;
+
+	mnl_decode_field_u64(&o, &first, "len", nlh->nlmsg_len, false);
+	mnl_decode_field_u64(&o, &first, "flags", nlh->nlmsg_flags, true);
+	mnl_decode_field_u64(&o, &first, "seq", nlh->nlmsg_seq, false);
+	mnl_decode_field_u64(&o, &first, "pid", nlh->nlmsg_pid, false);
+
+	if (nlh->nlmsg_type == NLMSG_ERROR &&
+	    payload_len >= sizeof(struct nlmsgerr)) {
+		const struct nlmsgerr *err = (const struct nlmsgerr *)payload;
+
+		out_sep(&o, &first);
+		out_key(&o, "error", 0);
+		out_i64(&o, err->error);
+		mnl_decode_field_u64(&o, &first, "orig_type",
+				     err->msg.nlmsg_type, false);
+		mnl_decode_field_u64(&o, &first, "orig_seq",
+				     err->msg.nlmsg_seq, false);
+	} else if (m && payload_len >= (size_t)MNL_ALIGN(m->hdrlen)) {
+		if (m->hdrlen) {
+			out_sep(&o, &first);
+			out_key(&o, "hdr", 0);
+			out_hex_mem(&o, payload, m->hdrlen);
+		}
+		payload += MNL_ALIGN(m->hdrlen);
+		payload_len -= MNL_ALIGN(m->hdrlen);
+		if (payload_len) {
+			if (o.json) {
+				out_sep(&o, &first);
+				out_key(&o, "attrs", 0);
+				out_char(&o, '{');
+			} else {
+				out_sep(&o, &first);
+			}
+			mnl_decode_attrs(&o, payload, payload_len, m->table, 0);
+			if (o.json)
+				out_char(&o, '}');
+		}
+	} else if (payload_len) {
+		out_sep(&o, &first);
+		out_key(&o, "payload", 0);
+		out_hex_mem(&o, payload, payload_len);
+	}
+
+	if (o.json)
+		out_char(&o, '}');
+
+	if (size)
+		buf[o.len < size ? o.len : size - 1] = '\0';
+
+	return o.len;
+}
+
+/**
+ * @}
+ */
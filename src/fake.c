@@ -0,0 +1,543 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <libmnl/libmnl.h>
+#include "internal.h"
+
+/**
+ * \defgroup fake Fake kernel endpoint
+ *
+ * A fake endpoint stands in for the kernel side of a Netlink socket, so
+ * that you can run your code, benchmarks and regression tests without a
+ * kernel, without privileges and with the same results on every run.
+ *
+ * mnl_fake_socket() gives you a regular struct mnl_socket that you use as
+ * usual. The requests that you send via mnl_socket_sendto() are passed to
+ * the responder of the endpoint message by message, in the calling thread.
+ * The responder queues the replies via mnl_fake_put(), mnl_fake_ack() and
+ * mnl_fake_dump(), and mnl_socket_recvfrom() returns them in order. You
+ * can also queue datagrams at any time, eg. to inject events as if they
+ * were sent to a multicast group.
+ *
+ * Dumps are produced as mnl_socket_recvfrom() is called: as many
+ * NLM_F_MULTI messages as fit in the buffer are packed into each datagram,
+ * and the last one is followed by NLMSG_DONE, like the kernel does. Thus,
+ * you can generate millions of entries without storing them. A dump can be
+ * flagged as interrupted (NLM_F_DUMP_INTR) from a given entry on, and
+ * mnl_fake_enobufs() or a receive buffer limit, see mnl_fake_set_rcvbuf(),
+ * make mnl_socket_recvfrom() fail with ENOBUFS as an overrun socket does.
+ *
+ * Nothing ever blocks: mnl_socket_recvfrom() fails with EAGAIN if there is
+ * nothing queued. There is no file descriptor behind the socket, so
+ * mnl_socket_get_fd() returns -1, mnl_socket_bind() only updates the port
+ * ID, mnl_socket_setsockopt() does nothing and mnl_socket_getsockopt()
+ * fails with ENOPROTOOPT.
+ *
+ * @{
+ */
+
+/* largest message that a dump callback may build. */
+#define MNL_FAKE_MSG_MAX	65536
+
+enum {
+	MNL_FAKE_DGRAM,
+	MNL_FAKE_DUMP,
+};
+
+/* queue record header, followed by the datagram or the dump state. */
+struct mnl_fake_rec {
+	uint32_t	kind;
+	uint32_t	len;
+};
+
+#define MNL_FAKE_REC_ALIGN(len)	(((len) + 7) & ~(size_t)7)
+
+struct mnl_fake_dump {
+	uint64_t		idx;
+	uint64_t		count;
+	uint64_t		intr_at;
+	mnl_fake_dump_cb_t	cb;
+	void			*data;
+	uint32_t		seq;
+	uint16_t		type;
+	bool			stopped;
+	int			error;
+};
+
+struct mnl_fake {
+	int			bus;
+	mnl_fake_cb_t		cb;
+	void			*data;
+	struct mnl_socket	*nl;
+	/* FIFO of records, compacted when it runs out of room at the end. */
+	char			*queue;
+	size_t			head;
+	size_t			tail;
+	size_t			size;
+	/* datagram bytes in the queue, and the limit, 0 means no limit. */
+	size_t			queued;
+	size_t			rcvbuf;
+	/* reported by the next mnl_socket_recvfrom(), before the queue. */
+	int			error;
+	/* incremented by mnl_fake_dump(), to skip the automatic ack. */
+	unsigned int		dumps;
+	/* message of the dump at the head that did not fit yet. */
+	size_t			pending;
+	char			*scratch;
+};
+
+static void *mnl_fake_push(struct mnl_fake *f, uint32_t kind, size_t len)
+{
+	size_t need = sizeof(struct mnl_fake_rec) + MNL_FAKE_REC_ALIGN(len);
+	struct mnl_fake_rec *rec;
+
+	if (f->tail + need > f->size) {
+		if (f->head > 0) {
+			memmove(f->queue, f->queue + f->head,
+				f->tail - f->head);
+			f->tail -= f->head;
+			f->head = 0;
+		}
+		if (f->tail + need > f->size) {
+			size_t size = f->size * 2;
+			char *queue;
+
+			while (f->tail + need > size)
+				size *= 2;
+
+			queue = realloc(f->queue, size);
+			if (queue == NULL)
+				return NULL;
+
+			f->queue = queue;
+			f->size = size;
+		}
+	}
+	rec = (struct mnl_fake_rec *)(f->queue + f->tail);
+	rec->kind = kind;
+	rec->len = len;
+	f->tail += need;
+
+	return rec + 1;
+}
+
+static void mnl_fake_pop(struct mnl_fake *f)
+{
+	struct mnl_fake_rec *rec = (struct mnl_fake_rec *)(f->queue + f->head);
+
+	if (rec->kind == MNL_FAKE_DGRAM)
+		f->queued -= rec->len;
+
+	f->head += sizeof(struct mnl_fake_rec) + MNL_FAKE_REC_ALIGN(rec->len);
+	if (f->head == f->tail)
+		f->head = f->tail = 0;
+}
+
+/* reserve room for a datagram, or drop it if the receive buffer is full. */
+static void *mnl_fake_push_dgram(struct mnl_fake *f, size_t len)
+{
+	void *buf;
+
+	if (f->rcvbuf && f->queued + len > f->rcvbuf) {
+		f->error = ENOBUFS;
+		errno = ENOBUFS;
+		return NULL;
+	}
+	buf = mnl_fake_push(f, MNL_FAKE_DGRAM, len);
+	if (buf == NULL)
+		return NULL;
+
+	f->queued += len;
+	return buf;
+}
+
+/**
+ * mnl_fake_start - create a fake kernel endpoint
+ * \param bus the netlink bus that is emulated (see NETLINK_* constants)
+ * \param cb responder that is called for each request, NULL to ack them all
+ * \param data pointer that is passed to the responder
+ *
+ * The responder is called for each message that is sent through the
+ * socket of the endpoint, except for control messages. It may queue any
+ * reply and it returns 0 on success or a negative errno value, as the
+ * handlers of the kernel do. The library then queues the acknowledgment
+ * like the kernel does: an error message if it failed, or an ack if the
+ * request has the NLM_F_ACK flag set and it did not start a dump.
+ *
+ * On error, it returns NULL and errno is appropriately set. Otherwise, it
+ * returns a valid pointer to the mnl_fake structure.
+ */
+EXPORT_SYMBOL(mnl_fake_start);
+struct mnl_fake *mnl_fake_start(int bus, mnl_fake_cb_t cb, void *data)
+{
+	struct mnl_fake *f;
+
+	f = calloc(1, sizeof(struct mnl_fake));
+	if (f == NULL)
+		return NULL;
+
+	f->size = 65536;
+	f->queue = malloc(f->size);
+	if (f->queue == NULL)
+		goto err;
+
+	f->scratch = malloc(MNL_FAKE_MSG_MAX);
+	if (f->scratch == NULL)
+		goto err;
+
+	f->bus = bus;
+	f->cb = cb;
+	f->data = data;
+
+	return f;
+err:
+	free(f->queue);
+	free(f);
+	return NULL;
+}
+
+/**
+ * mnl_fake_stop - release a fake kernel endpoint
+ * \param f endpoint obtained via mnl_fake_start()
+ *
+ * The replies that are still queued are dropped. If the socket of the
+ * endpoint is still open, any further operation on it fails with EBADF,
+ * so you should call mnl_socket_close() first.
+ */
+EXPORT_SYMBOL(mnl_fake_stop);
+void mnl_fake_stop(struct mnl_fake *f)
+{
+	if (f->nl)
+		__mnl_socket_unfake(f->nl);
+
+	free(f->scratch);
+	free(f->queue);
+	free(f);
+}
+
+/**
+ * mnl_fake_socket - open the socket that talks to a fake endpoint
+ * \param f endpoint obtained via mnl_fake_start()
+ *
+ * The socket behaves as a socket of the emulated bus that is already
+ * bound, its port ID is the process ID as it would be after automatic
+ * selection. Release it with mnl_socket_close() as usual. There is only
+ * one socket per endpoint, if it is already open errno is set to EBUSY.
+ *
+ * On error, it returns NULL and errno is appropriately set. Otherwise, it
+ * returns a valid pointer to the mnl_socket structure.
+ */
+EXPORT_SYMBOL(mnl_fake_socket);
+struct mnl_socket *mnl_fake_socket(struct mnl_fake *f)
+{
+	if (f->nl) {
+		errno = EBUSY;
+		return NULL;
+	}
+	f->nl = __mnl_socket_fake(f, f->bus, getpid());
+
+	return f->nl;
+}
+
+/**
+ * mnl_fake_set_rcvbuf - limit the datagrams that the endpoint may queue
+ * \param f endpoint obtained via mnl_fake_start()
+ * \param size limit in bytes, zero means no limit
+ *
+ * Once the datagrams that are queued would exceed this limit, the new ones
+ * are dropped and the next call to mnl_socket_recvfrom() fails with
+ * ENOBUFS, as it happens when the receive buffer of a socket overruns
+ * during an event storm. Dumps are produced on demand, so they do not
+ * count against this limit.
+ *
+ * This function returns 0.
+ */
+EXPORT_SYMBOL(mnl_fake_set_rcvbuf);
+int mnl_fake_set_rcvbuf(struct mnl_fake *f, size_t size)
+{
+	f->rcvbuf = size;
+	return 0;
+}
+
+/**
+ * mnl_fake_enobufs - report an overrun on the next receive
+ * \param f endpoint obtained via mnl_fake_start()
+ *
+ * The next call to mnl_socket_recvfrom() fails with ENOBUFS, before the
+ * queued replies are returned, and the call after that goes on with them.
+ */
+EXPORT_SYMBOL(mnl_fake_enobufs);
+void mnl_fake_enobufs(struct mnl_fake *f)
+{
+	f->error = ENOBUFS;
+}
+
+/**
+ * mnl_fake_put - queue a datagram
+ * \param f endpoint obtained via mnl_fake_start()
+ * \param buf buffer that contains one or more netlink messages
+ * \param len number of bytes in the buffer
+ *
+ * The datagram is copied, it is returned as is by mnl_socket_recvfrom()
+ * once the previous replies have been received.
+ *
+ * On error, this function returns -1 and errno is appropriately set, it
+ * is set to ENOBUFS if the datagram was dropped because of the receive
+ * buffer limit. On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_fake_put);
+int mnl_fake_put(struct mnl_fake *f, const void *buf, size_t len)
+{
+	void *dst;
+
+	dst = mnl_fake_push_dgram(f, len);
+	if (dst == NULL)
+		return -1;
+
+	memcpy(dst, buf, len);
+	return 0;
+}
+
+/**
+ * mnl_fake_ack - queue an acknowledgment
+ * \param f endpoint obtained via mnl_fake_start()
+ * \param req request that is acknowledged
+ * \param error zero for an ack, or a negative errno value
+ *
+ * This queues a NLMSG_ERROR message with the sequence number of the
+ * request. As the kernel does, an ack only includes the header of the
+ * request and it has the NLM_F_CAPPED flag set, while an error message
+ * includes the whole request.
+ *
+ * On error, this function returns -1 and errno is appropriately set.
+ * On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_fake_ack);
+int mnl_fake_ack(struct mnl_fake *f, const struct nlmsghdr *req, int error)
+{
+	size_t payload = error ? req->nlmsg_len : sizeof(struct nlmsghdr);
+	size_t len = MNL_NLMSG_HDRLEN + sizeof(struct nlmsgerr) -
+		     sizeof(struct nlmsghdr) + payload;
+	struct nlmsgerr *err;
+	struct nlmsghdr *nlh;
+
+	nlh = mnl_fake_push_dgram(f, MNL_ALIGN(len));
+	if (nlh == NULL)
+		return -1;
+
+	memset(nlh, 0, MNL_ALIGN(len));
+	nlh->nlmsg_len = len;
+	nlh->nlmsg_type = NLMSG_ERROR;
+	nlh->nlmsg_flags = error ? 0 : NLM_F_CAPPED;
+	nlh->nlmsg_seq = req->nlmsg_seq;
+	nlh->nlmsg_pid = f->nl ? mnl_socket_get_portid(f->nl) : 0;
+
+	err = mnl_nlmsg_get_payload(nlh);
+	err->error = error;
+	memcpy(&err->msg, req, payload);
+
+	return 0;
+}
+
+/**
+ * mnl_fake_dump - queue a dump
+ * \param f endpoint obtained via mnl_fake_start()
+ * \param req dump request that is answered
+ * \param count number of entries in the dump
+ * \param intr_at index of the first entry flagged with NLM_F_DUMP_INTR,
+ * use UINT64_MAX for a consistent dump
+ * \param cb callback that builds each entry
+ * \param data pointer that is passed to the callback
+ *
+ * The callback is called from mnl_socket_recvfrom() with the index of the
+ * entry and a message whose header is already set: the type and the
+ * sequence number of the request, the port ID of the socket and the
+ * NLM_F_MULTI flag. It adds the family header and the attributes, and it
+ * may change the type. An entry must not exceed 64 KBytes.
+ *
+ * The callback returns MNL_CB_OK to go on with the next entry, MNL_CB_STOP
+ * to finish the dump before count entries, or MNL_CB_ERROR to finish it
+ * with an error: the NLMSG_DONE message then carries the value of errno.
+ *
+ * On error, this function returns -1 and errno is appropriately set.
+ * On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_fake_dump);
+int mnl_fake_dump(struct mnl_fake *f, const struct nlmsghdr *req,
+		  uint64_t count, uint64_t intr_at, mnl_fake_dump_cb_t cb,
+		  void *data)
+{
+	struct mnl_fake_dump *d;
+
+	d = mnl_fake_push(f, MNL_FAKE_DUMP, sizeof(struct mnl_fake_dump));
+	if (d == NULL)
+		return -1;
+
+	memset(d, 0, sizeof(struct mnl_fake_dump));
+	d->count = count;
+	d->intr_at = intr_at;
+	d->cb = cb;
+	d->data = data;
+	d->seq = req->nlmsg_seq;
+	d->type = req->nlmsg_type;
+	f->dumps++;
+
+	return 0;
+}
+
+static uint16_t mnl_fake_dump_flags(const struct mnl_fake_dump *d)
+{
+	return NLM_F_MULTI | (d->idx >= d->intr_at ? NLM_F_DUMP_INTR : 0);
+}
+
+static struct mnl_fake_dump *mnl_fake_dump_head(struct mnl_fake *f)
+{
+	return (struct mnl_fake_dump *)(f->queue + f->head +
+					sizeof(struct mnl_fake_rec));
+}
+
+static ssize_t mnl_fake_recv_dump(struct mnl_fake *f, char *buf, size_t bufsiz)
+{
+	size_t done_len = MNL_NLMSG_HDRLEN + MNL_ALIGN(sizeof(int));
+	uint32_t portid = f->nl ? mnl_socket_get_portid(f->nl) : 0;
+	struct mnl_fake_dump dump, *d = &dump;
+	bool done = false;
+	size_t off = 0;
+
+	/* the callback may push datagrams, which moves the queue around, so
+	 * work on a copy of the state that is stored back at the end. */
+	memcpy(d, mnl_fake_dump_head(f), sizeof(*d));
+
+	for (;;) {
+		struct nlmsghdr *nlh;
+
+		if (!f->pending && (d->stopped || d->idx >= d->count)) {
+			if (off + done_len > bufsiz)
+				break;
+
+			nlh = mnl_nlmsg_put_header(buf + off);
+			nlh->nlmsg_type = NLMSG_DONE;
+			nlh->nlmsg_flags = mnl_fake_dump_flags(d);
+			nlh->nlmsg_seq = d->seq;
+			nlh->nlmsg_pid = portid;
+			*(int *)mnl_nlmsg_put_extra_header(nlh, sizeof(int)) =
+				d->error;
+			off += done_len;
+			done = true;
+			break;
+		}
+		if (!f->pending) {
+			int ret;
+
+			nlh = mnl_nlmsg_put_header(f->scratch);
+			nlh->nlmsg_type = d->type;
+			nlh->nlmsg_flags = mnl_fake_dump_flags(d);
+			nlh->nlmsg_seq = d->seq;
+			nlh->nlmsg_pid = portid;
+
+			ret = d->cb(nlh, d->idx, d->data);
+			if (ret <= MNL_CB_STOP) {
+				d->stopped = true;
+				if (ret < MNL_CB_STOP)
+					d->error = -errno;
+				continue;
+			}
+			d->idx++;
+			f->pending = MNL_ALIGN(nlh->nlmsg_len);
+		}
+		if (off + f->pending > bufsiz)
+			break;
+
+		memcpy(buf + off, f->scratch, f->pending);
+		off += f->pending;
+		f->pending = 0;
+	}
+	if (done) {
+		mnl_fake_pop(f);
+		return off;
+	}
+	memcpy(mnl_fake_dump_head(f), d, sizeof(*d));
+
+	if (off == 0) {
+		/* as the kernel would truncate it, drop what does not fit. */
+		if (f->pending)
+			f->pending = 0;
+		else
+			mnl_fake_pop(f);
+
+		errno = ENOSPC;
+		return -1;
+	}
+	return off;
+}
+
+void __mnl_fake_detach(struct mnl_fake *f)
+{
+	f->nl = NULL;
+}
+
+ssize_t __mnl_fake_recvfrom(struct mnl_fake *f, void *buf, size_t bufsiz)
+{
+	struct mnl_fake_rec *rec;
+	size_t len;
+
+	if (f->error) {
+		errno = f->error;
+		f->error = 0;
+		return -1;
+	}
+	if (f->head == f->tail) {
+		errno = EAGAIN;
+		return -1;
+	}
+	rec = (struct mnl_fake_rec *)(f->queue + f->head);
+	if (rec->kind == MNL_FAKE_DUMP)
+		return mnl_fake_recv_dump(f, buf, bufsiz);
+
+	len = rec->len;
+	if (len > bufsiz) {
+		memcpy(buf, rec + 1, bufsiz);
+		mnl_fake_pop(f);
+		errno = ENOSPC;
+		return -1;
+	}
+	memcpy(buf, rec + 1, len);
+	mnl_fake_pop(f);
+
+	return len;
+}
+
+ssize_t __mnl_fake_sendto(struct mnl_fake *f, const void *buf, size_t len)
+{
+	const struct nlmsghdr *nlh = buf;
+	int rem = len;
+
+	while (mnl_nlmsg_ok(nlh, rem)) {
+		unsigned int dumps = f->dumps;
+		int ret = 0;
+
+		if (nlh->nlmsg_type < NLMSG_MIN_TYPE)
+			goto next;
+
+		if (f->cb)
+			ret = f->cb(f, nlh, f->data);
+
+		if (ret < 0 || ((nlh->nlmsg_flags & NLM_F_ACK) &&
+				f->dumps == dumps))
+			mnl_fake_ack(f, nlh, ret < 0 ? ret : 0);
+next:
+		nlh = mnl_nlmsg_next(nlh, &rem);
+	}
+	return len;
+}
+
+/**
+ * @}
+ */
@@ -9,4 +9,18 @@
 #	define EXPORT_SYMBOL
 #endif
 
+#include <sys/types.h>
+#include <stdint.h>
+
+struct mnl_socket;
+struct mnl_fake;
+
+/* glue between the socket helpers and the fake kernel endpoint. */
+struct mnl_socket *__mnl_socket_fake(struct mnl_fake *f, int bus,
+				     uint32_t portid);
+void __mnl_socket_unfake(struct mnl_socket *nl);
+void __mnl_fake_detach(struct mnl_fake *f);
+ssize_t __mnl_fake_sendto(struct mnl_fake *f, const void *buf, size_t len);
+ssize_t __mnl_fake_recvfrom(struct mnl_fake *f, void *buf, size_t bufsiz);
+
 #endif
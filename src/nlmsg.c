@@ -564,3 +564,511 @@ bool mnl_nlmsg_batch_is_empty(struct mnl_nlmsg_batch *b)
 /**
  * @}
  */
+
+/**
+ * \defgroup batch_ack Netlink batch acknowledgment helpers
+ *
+ * If you send a batch of messages with NLM_F_ACK set, the kernel replies
+ * with one NLMSG_ERROR message per request. Since these replies may span
+ * several datagrams, you have to correlate them with the messages in the
+ * batch via the sequence number. These helpers do this work for you: they
+ * record the sequence number range of the batch that you have sent, then
+ * they consume the acknowledgment stream and keep one bit per message to
+ * know whether it has been acknowledged and whether it has failed.
+ *
+ * Each message in the batch is identified by its index, which is the
+ * distance between its sequence number and the lowest sequence number that
+ * was found in the batch. Thus, the messages in the batch must use distinct
+ * sequence numbers, which is what you usually do anyway.
+ *
+ * This allows you to retry the failed messages selectively, instead of
+ * sending the whole batch again.
+ *
+ * @{
+ */
+
+#define MNL_BITMAP_WORDS(n)	(((n) + 31) / 32)
+
+static inline void mnl_bitmap_set(uint32_t *map, unsigned int bit)
+{
+	map[bit / 32] |= 1U << (bit % 32);
+}
+
+static inline bool mnl_bitmap_test(const uint32_t *map, unsigned int bit)
+{
+	return map[bit / 32] & (1U << (bit % 32));
+}
+
+struct mnl_nlmsg_batch_ack {
+	/* lowest sequence number in the batch. */
+	uint32_t	seq;
+	/* number of sequence numbers that are covered. */
+	unsigned int	count;
+	/* number of acknowledgments that we are still waiting for. */
+	unsigned int	pending;
+	/* messages that requested an acknowledgment (NLM_F_ACK). */
+	uint32_t	*expect;
+	/* messages that received an acknowledgment or an error. */
+	uint32_t	*done;
+	/* messages that have failed. */
+	uint32_t	*failed;
+	/* errno value for each message, zero if it has not failed. */
+	uint16_t	*error;
+};
+
+/**
+ * mnl_nlmsg_batch_ack_start - start tracking acknowledgments of a batch
+ * \param buf pointer to the buffer that contains the batch
+ * \param len length of the batch
+ *
+ * This function walks over the messages that are stored in the buffer to
+ * obtain the sequence number range of the batch. You usually pass the
+ * values returned by mnl_nlmsg_batch_head() and mnl_nlmsg_batch_size(),
+ * although any buffer that contains a sequence of Netlink messages is fine.
+ * Messages whose sequence number is zero are not tracked.
+ *
+ * On error, it returns NULL and errno is set. If the buffer contains no
+ * messages, errno is set to EINVAL. Otherwise, it returns a pointer to the
+ * object that you have to release via mnl_nlmsg_batch_ack_stop().
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_start);
+struct mnl_nlmsg_batch_ack *mnl_nlmsg_batch_ack_start(const void *buf,
+						      size_t len)
+{
+	const struct nlmsghdr *nlh = buf;
+	struct mnl_nlmsg_batch_ack *a;
+	uint32_t first, span = 0;
+	unsigned int words;
+	int rem = len;
+	char *ptr;
+
+	if (!mnl_nlmsg_ok(nlh, rem)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* sequence numbers may wrap around, so the range is expressed as
+	 * an offset to the lowest sequence number that we have seen. Zero is
+	 * reserved for events and it is skipped later on, leave it out of
+	 * the range, otherwise it could span most of the sequence space. */
+	first = 0;
+	for (; mnl_nlmsg_ok(nlh, rem); nlh = mnl_nlmsg_next(nlh, &rem)) {
+		uint32_t diff = nlh->nlmsg_seq - first;
+
+		if (nlh->nlmsg_seq == 0)
+			continue;
+
+		if (first == 0) {
+			first = nlh->nlmsg_seq;
+		} else if (diff > INT32_MAX) {
+			span += first - nlh->nlmsg_seq;
+			first = nlh->nlmsg_seq;
+		} else if (diff > span) {
+			span = diff;
+		}
+	}
+	if (span >= INT32_MAX) {
+		errno = ERANGE;
+		return NULL;
+	}
+
+	words = MNL_BITMAP_WORDS(span + 1);
+	a = calloc(1, sizeof(struct mnl_nlmsg_batch_ack) +
+		      3 * words * sizeof(uint32_t) +
+		      (span + 1) * sizeof(uint16_t));
+	if (a == NULL)
+		return NULL;
+
+	ptr = (char *)a + sizeof(struct mnl_nlmsg_batch_ack);
+	a->expect = (uint32_t *)ptr;
+	a->done = a->expect + words;
+	a->failed = a->done + words;
+	a->error = (uint16_t *)(a->failed + words);
+	a->seq = first;
+	a->count = span + 1;
+
+	nlh = buf;
+	rem = len;
+	while (mnl_nlmsg_ok(nlh, rem)) {
+		unsigned int i = nlh->nlmsg_seq - first;
+
+		/* sequence number zero is skipped by mnl_nlmsg_batch_ack_run()
+		 * since it is reserved for events, don't wait for it. */
+		if ((nlh->nlmsg_flags & NLM_F_ACK) && nlh->nlmsg_seq != 0 &&
+		    !mnl_bitmap_test(a->expect, i)) {
+			mnl_bitmap_set(a->expect, i);
+			a->pending++;
+		}
+		nlh = mnl_nlmsg_next(nlh, &rem);
+	}
+	return a;
+}
+
+/**
+ * mnl_nlmsg_batch_ack_stop - release a batch acknowledgment tracker
+ * \param a pointer to the object returned by mnl_nlmsg_batch_ack_start()
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_stop);
+void mnl_nlmsg_batch_ack_stop(struct mnl_nlmsg_batch_ack *a)
+{
+	free(a);
+}
+
+/**
+ * mnl_nlmsg_batch_ack_run - consume acknowledgments for a batch
+ * \param a pointer to the batch acknowledgment tracker
+ * \param buf buffer that contains the netlink messages
+ * \param numbytes number of bytes stored in the buffer
+ * \param portid Netlink PortID that we expect to receive
+ * \param cb_err callback handler for errors (optional)
+ * \param data pointer to data that will be passed to cb_err
+ *
+ * This function consumes the NLMSG_ERROR messages that are stored in the
+ * buffer and records the result for the corresponding message in the batch.
+ * Messages whose sequence number is zero are skipped, as well as any other
+ * message that is not NLMSG_ERROR, so you can use the same socket to
+ * listen to events.
+ *
+ * If cb_err is not NULL, it is called for each error that is reported. If
+ * you have enabled NETLINK_EXT_ACK, you can use it to parse the extended
+ * acknowledgment attributes (see enum nlmsgerr_attrs) that follow the
+ * original message. If this callback returns MNL_CB_STOP or MNL_CB_ERROR,
+ * this function stops and propagates the return value.
+ *
+ * This function returns MNL_CB_STOP once all the acknowledgments that were
+ * requested have been received, and MNL_CB_OK if there are still pending
+ * ones, so you have to call it again with the next datagram. On error, it
+ * returns -1 and errno is explicitly set. If the portID is not the expected,
+ * errno is set to ESRCH. If the sequence number does not belong to this
+ * batch, errno is set to EPROTO. If the error message is malformed, errno is
+ * set to EBADMSG.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_run);
+int mnl_nlmsg_batch_ack_run(struct mnl_nlmsg_batch_ack *a, const void *buf,
+			    size_t numbytes, unsigned int portid,
+			    mnl_cb_t cb_err, void *data)
+{
+	const struct nlmsghdr *nlh = buf;
+	int ret, len = numbytes;
+
+	while (mnl_nlmsg_ok(nlh, len)) {
+		const struct nlmsgerr *err;
+		unsigned int i;
+
+		if (nlh->nlmsg_type != NLMSG_ERROR || nlh->nlmsg_seq == 0)
+			goto next;
+
+		if (!mnl_nlmsg_portid_ok(nlh, portid)) {
+			errno = ESRCH;
+			return -1;
+		}
+		i = nlh->nlmsg_seq - a->seq;
+		if (i >= a->count) {
+			errno = EPROTO;
+			return -1;
+		}
+		if (nlh->nlmsg_len < mnl_nlmsg_size(sizeof(struct nlmsgerr))) {
+			errno = EBADMSG;
+			return -1;
+		}
+		if (mnl_bitmap_test(a->done, i))
+			goto next;
+
+		mnl_bitmap_set(a->done, i);
+		if (mnl_bitmap_test(a->expect, i))
+			a->pending--;
+
+		err = mnl_nlmsg_get_payload(nlh);
+		if (err->error != 0) {
+			/* Netlink subsystems returns the errno value with
+			 * different signess */
+			a->error[i] = err->error < 0 ? -err->error : err->error;
+			mnl_bitmap_set(a->failed, i);
+
+			if (cb_err) {
+				ret = cb_err(nlh, data);
+				if (ret <= MNL_CB_STOP)
+					return ret;
+			}
+		}
+next:
+		nlh = mnl_nlmsg_next(nlh, &len);
+	}
+	return a->pending > 0 ? MNL_CB_OK : MNL_CB_STOP;
+}
+
+/**
+ * mnl_nlmsg_batch_ack_pending - number of acknowledgments still pending
+ * \param a pointer to the batch acknowledgment tracker
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_pending);
+unsigned int mnl_nlmsg_batch_ack_pending(const struct mnl_nlmsg_batch_ack *a)
+{
+	return a->pending;
+}
+
+/**
+ * mnl_nlmsg_batch_ack_count - number of sequence numbers in the batch
+ * \param a pointer to the batch acknowledgment tracker
+ *
+ * This function returns the number of sequence numbers that are covered
+ * by this batch, which is the number of valid message indexes.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_count);
+unsigned int mnl_nlmsg_batch_ack_count(const struct mnl_nlmsg_batch_ack *a)
+{
+	return a->count;
+}
+
+/**
+ * mnl_nlmsg_batch_ack_get_seq - get the sequence number of a message
+ * \param a pointer to the batch acknowledgment tracker
+ * \param index index of the message in the batch
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_get_seq);
+uint32_t mnl_nlmsg_batch_ack_get_seq(const struct mnl_nlmsg_batch_ack *a,
+				     unsigned int index)
+{
+	return a->seq + index;
+}
+
+/**
+ * mnl_nlmsg_batch_ack_get_error - get the result for a message in the batch
+ * \param a pointer to the batch acknowledgment tracker
+ * \param index index of the message in the batch
+ *
+ * This function returns the errno value that the kernel has reported for
+ * this message. If this message has not failed (so far), it returns zero.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_get_error);
+int mnl_nlmsg_batch_ack_get_error(const struct mnl_nlmsg_batch_ack *a,
+				  unsigned int index)
+{
+	if (index >= a->count)
+		return 0;
+	return a->error[index];
+}
+
+/**
+ * mnl_nlmsg_batch_ack_next_failed - look up the next failed message
+ * \param a pointer to the batch acknowledgment tracker
+ * \param index index of the message to start searching from
+ *
+ * This function returns the index of the first message that has failed
+ * starting from the index passed as parameter (inclusive), or -1 if there
+ * are no more failed messages. You can iterate over the failed messages
+ * with:
+ *
+ * \verbatim
+	for (i = mnl_nlmsg_batch_ack_next_failed(a, 0); i >= 0;
+	     i = mnl_nlmsg_batch_ack_next_failed(a, i + 1))
+\endverbatim
+ */
+EXPORT_SYMBOL(mnl_nlmsg_batch_ack_next_failed);
+int mnl_nlmsg_batch_ack_next_failed(const struct mnl_nlmsg_batch_ack *a,
+				    unsigned int index)
+{
+	unsigned int w = index / 32;
+	uint32_t word;
+
+	if (index >= a->count)
+		return -1;
+
+	/* mask out the bits below index in the first word. */
+	word = a->failed[w] & (~0U << (index % 32));
+	while (word == 0) {
+		if (++w >= MNL_BITMAP_WORDS(a->count))
+			return -1;
+		word = a->failed[w];
+	}
+	return w * 32 + __builtin_ctz(word);
+}
+
+/**
+ * @}
+ */
+
+/**
+ * \defgroup tmpl Netlink message templates
+ *
+ * If you send the same message over and over again with only a few fields
+ * that change, eg. verdicts for packets, you can build the message once and
+ * turn it into a template. Then, each new message is a copy of the template
+ * where the variable fields are patched.
+ *
+ * To create a template, build the message as usual and pass it to
+ * mnl_nlmsg_tmpl_start(), then register the variable fields with
+ * mnl_nlmsg_tmpl_add_field(). The template keeps its own copy of the
+ * message and the offset of each field.
+ *
+ * Each call to mnl_nlmsg_tmpl_put() copies the template into your buffer
+ * and assigns the next sequence number to the new message. You can use
+ * mnl_nlmsg_tmpl_set_field() to patch the fields of this copy.
+ *
+ * @{
+ */
+
+struct mnl_nlmsg_tmpl_field {
+	uint32_t	offset;
+	uint32_t	len;
+};
+
+struct mnl_nlmsg_tmpl {
+	/* sequence number for the next message. */
+	uint32_t			seq;
+	unsigned int			num_fields;
+	unsigned int			max_fields;
+	struct mnl_nlmsg_tmpl_field	*fields;
+	/* copy of the message, aligned to MNL_ALIGNTO. */
+	struct nlmsghdr			*nlh;
+};
+
+/**
+ * mnl_nlmsg_tmpl_start - create a message template
+ * \param nlh pointer to the message that is used as template
+ * \param max_fields maximum number of variable fields
+ *
+ * This function copies the message, so you can release it or reuse the
+ * buffer afterwards. The sequence number of the message is the one that
+ * is assigned to the first message that is obtained from this template.
+ *
+ * On error, it returns NULL and errno is set. Otherwise, it returns a pointer
+ * to the template that you have to release via mnl_nlmsg_tmpl_stop().
+ */
+EXPORT_SYMBOL(mnl_nlmsg_tmpl_start);
+struct mnl_nlmsg_tmpl *mnl_nlmsg_tmpl_start(const struct nlmsghdr *nlh,
+					    unsigned int max_fields)
+{
+	struct mnl_nlmsg_tmpl *t;
+	size_t fields_len = max_fields * sizeof(struct mnl_nlmsg_tmpl_field);
+
+	if (nlh->nlmsg_len < MNL_NLMSG_HDRLEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	t = malloc(sizeof(struct mnl_nlmsg_tmpl) + fields_len +
+		   MNL_ALIGN(nlh->nlmsg_len));
+	if (t == NULL)
+		return NULL;
+
+	t->seq = nlh->nlmsg_seq;
+	t->num_fields = 0;
+	t->max_fields = max_fields;
+	t->fields = (struct mnl_nlmsg_tmpl_field *)(t + 1);
+	t->nlh = (struct nlmsghdr *)((char *)t->fields + fields_len);
+	memcpy(t->nlh, nlh, nlh->nlmsg_len);
+	/* copy the padding too, so that the copies are whole. */
+	memset((char *)t->nlh + nlh->nlmsg_len, 0,
+	       MNL_ALIGN(nlh->nlmsg_len) - nlh->nlmsg_len);
+
+	return t;
+}
+
+/**
+ * mnl_nlmsg_tmpl_stop - release a message template
+ * \param t pointer to the template
+ */
+EXPORT_SYMBOL(mnl_nlmsg_tmpl_stop);
+void mnl_nlmsg_tmpl_stop(struct mnl_nlmsg_tmpl *t)
+{
+	free(t);
+}
+
+/**
+ * mnl_nlmsg_tmpl_add_field - register a variable field in the template
+ * \param t pointer to the template
+ * \param nlh pointer to the message that was passed to mnl_nlmsg_tmpl_start()
+ * or to any message obtained from this template
+ * \param field pointer to the field inside that message
+ * \param len length of the field
+ *
+ * The field is identified by its offset to the beginning of the message,
+ * so you can pass a pointer into the original message, eg. the payload of
+ * an attribute obtained via mnl_attr_get_payload().
+ *
+ * On error, it returns -1 and errno is set to ENOSPC if there is no room
+ * for more fields, or to EINVAL if the field is not inside the message.
+ * Otherwise, it returns the index of the field that you have to pass to
+ * mnl_nlmsg_tmpl_set_field().
+ */
+EXPORT_SYMBOL(mnl_nlmsg_tmpl_add_field);
+int mnl_nlmsg_tmpl_add_field(struct mnl_nlmsg_tmpl *t,
+			     const struct nlmsghdr *nlh, const void *field,
+			     size_t len)
+{
+	size_t offset = (const char *)field - (const char *)nlh;
+
+	if ((const char *)field < (const char *)nlh ||
+	    offset + len > t->nlh->nlmsg_len) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (t->num_fields >= t->max_fields) {
+		errno = ENOSPC;
+		return -1;
+	}
+	t->fields[t->num_fields].offset = offset;
+	t->fields[t->num_fields].len = len;
+
+	return t->num_fields++;
+}
+
+/**
+ * mnl_nlmsg_tmpl_put - obtain a new message from the template
+ * \param t pointer to the template
+ * \param buf memory to store the new message, eg. from
+ * mnl_nlmsg_batch_current()
+ *
+ * This function copies the template into the buffer and sets the sequence
+ * number of the new message, which is incremented for each message. The
+ * buffer must have room for the whole message, ie. nlmsg_len of the
+ * template message aligned to MNL_ALIGNTO. This function returns a pointer
+ * to the new message.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_tmpl_put);
+struct nlmsghdr *mnl_nlmsg_tmpl_put(struct mnl_nlmsg_tmpl *t, void *buf)
+{
+	struct nlmsghdr *nlh = buf;
+
+	memcpy(buf, t->nlh, MNL_ALIGN(t->nlh->nlmsg_len));
+	nlh->nlmsg_seq = t->seq++;
+	return nlh;
+}
+
+/**
+ * mnl_nlmsg_tmpl_set_field - patch a variable field in a message
+ * \param t pointer to the template
+ * \param nlh pointer to a message obtained via mnl_nlmsg_tmpl_put()
+ * \param index index of the field returned by mnl_nlmsg_tmpl_add_field()
+ * \param data pointer to the new value, of the length of the field
+ */
+EXPORT_SYMBOL(mnl_nlmsg_tmpl_set_field);
+void mnl_nlmsg_tmpl_set_field(const struct mnl_nlmsg_tmpl *t,
+			      struct nlmsghdr *nlh, unsigned int index,
+			      const void *data)
+{
+	const struct mnl_nlmsg_tmpl_field *f = &t->fields[index];
+
+	memcpy((char *)nlh + f->offset, data, f->len);
+}
+
+/**
+ * mnl_nlmsg_tmpl_get_field - get a pointer to a variable field in a message
+ * \param t pointer to the template
+ * \param nlh pointer to a message obtained via mnl_nlmsg_tmpl_put()
+ * \param index index of the field returned by mnl_nlmsg_tmpl_add_field()
+ *
+ * This is useful if you prefer to patch the field yourself. Note that the
+ * field may not be aligned to its natural type alignment.
+ */
+EXPORT_SYMBOL(mnl_nlmsg_tmpl_get_field);
+void *mnl_nlmsg_tmpl_get_field(const struct mnl_nlmsg_tmpl *t,
+			       struct nlmsghdr *nlh, unsigned int index)
+{
+	return (char *)nlh + t->fields[index].offset;
+}
+
+/**
+ * @}
+ */
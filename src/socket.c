@@ -69,6 +69,11 @@
 struct mnl_socket {
 	int 			fd;
 	struct sockaddr_nl	addr;
+	/* capture, see mnl_socket_set_tap(). */
+	struct mnl_tap		*tap;
+	uint16_t		protocol;
+	/* kernel stand-in, see mnl_fake_socket(). */
+	struct mnl_fake		*fake;
 };
 
 /**
@@ -185,6 +190,29 @@ struct mnl_socket *mnl_socket_fdopen(int fd)
 	return nl;
 }
 
+struct mnl_socket *__mnl_socket_fake(struct mnl_fake *f, int bus,
+				     uint32_t portid)
+{
+	struct mnl_socket *nl;
+
+	nl = calloc(1, sizeof(struct mnl_socket));
+	if (nl == NULL)
+		return NULL;
+
+	nl->fd = -1;
+	nl->addr.nl_family = AF_NETLINK;
+	nl->addr.nl_pid = portid;
+	nl->protocol = bus;
+	nl->fake = f;
+
+	return nl;
+}
+
+void __mnl_socket_unfake(struct mnl_socket *nl)
+{
+	nl->fake = NULL;
+}
+
 /**
  * mnl_socket_bind - bind netlink socket
  * \param nl netlink socket obtained via mnl_socket_open()
@@ -201,6 +229,13 @@ int mnl_socket_bind(struct mnl_socket *nl, unsigned int groups, pid_t pid)
 	int ret;
 	socklen_t addr_len;
 
+	if (nl->fake) {
+		nl->addr.nl_groups = groups;
+		if (pid)
+			nl->addr.nl_pid = pid;
+		return 0;
+	}
+
 	nl->addr.nl_family = AF_NETLINK;
 	nl->addr.nl_groups = groups;
 	nl->addr.nl_pid = pid;
@@ -241,8 +276,17 @@ ssize_t mnl_socket_sendto(const struct mnl_socket *nl, const void *buf,
 	static const struct sockaddr_nl snl = {
 		.nl_family = AF_NETLINK
 	};
-	return sendto(nl->fd, buf, len, 0, 
-		      (struct sockaddr *) &snl, sizeof(snl));
+	ssize_t ret;
+
+	if (nl->fake)
+		ret = __mnl_fake_sendto(nl->fake, buf, len);
+	else
+		ret = sendto(nl->fd, buf, len, 0,
+			     (struct sockaddr *) &snl, sizeof(snl));
+	if (ret > 0 && nl->tap)
+		mnl_tap_put(nl->tap, buf, ret, nl->protocol, MNL_TAP_SEND);
+
+	return ret;
 }
 
 /**
@@ -278,6 +322,12 @@ ssize_t mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf,
 		.msg_controllen	= 0,
 		.msg_flags	= 0,
 	};
+	if (nl->fake) {
+		ret = __mnl_fake_recvfrom(nl->fake, buf, bufsiz);
+		if (ret == -1)
+			return ret;
+		goto out;
+	}
 	ret = recvmsg(nl->fd, &msg, 0);
 	if (ret == -1)
 		return ret;
@@ -290,6 +340,10 @@ ssize_t mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf,
 		errno = EINVAL;
 		return -1;
 	}
+out:
+	if (nl->tap)
+		mnl_tap_put(nl->tap, buf, ret, nl->protocol, MNL_TAP_RECV);
+
 	return ret;
 }
 
@@ -303,7 +357,14 @@ ssize_t mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf,
 EXPORT_SYMBOL(mnl_socket_close);
 int mnl_socket_close(struct mnl_socket *nl)
 {
-	int ret = close(nl->fd);
+	int ret;
+
+	if (nl->fake) {
+		__mnl_fake_detach(nl->fake);
+		free(nl);
+		return 0;
+	}
+	ret = close(nl->fd);
 	free(nl);
 	return ret;
 }
@@ -337,6 +398,9 @@ EXPORT_SYMBOL(mnl_socket_setsockopt);
 int mnl_socket_setsockopt(const struct mnl_socket *nl, int type,
 			  void *buf, socklen_t len)
 {
+	if (nl->fake)
+		return 0;
+
 	return setsockopt(nl->fd, SOL_NETLINK, type, buf, len);
 }
 
@@ -353,9 +417,43 @@ EXPORT_SYMBOL(mnl_socket_getsockopt);
 int mnl_socket_getsockopt(const struct mnl_socket *nl, int type,
 			  void *buf, socklen_t *len)
 {
+	if (nl->fake) {
+		errno = ENOPROTOOPT;
+		return -1;
+	}
 	return getsockopt(nl->fd, SOL_NETLINK, type, buf, len);
 }
 
+/**
+ * mnl_socket_set_tap - record the traffic of a netlink socket
+ * \param nl netlink socket obtained via mnl_socket_open()
+ * \param t tap obtained via mnl_tap_start(), NULL to stop recording
+ *
+ * From now on, the datagrams that are sent with mnl_socket_sendto() and
+ * received with mnl_socket_recvfrom() are recorded into the tap, see the
+ * tap group for more details. One tap can be attached to several sockets,
+ * as long as they are used by the same thread.
+ *
+ * On error, this function returns -1 and errno is appropriately set.
+ * On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_socket_set_tap);
+int mnl_socket_set_tap(struct mnl_socket *nl, struct mnl_tap *t)
+{
+	socklen_t len = sizeof(int);
+	int protocol;
+
+	if (t && !nl->fake &&
+	    getsockopt(nl->fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &len) < 0)
+		return -1;
+
+	nl->tap = t;
+	if (t && !nl->fake)
+		nl->protocol = protocol;
+
+	return 0;
+}
+
 /**
  * @}
  */
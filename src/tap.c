@@ -0,0 +1,378 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <libmnl/libmnl.h>
+#include "internal.h"
+
+/**
+ * \defgroup tap Netlink traffic capture
+ *
+ * A tap records the datagrams that go through one or more sockets into a
+ * pcap file, so that you can inspect them with the usual tools or replay
+ * them later. The records use LINKTYPE_NETLINK, which is what the nlmon
+ * device of the kernel provides: a 16-byte cooked header that tells the
+ * Netlink bus and the direction, followed by the datagram.
+ *
+ * Once it is attached via mnl_socket_set_tap(), every datagram sent with
+ * mnl_socket_sendto() and received with mnl_socket_recvfrom() is recorded.
+ * If you use sendmsg() or recvmsg() on the file descriptor directly, you
+ * can record the datagrams yourself via mnl_tap_put().
+ *
+ * The records are accumulated in a buffer that is written to the file
+ * descriptor only when it is full, so the cost of an enabled tap is one
+ * memory copy per datagram most of the time. No locks are taken: as it
+ * happens with sockets, a tap must not be used by several threads at the
+ * same time, open one tap per thread instead.
+ *
+ * The replay helpers walk over a capture in memory, eg. a file that you
+ * have mapped, and give you the datagrams one by one, so you can pass them
+ * to mnl_cb_run() to reproduce a problem or to benchmark your callbacks
+ * without a kernel.
+ *
+ * @{
+ */
+
+#define MNL_TAP_LINKTYPE	253	/* LINKTYPE_NETLINK */
+#define MNL_TAP_SNAPLEN		262144
+#define MNL_TAP_MAGIC_USEC	0xa1b2c3d4
+#define MNL_TAP_MAGIC_NSEC	0xa1b23c4d
+#define MNL_TAP_ARPHRD_NETLINK	824
+
+struct mnl_tap_file_hdr {
+	uint32_t	magic;
+	uint16_t	version_major;
+	uint16_t	version_minor;
+	int32_t		thiszone;
+	uint32_t	sigfigs;
+	uint32_t	snaplen;
+	uint32_t	linktype;
+};
+
+struct mnl_tap_rec_hdr {
+	uint32_t	ts_sec;
+	uint32_t	ts_frac;
+	uint32_t	incl_len;
+	uint32_t	orig_len;
+	/* cooked header, in network byte order. */
+	uint16_t	pkttype;
+	uint16_t	hatype;
+	uint16_t	halen;
+	uint8_t		addr[8];
+	uint16_t	protocol;
+};
+
+/* the cooked header is part of the captured data, hence of the snaplen. */
+#define MNL_TAP_COOKED_LEN	(sizeof(struct mnl_tap_rec_hdr) - \
+				 offsetof(struct mnl_tap_rec_hdr, pkttype))
+#define MNL_TAP_DATA_MAX	(MNL_TAP_SNAPLEN - MNL_TAP_COOKED_LEN)
+
+struct mnl_tap {
+	int	fd;
+	/* first write error, reported by mnl_tap_flush(). */
+	int	error;
+	size_t	len;
+	size_t	size;
+	char	buf[];
+};
+
+static int mnl_tap_write(int fd, const struct iovec *iov, int iovcnt)
+{
+	struct iovec v[iovcnt];
+	int i = 0;
+
+	memcpy(v, iov, sizeof(v));
+	while (i < iovcnt) {
+		ssize_t ret = writev(fd, &v[i], iovcnt - i);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		while (i < iovcnt && (size_t)ret >= v[i].iov_len)
+			ret -= v[i++].iov_len;
+		if (i < iovcnt) {
+			v[i].iov_base = (char *)v[i].iov_base + ret;
+			v[i].iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
+/**
+ * mnl_tap_start - allocate a tap that writes into a file descriptor
+ * \param fd file descriptor where the capture is written, eg. a file
+ * \param bufsiz size of the buffer that accumulates the records
+ *
+ * This function writes the pcap file header to fd, which is not closed by
+ * mnl_tap_stop(). A buffer of a few hundreds of kilobytes makes the writes
+ * rare, records that do not fit into the buffer are written directly.
+ *
+ * On error, it returns NULL and errno is set. Otherwise, it returns a pointer
+ * to the tap that you have to release via mnl_tap_stop().
+ */
+EXPORT_SYMBOL(mnl_tap_start);
+struct mnl_tap *mnl_tap_start(int fd, size_t bufsiz)
+{
+	struct mnl_tap_file_hdr hdr = {
+		.magic		= MNL_TAP_MAGIC_NSEC,
+		.version_major	= 2,
+		.version_minor	= 4,
+		.snaplen	= MNL_TAP_SNAPLEN,
+		.linktype	= MNL_TAP_LINKTYPE,
+	};
+	struct mnl_tap *t;
+
+	if (bufsiz < sizeof(struct mnl_tap_rec_hdr)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	t = malloc(sizeof(struct mnl_tap) + bufsiz);
+	if (t == NULL)
+		return NULL;
+
+	t->fd = fd;
+	t->error = 0;
+	t->len = 0;
+	t->size = bufsiz;
+
+	/* the header goes out right away, so the file is valid even if
+	 * nothing else is ever recorded. */
+	if (mnl_tap_write(fd, &(struct iovec){ &hdr, sizeof(hdr) }, 1) < 0) {
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+/**
+ * mnl_tap_flush - write the buffered records
+ * \param t pointer to the tap
+ *
+ * On error, it returns -1 and errno is set. Since the records are written
+ * in the background of the socket operations, this also reports the first
+ * error that happened since the previous call. On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_tap_flush);
+int mnl_tap_flush(struct mnl_tap *t)
+{
+	int error = t->error;
+
+	if (t->len > 0 &&
+	    mnl_tap_write(t->fd, &(struct iovec){ t->buf, t->len }, 1) < 0 &&
+	    error == 0)
+		error = errno;
+
+	t->len = 0;
+	t->error = 0;
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * mnl_tap_stop - write the buffered records and release the tap
+ * \param t pointer to the tap
+ *
+ * Detach the tap from the sockets before you call this function. Call
+ * mnl_tap_flush() before if you want to know if all the records have been
+ * written.
+ */
+EXPORT_SYMBOL(mnl_tap_stop);
+void mnl_tap_stop(struct mnl_tap *t)
+{
+	mnl_tap_flush(t);
+	free(t);
+}
+
+/**
+ * mnl_tap_put - record one datagram
+ * \param t pointer to the tap
+ * \param buf pointer to the datagram
+ * \param len length of the datagram
+ * \param protocol Netlink bus of the socket (see NETLINK_* constants)
+ * \param dir MNL_TAP_SEND or MNL_TAP_RECV
+ *
+ * Datagrams that do not fit into the snapshot length of the capture, 256 KB
+ * including the 16-byte cooked header, are truncated.
+ *
+ * On error, it returns -1 and errno is set. The error is also reported by
+ * the next call to mnl_tap_flush(). On success, it returns 0.
+ */
+EXPORT_SYMBOL(mnl_tap_put);
+int mnl_tap_put(struct mnl_tap *t, const void *buf, size_t len,
+		uint16_t protocol, enum mnl_tap_dir dir)
+{
+	struct mnl_tap_rec_hdr hdr = {
+		.pkttype	= htons(dir),
+		.hatype		= htons(MNL_TAP_ARPHRD_NETLINK),
+		.protocol	= htons(protocol),
+	};
+	size_t incl_len = len < MNL_TAP_DATA_MAX ? len : MNL_TAP_DATA_MAX;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	hdr.ts_sec = ts.tv_sec;
+	hdr.ts_frac = ts.tv_nsec;
+	hdr.incl_len = MNL_TAP_COOKED_LEN + incl_len;
+	hdr.orig_len = hdr.incl_len - incl_len + len;
+
+	if (t->len + sizeof(hdr) + incl_len > t->size) {
+		if (mnl_tap_flush(t) < 0)
+			goto err;
+
+		if (sizeof(hdr) + incl_len > t->size) {
+			struct iovec iov[] = {
+				{ &hdr, sizeof(hdr) },
+				{ (void *)buf, incl_len },
+			};
+
+			if (mnl_tap_write(t->fd, iov, 2) < 0)
+				goto err;
+
+			return 0;
+		}
+	}
+	memcpy(t->buf + t->len, &hdr, sizeof(hdr));
+	memcpy(t->buf + t->len + sizeof(hdr), buf, incl_len);
+	t->len += sizeof(hdr) + incl_len;
+	return 0;
+err:
+	if (t->error == 0)
+		t->error = errno;
+	return -1;
+}
+
+struct mnl_tap_replay {
+	const char	*data;
+	size_t		len;
+	size_t		off;
+	bool		nsec;
+};
+
+/**
+ * mnl_tap_replay_start - prepare to replay a capture
+ * \param data pointer to the capture, including the pcap file header
+ * \param len length of the capture
+ *
+ * The capture must be a pcap file in the byte order of this host that uses
+ * LINKTYPE_NETLINK, such as the ones written by a tap or by tcpdump on a
+ * nlmon device. The capture is not copied, it has to stay in place until
+ * mnl_tap_replay_stop() is called.
+ *
+ * On error, it returns NULL and errno is set, EINVAL means that this is not
+ * a suitable capture. Otherwise, it returns a pointer that you have to
+ * release via mnl_tap_replay_stop().
+ */
+EXPORT_SYMBOL(mnl_tap_replay_start);
+struct mnl_tap_replay *mnl_tap_replay_start(const void *data, size_t len)
+{
+	const struct mnl_tap_file_hdr *hdr = data;
+	struct mnl_tap_replay *r;
+
+	if (len < sizeof(*hdr) ||
+	    (hdr->magic != MNL_TAP_MAGIC_USEC &&
+	     hdr->magic != MNL_TAP_MAGIC_NSEC) ||
+	    hdr->linktype != MNL_TAP_LINKTYPE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	r = malloc(sizeof(struct mnl_tap_replay));
+	if (r == NULL)
+		return NULL;
+
+	r->data = data;
+	r->len = len;
+	r->off = sizeof(*hdr);
+	r->nsec = hdr->magic == MNL_TAP_MAGIC_NSEC;
+	return r;
+}
+
+/**
+ * mnl_tap_replay_stop - release the replay state
+ * \param r pointer obtained via mnl_tap_replay_start()
+ */
+EXPORT_SYMBOL(mnl_tap_replay_stop);
+void mnl_tap_replay_stop(struct mnl_tap_replay *r)
+{
+	free(r);
+}
+
+/**
+ * mnl_tap_replay_rewind - go back to the first datagram of the capture
+ * \param r pointer obtained via mnl_tap_replay_start()
+ *
+ * This is useful to replay the same capture in a loop for benchmarking.
+ */
+EXPORT_SYMBOL(mnl_tap_replay_rewind);
+void mnl_tap_replay_rewind(struct mnl_tap_replay *r)
+{
+	r->off = sizeof(struct mnl_tap_file_hdr);
+}
+
+/**
+ * mnl_tap_replay_next - get the next datagram of the capture
+ * \param r pointer obtained via mnl_tap_replay_start()
+ * \param info pointer to store the details of the datagram
+ *
+ * This function returns a pointer to the datagram in the capture, so that
+ * you can pass it to mnl_cb_run() with the length stored in info. Note that
+ * the datagram is aligned only if the length of the previous datagrams is
+ * a multiple of four, which is the case unless they have been truncated.
+ *
+ * At the end of the capture, it returns NULL and errno is set to zero. If
+ * the capture is malformed or truncated, it returns NULL and errno is set
+ * to EBADMSG.
+ */
+EXPORT_SYMBOL(mnl_tap_replay_next);
+const void *mnl_tap_replay_next(struct mnl_tap_replay *r,
+				struct mnl_tap_info *info)
+{
+	const size_t cooked = MNL_TAP_COOKED_LEN;
+	const size_t rec = offsetof(struct mnl_tap_rec_hdr, pkttype);
+	struct mnl_tap_rec_hdr hdr;
+
+	if (r->off == r->len) {
+		errno = 0;
+		return NULL;
+	}
+	if (r->len - r->off < sizeof(hdr))
+		goto err;
+
+	memcpy(&hdr, r->data + r->off, sizeof(hdr));
+	if (hdr.incl_len < cooked || hdr.incl_len > r->len - r->off - rec ||
+	    ntohs(hdr.hatype) != MNL_TAP_ARPHRD_NETLINK)
+		goto err;
+
+	info->sec = hdr.ts_sec;
+	info->nsec = r->nsec ? hdr.ts_frac : hdr.ts_frac * 1000;
+	info->protocol = ntohs(hdr.protocol);
+	info->dir = ntohs(hdr.pkttype);
+	info->len = hdr.incl_len - cooked;
+	info->orig_len = hdr.orig_len - cooked;
+
+	r->off += rec + hdr.incl_len;
+	return r->data + r->off - info->len;
+err:
+	errno = EBADMSG;
+	return NULL;
+}
+
+/**
+ * @}
+ */